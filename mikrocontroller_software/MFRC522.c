@@ -6,6 +6,9 @@
 
 #include <Arduino.h>
 #include <MFRC522.h>
+#include "main.h"
+#include "pins.h"
+#include "dds.h"
 
 /* private data of MFRC522 class */
 byte _chipSelectPin;		// Arduino pin connected to MFRC522's SPI slave select input (Pin 24, NSS, active low)
@@ -16,6 +19,10 @@ byte MIFARE_TwoStepHelper(byte command, byte blockAddr, long data);
 /* global data in MFRC522 class that had to be extracted to c file (otherwise linker is crying) */
 Uid uid;
 
+/* set by the interrupt of the IRQ pin of the MFRC522, see PCD_IrqHandler() */
+static volatile bool pcd_irq = false;
+static uint32_t pcd_start_ms;		// start of the running command, for the emergency timeout
+
 // Firmware data for self-test
 // Reference values based on firmware version; taken from 16.1.1 in spec.
 // Version 1.0
@@ -81,6 +88,32 @@ void setSPIConfig() {
 // Basic interface functions for communicating with the MFRC522
 /////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Selects the MFRC522 on the SPI bus. Same as digitalWrite(_chipSelectPin, LOW) in Arduino.c,
+ * but the port is resolved at compile time.
+ */
+static inline void PCD_Select() {
+	if (RFID_PORT & (1 << RFID_CS)) {
+		// only wait for the spi if RFID_CS is high, otherwise the controller could hang
+#ifdef CS_LED
+		LED_ON();
+#endif
+		while (SPI_get_state() != SPI_ON);
+#ifdef CS_LED
+		LED_OFF();
+#endif
+	}
+	RFID_PORT &= ~(1 << RFID_CS);
+} // End PCD_Select()
+
+/**
+ * Releases the MFRC522 on the SPI bus. Same as digitalWrite(_chipSelectPin, HIGH) in Arduino.c.
+ */
+static inline void PCD_Release() {
+	RFID_PORT |= (1 << RFID_CS);
+	dds_execute_command_buffer();		// execute all the dds commands that failed while rfid was sending
+} // End PCD_Release()
+
 /**
  * Writes a byte to the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
@@ -88,10 +121,10 @@ void setSPIConfig() {
 void PCD_WriteRegister(	byte reg,		///< The register to write to. One of the PCD_Register enums.
 						byte value		///< The value to write.
 					) {
-	digitalWrite(_chipSelectPin, LOW);		// Select slave
+	PCD_Select();							// Select slave
 	SPI_transfer(reg & 0x7E);				// MSB == 0 is for writing. LSB is not used in address. Datasheet section 8.1.2.3.
 	SPI_transfer(value);
-	digitalWrite(_chipSelectPin, HIGH);		// Release slave again
+	PCD_Release();							// Release slave again
 } // End PCD_WriteRegister()
 
 ///**
@@ -102,12 +135,12 @@ void PCD_WriteRegister_pointer(	byte reg,		///< The register to write to. One of
 									byte count,		///< The number of bytes to write to the register
 									byte *values	///< The values to write. Byte array.
 								) {
-	digitalWrite(_chipSelectPin, LOW);		// Select slave
+	PCD_Select();							// Select slave
 	SPI_transfer(reg & 0x7E);				// MSB == 0 is for writing. LSB is not used in address. Datasheet section 8.1.2.3.
 	for (byte index = 0; index < count; index++) {
 		SPI_transfer(values[index]);
 	}
-	digitalWrite(_chipSelectPin, HIGH);		// Release slave again
+	PCD_Release();							// Release slave again
 } // End PCD_WriteRegister()
 
 ///**
@@ -117,10 +150,10 @@ void PCD_WriteRegister_pointer(	byte reg,		///< The register to write to. One of
 byte PCD_ReadRegister_one(	byte reg	///< The register to read from. One of the PCD_Register enums.
 								) {
 	byte value;
-	digitalWrite(_chipSelectPin, LOW);			// Select slave
+	PCD_Select();							// Select slave
 	SPI_transfer(0x80 | (reg & 0x7E));			// MSB == 1 is for reading. LSB is not used in address. Datasheet section 8.1.2.3.
 	value = SPI_transfer(0);					// Read the value back. Send 0 to stop reading.
-	digitalWrite(_chipSelectPin, HIGH);			// Release slave again
+	PCD_Release();							// Release slave again
 	return value;
 } // End PCD_ReadRegister()
 
@@ -145,7 +178,7 @@ void PCD_ReadRegister(	byte reg,		///< The register to read from. One of the PCD
 	//Serial_print(F("Reading "));	Serial_print(count); Serial_println(F(" bytes from register."));
 	byte address = 0x80 | (reg & 0x7E);		// MSB == 1 is for reading. LSB is not used in address. Datasheet section 8.1.2.3.
 	byte index = 0;							// Index in values array.
-	digitalWrite(_chipSelectPin, LOW);		// Select slave
+	PCD_Select();							// Select slave
 	count--;								// One read is performed outside of the loop
 	SPI_transfer(address);					// Tell MFRC522 which address we want to read
 	while (index < count) {
@@ -166,9 +199,27 @@ void PCD_ReadRegister(	byte reg,		///< The register to read from. One of the PCD
 		index++;
 	}
 	values[index] = SPI_transfer(0);			// Read the final byte. Send 0 to stop reading.
-	digitalWrite(_chipSelectPin, HIGH);			// Release slave again
+	PCD_Release();							// Release slave again
 } // End PCD_ReadRegister()
 
+/**
+ * Reads several different registers in one SPI transfer (datasheet section 8.1.2.1),
+ * which saves the chip select handling of single register reads.
+ */
+void PCD_ReadRegisterList(	byte count,			///< The number of registers to read, at least one
+							const byte *regs,	///< The registers to read. One of the PCD_Register enums each.
+							byte *values		///< Byte array to store the values in.
+						) {
+	byte index;
+	PCD_Select();
+	SPI_transfer(0x80 | (regs[0] & 0x7E));		// MSB == 1 is for reading. LSB is not used in address.
+	for (index = 1; index < count; index++) {
+		values[index - 1] = SPI_transfer(0x80 | (regs[index] & 0x7E));	// Read value and send next address
+	}
+	values[count - 1] = SPI_transfer(0);		// Read the final byte. Send 0 to stop reading.
+	PCD_Release();
+} // End PCD_ReadRegisterList()
+
 ///**
 // * Sets the bits given in mask in register reg.
 // */
@@ -202,24 +253,31 @@ byte PCD_CalculateCRC(	byte *data,		///< In: Pointer to the data to transfer to
 								byte *result	///< Out: Pointer to result buffer. Result is written to result[0..1], low byte first.
 					 ) {
 	PCD_WriteRegister(CommandReg, PCD_Idle);		// Stop any active command.
+	PCD_WriteRegister(ComIrqReg, 0x7F);				// Clear the request bits of the last transceive, otherwise they keep the IRQ pin active
 	PCD_WriteRegister(DivIrqReg, 0x04);				// Clear the CRCIRq interrupt request bit
-	PCD_SetRegisterBitMask(FIFOLevelReg, 0x80);		// FlushBuffer = 1, FIFO initialization
+	PCD_WriteRegister(FIFOLevelReg, 0x80);			// FlushBuffer = 1, FIFO initialization. The other bits are read only.
 	PCD_WriteRegister_pointer(FIFODataReg, length, data);	// Write data to the FIFO
+	pcd_irq = false;
+	pcd_start_ms = main_get_time_ms();
 	PCD_WriteRegister(CommandReg, PCD_CalcCRC);		// Start the calculation
 
-	// Wait for the CRC calculation to complete. Each iteration of the while-loop takes 17.73�s.
-	word i = 5000;
+	// Wait for the CRC calculation to complete. CRCIRq is routed to the IRQ pin (see PCD_Init()),
+	// so DivIrqReg is only read after the interrupt or for the emergency break.
 	byte n;
 	while (1) {
-		n = PCD_ReadRegister_one(DivIrqReg);	// DivIrqReg[7..0] bits are: Set2 reserved reserved MfinActIRq reserved CRCIRq reserved reserved
-		if (n & 0x04) {						// CRCIRq bit set - calculation done
-			break;
-		}
-		if (--i == 0) {						// The emergency break. We will eventually terminate on this one after 89ms. Communication with the MFRC522 might be down.
-			return STATUS_TIMEOUT;
+		if (pcd_irq || main_get_time_ms() - pcd_start_ms > PCD_TIMEOUT_MS) {
+			n = PCD_ReadRegister_one(DivIrqReg);	// DivIrqReg[7..0] bits are: Set2 reserved reserved MfinActIRq reserved CRCIRq reserved reserved
+			if (n & 0x04) {						// CRCIRq bit set - calculation done
+				break;
+			}
+			if (!pcd_irq) {						// The emergency break. Communication with the MFRC522 might be down.
+				return STATUS_TIMEOUT;
+			}
+			pcd_irq = false;
 		}
 	}
 	PCD_WriteRegister(CommandReg, PCD_Idle);		// Stop calculating CRC for new content in the FIFO.
+	PCD_WriteRegister(DivIrqReg, 0x04);				// Clear CRCIRq again, otherwise the IRQ pin stays active
 
 	// Transfer the result from the registers to the result buffer
 	result[0] = PCD_ReadRegister_one(CRCResultRegL);
@@ -265,6 +323,11 @@ void PCD_Init() {
 
 	PCD_WriteRegister(TxASKReg, 0x40);		// Default 0x00. Force a 100 % ASK modulation independent of the ModGsPReg register setting
 	PCD_WriteRegister(ModeReg, 0x3D);		// Default 0x3F. Set the preset value for the CRC coprocessor for the CalcCRC command to 0x6363 (ISO 14443-3 part 6.2.4)
+
+	// Route the interrupts that end a command to the IRQ pin. Only these are enabled, because the pin stays
+	// active until all enabled request bits are cleared and the edge of a further interrupt would be lost.
+	PCD_WriteRegister(ComIEnReg, 0x80 | 0x31);	// IRqInv=1 (IRQ pin active low), RxIEn, IdleIEn, TimerIEn
+	PCD_WriteRegister(DivIEnReg, 0x80 | 0x04);	// IRQPushPull=1 (no pull up needed), CRCIEn
 	PCD_AntennaOn();						// Enable the antenna driver pins TX1 and TX2 (they were disabled by the reset)
 } // End PCD_Init()
 
@@ -293,6 +356,29 @@ void PCD_AntennaOn() {
 		PCD_WriteRegister(TxControlReg, value | 0x03);
 	}
 } // End PCD_AntennaOn()
+
+/**
+ * Enters the soft power-down mode (datasheet section 8.6.2). The oscillator and the antenna driver are switched off,
+ * the register values are kept.
+ */
+void PCD_SoftPowerDown() {
+	PCD_WriteRegister(CommandReg, PCD_Idle | 0x10);	// PowerDown=1
+} // End PCD_SoftPowerDown()
+
+/**
+ * Leaves the soft power-down mode without waiting for the oscillator.
+ * Use PCD_IsPoweredUp() to check when the MFRC522 is ready again.
+ */
+void PCD_SoftPowerUp() {
+	PCD_WriteRegister(CommandReg, PCD_Idle);		// PowerDown=0 starts the wake up
+} // End PCD_SoftPowerUp()
+
+/**
+ * @return true if the MFRC522 is not (any more) in soft power-down mode.
+ */
+bool PCD_IsPoweredUp() {
+	return (PCD_ReadRegister_one(CommandReg) & 0x10) == 0;	// The PowerDown bit stays set until the MFRC522 is ready
+} // End PCD_IsPoweredUp()
 //
 ///**
 // * Turns the antenna off by disabling pins TX1 and TX2.
@@ -308,22 +394,22 @@ void PCD_AntennaOn() {
 // *
 // * @return Value of the RxGain, scrubbed to the 3 bits used.
 // */
-//byte PCD_GetAntennaGain() {
-//	return PCD_ReadRegister_one(RFCfgReg) & (0x07<<4);
-//} // End PCD_GetAntennaGain()
-//
+byte PCD_GetAntennaGain() {
+	return PCD_ReadRegister_one(RFCfgReg) & (0x07<<4);
+} // End PCD_GetAntennaGain()
+
 ///**
 // * Set the MFRC522 Receiver Gain (RxGain) to value specified by given mask.
 // * See 9.3.3.6 / table 98 in http://www.nxp.com/documents/data_sheet/MFRC522.pdf
 // * NOTE: Given mask is scrubbed with (0x07<<4)=01110000b as RCFfgReg may use reserved bits.
 // */
-//void PCD_SetAntennaGain(byte mask) {
-//	if (PCD_GetAntennaGain() != mask) {						// only bother if there is a change
-//		PCD_ClearRegisterBitMask(RFCfgReg, (0x07<<4));		// clear needed to allow 000 pattern
-//		PCD_SetRegisterBitMask(RFCfgReg, mask & (0x07<<4));	// only set RxGain[2:0] bits
-//	}
-//} // End PCD_SetAntennaGain()
-//
+void PCD_SetAntennaGain(byte mask) {
+	if (PCD_GetAntennaGain() != mask) {						// only bother if there is a change
+		PCD_ClearRegisterBitMask(RFCfgReg, (0x07<<4));		// clear needed to allow 000 pattern
+		PCD_SetRegisterBitMask(RFCfgReg, mask & (0x07<<4));	// only set RxGain[2:0] bits
+	}
+} // End PCD_SetAntennaGain()
+
 ///**
 // * Performs a self-test of the MFRC522
 // * See 16.1.1 in http://www.nxp.com/documents/data_sheet/MFRC522.pdf
@@ -422,13 +508,13 @@ byte PCD_TransceiveData_five(	byte *sendData,		///< Pointer to the data to trans
 	return PCD_TransceiveData(sendData, sendLen, backData, backLen, validBits, 0, false);
 }
 
-//byte PCD_TransceiveData_four(	byte *sendData,		///< Pointer to the data to transfer to the FIFO.
-//									byte sendLen,		///< Number of bytes to transfer to the FIFO.
-//									byte *backData,		///< NULL or pointer to buffer if data should be read back after executing the command.
-//									byte *backLen		///< In: Max number of bytes to write to *backData. Out: The number of bytes returned.
-//						)	{
-//	return PCD_TransceiveData(sendData, sendLen, backData, backLen, NULL, 0, false);
-//}
+byte PCD_TransceiveData_four(	byte *sendData,		///< Pointer to the data to transfer to the FIFO.
+									byte sendLen,		///< Number of bytes to transfer to the FIFO.
+									byte *backData,		///< NULL or pointer to buffer if data should be read back after executing the command.
+									byte *backLen		///< In: Max number of bytes to write to *backData. Out: The number of bytes returned.
+						)	{
+	return PCD_TransceiveData(sendData, sendLen, backData, backLen, NULL, 0, false);
+}
 //
 //
 ///**
@@ -474,6 +560,8 @@ byte PCD_CommunicateWithPICC_seven(	byte command,		///< The command to execute.
  * Transfers data to the MFRC522 FIFO, executes a command, waits for completion and transfers data back from the FIFO.
  * CRC validation can only be done if backData and backLen are specified.
  *
+ * Blocking version of PCD_CommunicateStart(), PCD_CommunicatePoll() and PCD_CommunicateFinish().
+ *
  * @return STATUS_OK on success, STATUS_??? otherwise.
  */
 byte PCD_CommunicateWithPICC(	byte command,		///< The command to execute. One of the PCD_Command enums.
@@ -486,49 +574,106 @@ byte PCD_CommunicateWithPICC(	byte command,		///< The command to execute. One of
 										byte rxAlign,		///< In: Defines the bit position in backData[0] for the first bit received. Default 0.
 										bool checkCRC		///< In: True => The last two bytes of the response is assumed to be a CRC_A that must be validated.
 									 ) {
-	byte n, _validBits;
-	unsigned int i;
+	byte result;
 
-	// Prepare values for BitFramingReg
-	byte txLastBits = validBits ? *validBits : 0;
+	PCD_CommunicateStart(command, sendData, sendLen, validBits ? *validBits : 0, rxAlign);
+	do {
+		result = PCD_CommunicatePoll(waitIRq);
+	} while (result == STATUS_BUSY);
+	if (result != STATUS_OK) {
+		return result;
+	}
+	return PCD_CommunicateFinish(backData, backLen, validBits, rxAlign, checkCRC);
+} // End PCD_CommunicateWithPICC()
+
+/**
+ * Transfers data to the MFRC522 FIFO and starts a command without waiting for its completion.
+ * Call PCD_CommunicatePoll() until it does not return STATUS_BUSY any more, then PCD_CommunicateFinish().
+ */
+void PCD_CommunicateStart(	byte command,		///< The command to execute. One of the PCD_Command enums.
+							byte *sendData,		///< Pointer to the data to transfer to the FIFO. Can be reused after the call.
+							byte sendLen,		///< Number of bytes to transfer to the FIFO.
+							byte txLastBits,	///< The number of valid bits in the last byte to send. 0 for 8 valid bits.
+							byte rxAlign		///< Defines the bit position in backData[0] for the first bit received.
+						) {
 	byte bitFraming = (rxAlign << 4) + txLastBits;		// RxAlign = BitFramingReg[6..4]. TxLastBits = BitFramingReg[2..0]
 
 	PCD_WriteRegister(CommandReg, PCD_Idle);			// Stop any active command.
-	PCD_WriteRegister(ComIrqReg, 0x7F);					// Clear all seven interrupt request bits
-	PCD_SetRegisterBitMask(FIFOLevelReg, 0x80);			// FlushBuffer = 1, FIFO initialization
+	PCD_WriteRegister(ComIrqReg, 0x7F);					// Clear all seven interrupt request bits, this releases the IRQ pin
+	pcd_irq = false;
+	PCD_WriteRegister(FIFOLevelReg, 0x80);				// FlushBuffer = 1, FIFO initialization. The other bits are read only.
 	PCD_WriteRegister_pointer(FIFODataReg, sendLen, sendData);	// Write sendData to the FIFO
 	PCD_WriteRegister(BitFramingReg, bitFraming);		// Bit adjustments
+	pcd_start_ms = main_get_time_ms();
 	PCD_WriteRegister(CommandReg, command);				// Execute the command
 	if (command == PCD_Transceive) {
-		PCD_SetRegisterBitMask(BitFramingReg, 0x80);	// StartSend=1, transmission of data starts
+		PCD_WriteRegister(BitFramingReg, bitFraming | 0x80);	// StartSend=1, transmission of data starts
 	}
+} // End PCD_CommunicateStart()
 
-	// Wait for the command to complete.
-	// In PCD_Init() we set the TAuto flag in TModeReg. This means the timer automatically starts when the PCD stops transmitting.
-	// Each iteration of the do-while-loop takes 17.86�s.
-	i = 2000;
-	while (1) {
-		n = PCD_ReadRegister_one(ComIrqReg);	// ComIrqReg[7..0] bits are: Set1 TxIRq RxIRq IdleIRq HiAlertIRq LoAlertIRq ErrIRq TimerIRq
-		if (n & waitIRq) {					// One of the interrupts that signal success has been set.
-			break;
-		}
-		if (n & 0x01) {						// Timer interrupt - nothing received in 25ms
-			return STATUS_TIMEOUT;
+/**
+ * Checks if the command started with PCD_CommunicateStart() is completed.
+ * The MFRC522 is only accessed after its IRQ pin signalled the end of the command,
+ * so calling this function while the command is running costs no SPI transfers.
+ *
+ * @return STATUS_BUSY while the command is running, STATUS_OK if it completed, STATUS_TIMEOUT otherwise.
+ */
+byte PCD_CommunicatePoll(	byte waitIRq		///< The bits in the ComIrqReg register that signals successful completion of the command.
+						) {
+	byte n;
+
+	if (!pcd_irq) {
+		if (main_get_time_ms() - pcd_start_ms <= PCD_TIMEOUT_MS) {
+			return STATUS_BUSY;
 		}
-		if (--i == 0) {						// The emergency break. If all other condions fail we will eventually terminate on this one after 35.7ms. Communication with the MFRC522 might be down.
-			return STATUS_TIMEOUT;
+		// The emergency break. The interrupt got lost or communication with the MFRC522 might be down,
+		// look at the request bits a last time.
+		n = PCD_ReadRegister_one(ComIrqReg);
+		if (n & waitIRq) {
+			return STATUS_OK;
 		}
+		return STATUS_TIMEOUT;
+	}
+	pcd_irq = false;
+
+	// In PCD_Init() we set the TAuto flag in TModeReg. This means the timer automatically starts when the PCD stops transmitting.
+	n = PCD_ReadRegister_one(ComIrqReg);	// ComIrqReg[7..0] bits are: Set1 TxIRq RxIRq IdleIRq HiAlertIRq LoAlertIRq ErrIRq TimerIRq
+	if (n & waitIRq) {					// One of the interrupts that signal success has been set.
+		return STATUS_OK;
+	}
+	if (n & 0x01) {						// Timer interrupt - nothing received in 25ms
+		return STATUS_TIMEOUT;
 	}
+	return STATUS_BUSY;
+} // End PCD_CommunicatePoll()
+
+/**
+ * Evaluates the command after PCD_CommunicatePoll() returned STATUS_OK and transfers data back from the FIFO.
+ * CRC validation can only be done if backData and backLen are specified.
+ *
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+byte PCD_CommunicateFinish(	byte *backData,		///< NULL or pointer to buffer if data should be read back after executing the command.
+							byte *backLen,		///< In: Max number of bytes to write to *backData. Out: The number of bytes returned.
+							byte *validBits,	///< Out: The number of valid bits in the last byte. 0 for 8 valid bits.
+							byte rxAlign,		///< In: Defines the bit position in backData[0] for the first bit received. Default 0.
+							bool checkCRC		///< In: True => The last two bytes of the response is assumed to be a CRC_A that must be validated.
+						) {
+	static const byte statusRegs[2] = {ErrorReg, FIFOLevelReg};
+	byte status[2];
+	byte n, _validBits = 0;
+
+	PCD_ReadRegisterList(2, statusRegs, status);
 
 	// Stop now if any errors except collisions were detected.
-	byte errorRegValue = PCD_ReadRegister_one(ErrorReg); // ErrorReg[7..0] bits are: WrErr TempErr reserved BufferOvfl CollErr CRCErr ParityErr ProtocolErr
+	byte errorRegValue = status[0]; // ErrorReg[7..0] bits are: WrErr TempErr reserved BufferOvfl CollErr CRCErr ParityErr ProtocolErr
 	if (errorRegValue & 0x13) {	 // BufferOvfl ParityErr ProtocolErr
 		return STATUS_ERROR;
 	}
 
 	// If the caller wants data back, get it from the MFRC522.
 	if (backData && backLen) {
-		n = PCD_ReadRegister_one(FIFOLevelReg);			// Number of bytes in the FIFO
+		n = status[1];							// Number of bytes in the FIFO
 		if (n > *backLen) {
 			return STATUS_NO_ROOM;
 		}
@@ -567,7 +712,14 @@ byte PCD_CommunicateWithPICC(	byte command,		///< The command to execute. One of
 	}
 
 	return STATUS_OK;
-} // End PCD_CommunicateWithPICC()
+} // End PCD_CommunicateFinish()
+
+/**
+ * Has to be called by the interrupt service routine of the pin that is connected to the IRQ pin of the MFRC522.
+ */
+void PCD_IrqHandler() {
+	pcd_irq = true;
+} // End PCD_IrqHandler()
 
 ///**
 // * Transmits a REQuest command, Type A. Invites PICCs in state IDLE to go to READY and prepare for anticollision or selection. 7 bit frame.
@@ -621,6 +773,43 @@ byte PICC_REQA_or_WUPA(	byte command,		///< The command to send - PICC_CMD_REQA
 	return STATUS_OK;
 } // End PICC_REQA_or_WUPA()
 
+///**
+// * Starts a REQA command without waiting for the answer. Use PICC_PollRequestA() to get the answer.
+// */
+void PICC_StartRequestA() {
+	byte command = PICC_CMD_REQA;
+	PCD_ClearRegisterBitMask(CollReg, 0x80);		// ValuesAfterColl=1 => Bits received after collision are cleared.
+	PCD_CommunicateStart(PCD_Transceive, &command, 1, 7, 0);	// Short frame format - transmit only 7 bits of the last (and only) byte.
+} // End PICC_StartRequestA()
+
+///**
+// * Checks for the answer to a REQA command started with PICC_StartRequestA().
+// *
+// * @return STATUS_BUSY while waiting for the answer, STATUS_OK on success, STATUS_??? otherwise.
+// */
+byte PICC_PollRequestA(	byte *bufferATQA,	///< The buffer to store the ATQA (Answer to request) in
+						byte *bufferSize	///< Buffer size, at least two bytes. Also number of bytes returned if STATUS_OK.
+					  ) {
+	byte validBits;
+	byte status;
+
+	if (bufferATQA == NULL || *bufferSize < 2) {	// The ATQA response is 2 bytes long.
+		return STATUS_NO_ROOM;
+	}
+	status = PCD_CommunicatePoll(0x30);				// RxIRq and IdleIRq
+	if (status != STATUS_OK) {
+		return status;
+	}
+	status = PCD_CommunicateFinish(bufferATQA, bufferSize, &validBits, 0, false);
+	if (status != STATUS_OK) {
+		return status;
+	}
+	if (*bufferSize != 2 || validBits != 0) {		// ATQA must be exactly 16 bits.
+		return STATUS_ERROR;
+	}
+	return STATUS_OK;
+} // End PICC_PollRequestA()
+
 byte PICC_Select_one(	Uid *uid			///< Pointer to Uid struct. Normally output, but can also be used to supply a known UID.
 						 ) {
 	return PICC_Select(uid, 0);
@@ -856,36 +1045,42 @@ byte PICC_Select(	Uid *uid,			///< Pointer to Uid struct. Normally output, but c
 
 ///**
 // * Instructs a PICC in state ACTIVE(*) to go to state HALT.
+// * If the PICC is authenticated, call this function before PCD_StopCrypto1(), the HLTA has to be encrypted.
 // *
 // * @return STATUS_OK on success, STATUS_??? otherwise.
 // */
-//byte PICC_HaltA() {
-//	byte result;
-//	byte buffer[4];
-//
-//	// Build command buffer
-//	buffer[0] = PICC_CMD_HLTA;
-//	buffer[1] = 0;
-//	// Calculate CRC_A
-//	result = PCD_CalculateCRC(buffer, 2, &buffer[2]);
-//	if (result != STATUS_OK) {
-//		return result;
-//	}
-//
-//	// Send the command.
-//	// The standard says:
-//	//		If the PICC responds with any modulation during a period of 1 ms after the end of the frame containing the
-//	//		HLTA command, this response shall be interpreted as 'not acknowledge'.
-//	// We interpret that this way: Only STATUS_TIMEOUT is an success.
-//	result = PCD_TransceiveData_four(buffer, sizeof(buffer), NULL, 0);
-//	if (result == STATUS_TIMEOUT) {
-//		return STATUS_OK;
-//	}
-//	if (result == STATUS_OK) { // That is ironically NOT ok in this case ;-)
-//		return STATUS_ERROR;
-//	}
-//	return result;
-//} // End PICC_HaltA()
+byte PICC_HaltA() {
+	byte result;
+	byte buffer[4];
+
+	// Build command buffer
+	buffer[0] = PICC_CMD_HLTA;
+	buffer[1] = 0;
+	// Calculate CRC_A
+	result = PCD_CalculateCRC(buffer, 2, &buffer[2]);
+	if (result != STATUS_OK) {
+		return result;
+	}
+
+	// Send the command.
+	// The standard says:
+	//		If the PICC responds with any modulation during a period of 1 ms after the end of the frame containing the
+	//		HLTA command, this response shall be interpreted as 'not acknowledge'.
+	// We interpret that this way: Only STATUS_TIMEOUT is an success.
+	// So the timer is set to 1ms instead of 25ms (see PCD_Init()) for this command, the timeout is the normal case.
+	PCD_WriteRegister(TReloadRegH, 0x00);		// Reload timer with 0x028 = 40, ie 1ms before timeout.
+	PCD_WriteRegister(TReloadRegL, 0x28);
+	result = PCD_TransceiveData_four(buffer, sizeof(buffer), NULL, 0);
+	PCD_WriteRegister(TReloadRegH, 0x03);		// Back to 0x3E8 = 1000, ie 25ms.
+	PCD_WriteRegister(TReloadRegL, 0xE8);
+	if (result == STATUS_TIMEOUT) {
+		return STATUS_OK;
+	}
+	if (result == STATUS_OK) { // That is ironically NOT ok in this case ;-)
+		return STATUS_ERROR;
+	}
+	return result;
+} // End PICC_HaltA()
 //
 //
 ///////////////////////////////////////////////////////////////////////////////////////
@@ -1021,31 +1216,31 @@ byte MIFARE_Write(	byte blockAddr, ///< MIFARE Classic: The block (0-0xff) numbe
 // *
 // * @return STATUS_OK on success, STATUS_??? otherwise.
 // */
-//byte MIFARE_Ultralight_Write(	byte page,		///< The page (2-15) to write to.
-//										byte *buffer,	///< The 4 bytes to write to the PICC
-//										byte bufferSize	///< Buffer size, must be at least 4 bytes. Exactly 4 bytes are written.
-//									) {
-//	byte result;
-//
-//	// Sanity check
-//	if (buffer == NULL || bufferSize < 4) {
-//		return STATUS_INVALID;
-//	}
-//
-//	// Build commmand buffer
-//	byte cmdBuffer[6];
-//	cmdBuffer[0] = PICC_CMD_UL_WRITE;
-//	cmdBuffer[1] = page;
-//	memcpy(&cmdBuffer[2], buffer, 4);
-//
-//	// Perform the write
-//	result = PCD_MIFARE_Transceive_second(cmdBuffer, 6); // Adds CRC_A and checks that the response is MF_ACK.
-//	if (result != STATUS_OK) {
-//		return result;
-//	}
-//	return STATUS_OK;
-//} // End MIFARE_Ultralight_Write()
-//
+byte MIFARE_Ultralight_Write(	byte page,		///< The page (2-15) to write to.
+										byte *buffer,	///< The 4 bytes to write to the PICC
+										byte bufferSize	///< Buffer size, must be at least 4 bytes. Exactly 4 bytes are written.
+									) {
+	byte result;
+
+	// Sanity check
+	if (buffer == NULL || bufferSize < 4) {
+		return STATUS_INVALID;
+	}
+
+	// Build commmand buffer
+	byte cmdBuffer[6];
+	cmdBuffer[0] = PICC_CMD_UL_WRITE;
+	cmdBuffer[1] = page;
+	memcpy(&cmdBuffer[2], buffer, 4);
+
+	// Perform the write
+	result = PCD_MIFARE_Transceive_second(cmdBuffer, 6); // Adds CRC_A and checks that the response is MF_ACK.
+	if (result != STATUS_OK) {
+		return result;
+	}
+	return STATUS_OK;
+} // End MIFARE_Ultralight_Write()
+
 ///**
 // * MIFARE Decrement subtracts the delta from the value of the addressed block, and stores the result in a volatile memory.
 // * For MIFARE Classic only. The sector containing the block must be authenticated before calling this function.
@@ -1281,34 +1476,34 @@ byte PCD_MIFARE_Transceive(	byte *sendData,		///< Pointer to the data to transfe
 // *
 // * @return PICC_Type
 // */
-//byte PICC_GetType(byte sak		///< The SAK byte returned from PICC_Select().
-//							) {
-//	if (sak & 0x04) { // UID not complete
-//		return PICC_TYPE_NOT_COMPLETE;
-//	}
-//
-//	switch (sak) {
-//		case 0x09:	return PICC_TYPE_MIFARE_MINI;	break;
-//		case 0x08:	return PICC_TYPE_MIFARE_1K;		break;
-//		case 0x18:	return PICC_TYPE_MIFARE_4K;		break;
-//		case 0x00:	return PICC_TYPE_MIFARE_UL;		break;
-//		case 0x10:
-//		case 0x11:	return PICC_TYPE_MIFARE_PLUS;	break;
-//		case 0x01:	return PICC_TYPE_TNP3XXX;		break;
-//		default:	break;
-//	}
-//
-//	if (sak & 0x20) {
-//		return PICC_TYPE_ISO_14443_4;
-//	}
-//
-//	if (sak & 0x40) {
-//		return PICC_TYPE_ISO_18092;
-//	}
-//
-//	return PICC_TYPE_UNKNOWN;
-//} // End PICC_GetType()
-//
+byte PICC_GetType(byte sak		///< The SAK byte returned from PICC_Select().
+							) {
+	if (sak & 0x04) { // UID not complete
+		return PICC_TYPE_NOT_COMPLETE;
+	}
+
+	switch (sak) {
+		case 0x09:	return PICC_TYPE_MIFARE_MINI;	break;
+		case 0x08:	return PICC_TYPE_MIFARE_1K;		break;
+		case 0x18:	return PICC_TYPE_MIFARE_4K;		break;
+		case 0x00:	return PICC_TYPE_MIFARE_UL;		break;
+		case 0x10:
+		case 0x11:	return PICC_TYPE_MIFARE_PLUS;	break;
+		case 0x01:	return PICC_TYPE_TNP3XXX;		break;
+		default:	break;
+	}
+
+	if (sak & 0x20) {
+		return PICC_TYPE_ISO_14443_4;
+	}
+
+	if (sak & 0x40) {
+		return PICC_TYPE_ISO_18092;
+	}
+
+	return PICC_TYPE_UNKNOWN;
+} // End PICC_GetType()
+
 ///**
 // * Returns a __FlashStringHelper pointer to the PICC type name.
 // *
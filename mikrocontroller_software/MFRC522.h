@@ -241,7 +241,8 @@
 		STATUS_INTERNAL_ERROR	= 6,	// Internal error in the code. Should not happen ;-)
 		STATUS_INVALID			= 7,	// Invalid argument.
 		STATUS_CRC_WRONG		= 8,	// The CRC_A does not match
-		STATUS_MIFARE_NACK		= 9		// A MIFARE PICC responded with NAK.
+		STATUS_MIFARE_NACK		= 9,	// A MIFARE PICC responded with NAK.
+		STATUS_BUSY				= 10	// The command is still running, see PCD_CommunicatePoll().
 	};
 
 	// A struct used for passing the UID of a PICC.
@@ -262,6 +263,8 @@
 	// Size of the MFRC522 FIFO
 	static const byte FIFO_SIZE = 64;		// The FIFO is 64 bytes.
 
+	#define PCD_TIMEOUT_MS	40	// Emergency break if the IRQ pin does not signal the end of a command (the MFRC522 timer runs out after 25ms).
+
 	/////////////////////////////////////////////////////////////////////////////////////
 	// Functions for setting up the Arduino
 	/////////////////////////////////////////////////////////////////////////////////////
@@ -276,6 +279,7 @@
 	byte PCD_ReadRegister_one(byte reg);
 	void PCD_ReadRegister_three(byte reg, byte count, byte *values);
 	void PCD_ReadRegister(byte reg, byte count, byte *values, byte rxAlign);
+	void PCD_ReadRegisterList(byte count, const byte *regs, byte *values);
 	void setBitMask(unsigned char reg, unsigned char mask);
 	void PCD_SetRegisterBitMask(byte reg, byte mask);
 	void PCD_ClearRegisterBitMask(byte reg, byte mask);
@@ -288,6 +292,9 @@
 	void PCD_Reset(void);
 	void PCD_AntennaOn(void);
 	void PCD_AntennaOff(void);
+	void PCD_SoftPowerDown(void);
+	void PCD_SoftPowerUp(void);
+	bool PCD_IsPoweredUp(void);
 	byte PCD_GetAntennaGain(void);
 	void PCD_SetAntennaGain(byte mask);
 	bool PCD_PerformSelfTest(void);
@@ -304,9 +311,15 @@
 	byte PCD_CommunicateWithPICC_four(byte command, byte waitIRq, byte *sendData, byte sendLen);
 	byte PCD_CommunicateWithPICC_seven(byte command, byte waitIRq, byte *sendData, byte sendLen, byte *backData, byte *backLen, byte *validBits);
 	byte PCD_CommunicateWithPICC(byte command, byte waitIRq, byte *sendData, byte sendLen, byte *backData, byte *backLen, byte *validBits, byte rxAlign, bool checkCRC);
+	void PCD_CommunicateStart(byte command, byte *sendData, byte sendLen, byte txLastBits, byte rxAlign);
+	byte PCD_CommunicatePoll(byte waitIRq);
+	byte PCD_CommunicateFinish(byte *backData, byte *backLen, byte *validBits, byte rxAlign, bool checkCRC);
+	void PCD_IrqHandler(void);
 	byte PICC_RequestA(byte *bufferATQA, byte *bufferSize);
 	byte PICC_WakeupA(byte *bufferATQA, byte *bufferSize);
 	byte PICC_REQA_or_WUPA(byte command, byte *bufferATQA, byte *bufferSize);
+	void PICC_StartRequestA(void);
+	byte PICC_PollRequestA(byte *bufferATQA, byte *bufferSize);
 	//byte PICC_Select(Uid *uid, byte validBits = 0);
 	byte PICC_Select_one(Uid *uid);
 	byte PICC_Select(Uid *uid, byte validBits);
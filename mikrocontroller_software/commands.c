@@ -21,6 +21,7 @@
 
 #include <avr/pgmspace.h> /* documentation see: http://www.nongnu.org/avr-libc/user-manual/pgmspace.html */
 #include <avr/io.h>
+#include <string.h>
 
 #include "morse.h"
 #include "main.h"
@@ -31,6 +32,11 @@
 #include "utils.h"
 #include "dds.h"
 #include "user.h"
+#include "rfid.h"
+#include "ext_eeprom.h"
+#include "siphash.h"
+#include "scheduler.h"
+#include "config.h"
 
 #define START_TIME			0
 #define STOP_TIME			1
@@ -41,7 +47,10 @@
 
 #define NO_MODE				0
 #define SET_ID_MODE			1 /* set tag id mode */
-#define MODE_MAX			1
+#define CONFIG_MODE			2 /* lines of a "set config" block */
+#define MODE_MAX			2
+
+#define CONFIG_LINE_LENGTH	56 /* "set " and a line received by uart */
 
 #define CMD_STATUS_OK				0
 #define CMD_STATUS_NOT_RECOGNIZED	1
@@ -81,7 +90,17 @@
 #define CMD_GET_CRYSTAL_FREQUENCY	25
 #define CMD_PRINT_FOX_HISTORY	26
 #define CMD_SET_RELOAD			27
-#define CMD_MAX					27 /* highest index in array command */
+#define CMD_QUERY_TAG			28
+#define CMD_GET_RFID_STATS		29
+#define CMD_SET_REPUNCH_WINDOW	30
+#define CMD_SET_COMPACT_READOUT	31
+#define CMD_SET_STATION			32
+#define CMD_QUEUE_ID			33
+#define CMD_CLEAR_ID_QUEUE		34
+#define CMD_GET_TASK_STATS		35
+#define CMD_SET_WINDOW			36
+#define CMD_SET_CONFIG			37
+#define CMD_MAX					37 /* highest index in array command */
 
 const char PROGMEM cmd_set_time[] = "set time";
 const char PROGMEM cmd_set_date[] = "set date";
@@ -111,6 +130,16 @@ const char PROGMEM cmd_set_blink[] = "set blinking";
 const char PROGMEM cmd_get_crystal_frequency[] = "get crystal frequency";
 const char PROGMEM cmd_print_fox_history[] = "print fox history";
 const char PROGMEM cmd_set_reload[] = "set reload";
+const char PROGMEM cmd_query_tag[] = "query tag";
+const char PROGMEM cmd_get_rfid_stats[] = "get rfid stats";
+const char PROGMEM cmd_set_repunch_window[] = "set repunch window";
+const char PROGMEM cmd_set_compact_readout[] = "set compact readout";
+const char PROGMEM cmd_set_station[] = "set station";
+const char PROGMEM cmd_queue_id[] = "queue id";
+const char PROGMEM cmd_clear_id_queue[] = "clear id queue";
+const char PROGMEM cmd_get_task_stats[] = "get task stats";
+const char PROGMEM cmd_set_window[] = "set window";
+const char PROGMEM cmd_set_config[] = "set config";
 
 /*
  * arrays in flash memory have to be declared like this
@@ -145,6 +174,16 @@ const PGM_P const commands[CMD_MAX + 1] =	{
 	cmd_get_crystal_frequency,
 	cmd_print_fox_history,
 	cmd_set_reload,
+	cmd_query_tag,
+	cmd_get_rfid_stats,
+	cmd_set_repunch_window,
+	cmd_set_compact_readout,
+	cmd_set_station,
+	cmd_queue_id,
+	cmd_clear_id_queue,
+	cmd_get_task_stats,
+	cmd_set_window,
+	cmd_set_config,
 };
 
 /* help texts for each command */
@@ -266,10 +305,11 @@ const char PROGMEM help_cmd_set_amplitude[] =
 	"example: set amplitude 100";
 const char PROGMEM help_cmd_set_secret[] =
 	"\"set secret\" command:\r\n"
-	"give (random) secret key of fox between 1 and 65535\r\n"
-	"key is written onto tags as proof that fox was really foundc\r\n"
+	"give (random) secret key of fox with up to 32 hex digits\r\n"
+	"the fox writes a mac with this key onto the tags as proof\r\n"
+	"that the fox was really found\r\n"
 	"\r\n"
-	"example: set secret 34211";
+	"example: set secret 8f3a0c19d2b74e6a51c08e9f2d3b7a64";
 const char PROGMEM help_cmd_reset_history[] =
 	"\"reset history\" command:\r\n"
 	"delete user history inside eeprom of transmitter\r\n"
@@ -312,6 +352,84 @@ const char PROGMEM help_cmd_set_reload[] =
 	"configuration after each command or not\r\n"
 	"\r\n"
 	"example: set reload on";
+const char PROGMEM help_cmd_query_tag[] =
+	"\"query tag\" command:\r\n"
+	"give tag id between 1 and 65535\r\n"
+	"fox outputs number of punches and timestamps of first and\r\n"
+	"last punch of this tag saved in eeprom\r\n"
+	"\r\n"
+	"example: query tag 100";
+const char PROGMEM help_cmd_get_rfid_stats[] =
+	"\"get rfid stats\" command:\r\n"
+	"fox outputs the number of tag polls and how many of them\r\n"
+	"found a tag in the last hour, the current poll interval,\r\n"
+	"the receiver gain and the errors of the tag operations\r\n"
+	"\r\n"
+	"example: get rfid stats";
+const char PROGMEM help_cmd_set_repunch_window[] =
+	"\"set repunch window\" command:\r\n"
+	"give time in seconds between 0 and 65534 in which a tag\r\n"
+	"that punched again is only acknowledged and not written\r\n"
+	"0 means that every punch is written\r\n"
+	"\r\n"
+	"example: set repunch window 60";
+const char PROGMEM help_cmd_set_compact_readout[] =
+	"\"set compact readout\" command:\r\n"
+	"give \"on\" or \"off\"\r\n"
+	"if on the fox sends one line with the hex record of\r\n"
+	"each read tag instead of the history as text\r\n"
+	"\r\n"
+	"example: set compact readout on";
+const char PROGMEM help_cmd_set_station[] =
+	"\"set station\" command:\r\n"
+	"give \"fox\", \"start\" or \"register\"\r\n"
+	"fox: punches are written onto the tags\r\n"
+	"start: history of the tags is cleared and start time is written\r\n"
+	"register: ids given by \"queue id\" are written onto the tags\r\n"
+	"\r\n"
+	"example: set station register";
+const char PROGMEM help_cmd_queue_id[] =
+	"\"queue id\" command:\r\n"
+	"give id between 1 and 65535 to write onto a tag\r\n"
+	"in register station mode each recognised tag gets the next\r\n"
+	"id of the queue, up to 32 ids can be queued\r\n"
+	"\r\n"
+	"example: queue id 100";
+const char PROGMEM help_cmd_clear_id_queue[] =
+	"\"clear id queue\" command:\r\n"
+	"remove all ids given by \"queue id\" that are not written yet\r\n"
+	"\r\n"
+	"example: clear id queue";
+const char PROGMEM help_cmd_get_task_stats[] =
+	"\"get task stats\" command:\r\n"
+	"fox outputs for each task of the scheduler how often it\r\n"
+	"was executed, its longest runtime and how often it was\r\n"
+	"started later than its deadline\r\n"
+	"\r\n"
+	"example: get task stats";
+const char PROGMEM help_cmd_set_window[] =
+	"\"set window\" command:\r\n"
+	"give window number between 1 and 3 and one of:\r\n"
+	"start YYYY-MM-DD HH:MM:SS - start of the window\r\n"
+	"stop YYYY-MM-DD HH:MM:SS - end of the window\r\n"
+	"fox MAX MINUTE - fox max and transmit minute, 0 0 for\r\n"
+	"the values given by \"set fox max\" etc.\r\n"
+	"frequency HZ - frequency, 0 for \"set frequency\"\r\n"
+	"clear - remove the window\r\n"
+	"window 0 is given by \"set start time\" etc.\r\n"
+	"\r\n"
+	"example: set window 1 start 2016-04-09 10:00:00";
+const char PROGMEM help_cmd_set_config[] =
+	"\"set config\" command:\r\n"
+	"starts a block of settings, one setting per line in the\r\n"
+	"form name=value, the name is a \"set\" command without \"set \"\r\n"
+	"(spaces may be written as _), the block ends with \"end\"\r\n"
+	"the settings are only saved if all of them are valid\r\n"
+	"\r\n"
+	"example: set config\r\n"
+	"fox_number=2\r\n"
+	"wpm=10\r\n"
+	"end";
 
 const PGM_P const help_commands[CMD_MAX + 1] =	{
 	help_cmd_set_time,
@@ -342,16 +460,59 @@ const PGM_P const help_commands[CMD_MAX + 1] =	{
 	help_cmd_get_crystal_frequency,
 	help_cmd_print_fox_history,
 	help_cmd_set_reload,
+	help_cmd_query_tag,
+	help_cmd_get_rfid_stats,
+	help_cmd_set_repunch_window,
+	help_cmd_set_compact_readout,
+	help_cmd_set_station,
+	help_cmd_queue_id,
+	help_cmd_clear_id_queue,
+	help_cmd_get_task_stats,
+	help_cmd_set_window,
+	help_cmd_set_config,
 };
 
 const char PROGMEM prompt_no_mode[] = "ARDF Transmitter# ";
+const char PROGMEM prompt_config_mode[] = "ARDF Transmitter (config)# ";
 
 const PGM_P const prompt[MODE_MAX + 1]	=	{
-	prompt_no_mode
+	prompt_no_mode,
+	prompt_no_mode, /* set id mode does not print a prompt */
+	prompt_config_mode
+};
+
+/* commands that are allowed in a "set config" block */
+const uint8_t config_commands[] = {
+	CMD_SET_STARTUP_TIME,
+	CMD_SET_STOP_TIME,
+	CMD_SET_STARTUP_DATE,
+	CMD_SET_STOP_DATE,
+	CMD_SET_WPM,
+	CMD_SET_CALL,
+	CMD_SET_FREQUENCY,
+	CMD_SET_CRYSTAL_FREQUENCY,
+	CMD_SET_FOX_NUMBER,
+	CMD_SET_FOX_MAX,
+	CMD_SET_MODULATION,
+	CMD_SET_MORSING,
+	CMD_SET_AMPLITUDE,
+	CMD_SET_SECRET,
+	CMD_SET_TRANSMIT_MINUTE,
+	CMD_SET_REPUNCH_WINDOW,
+	CMD_SET_COMPACT_READOUT,
+	CMD_SET_STATION,
+	CMD_SET_WINDOW
 };
 
 const char PROGMEM string_on[] = "on";
 const char PROGMEM string_off[] = "off";
+const char PROGMEM string_fox[] = "fox";
+const char PROGMEM string_start[] = "start";
+const char PROGMEM string_register[] = "register";
+const char PROGMEM string_stop[] = "stop";
+const char PROGMEM string_frequency[] = "frequency";
+const char PROGMEM string_clear[] = "clear";
+const char PROGMEM string_end[] = "end";
 
 /*
  * if changing order -> change also in morse.h
@@ -400,9 +561,15 @@ const char PROGMEM help_message_ending[] =
 
 const char PROGMEM cmd_not_rec[] = "Command not recognised";
 const char PROGMEM err[] = "Error";
+const char PROGMEM config_error_text[] = "Error in line ";
 
 uint8_t reload_each_command = TRUE;
 
+/* state of a "set config" block */
+static struct config config_backup;	/* restored if a line of the block fails */
+static uint8_t config_line;			/* number of the current line in the block */
+static uint8_t config_error_line;	/* first line that failed, 0 if none */
+
 /*
  * internal functions
  */
@@ -480,6 +647,90 @@ static uint8_t command_get_parameter(uint8_t command_number, char *string_in, ch
 	return CMD_STATUS_OK;
 }
 
+/**
+ * commit_settings - save the settings and reload the changed modules
+ */
+static void commit_settings(void)
+{
+	config_commit();
+#ifdef EACH_COMMAND_RELOAD
+	if (reload_each_command == TRUE)	{
+		main_reload();
+	}
+#endif
+}
+
+/**
+ * is_config_command - check if a command is allowed in a "set config" block
+ * @command:	the command number
+ *
+ *		Return: TRUE if the command changes a setting, FALSE otherwise
+ */
+static uint8_t is_config_command(uint8_t command)
+{
+	uint8_t i;
+	for (i = 0; i < sizeof(config_commands); i++)	{
+		if (config_commands[i] == command)	{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * config_line_to_command - convert a line of a "set config" block to a command
+ * @string:	the line in the form name=value, e.g. "fox_max=3"
+ * @line:	buffer of CONFIG_LINE_LENGTH bytes for the command, e.g. "set fox max 3"
+ *
+ *		Return: TRUE on success, FALSE if the line has not the right form
+ */
+static uint8_t config_line_to_command(const char *string, char *line)
+{
+	uint8_t i = 0;
+	uint8_t j = 4;
+
+	memcpy(line, "set ", 4);
+	while (string[i] != '=')	{
+		if (string[i] == 0 || j >= CONFIG_LINE_LENGTH - 2)	{
+			return FALSE;
+		}
+		line[j++] = (string[i] == '_') ? ' ' : string[i];
+		i++;
+	}
+	line[j++] = ' ';
+	i++;
+	while (string[i] != 0)	{
+		if (j >= CONFIG_LINE_LENGTH - 1)	{
+			return FALSE;
+		}
+		line[j++] = string[i++];
+	}
+	line[j] = 0;
+	return TRUE;
+}
+
+/**
+ * finish_config - end a "set config" block
+ *
+ *		If all lines were valid the settings are saved and the changed modules
+ *		are reloaded once. Otherwise the settings from before the block are
+ *		restored. One status line is sent in both cases.
+ */
+static void finish_config(void)
+{
+	mode = NO_MODE;
+	if (config_error_line != 0)	{
+		config = config_backup;
+		commit_settings(); /* modules may have cached the changed settings */
+		uart_send_text_flash((uint16_t)config_error_text);
+		uart_send_int(config_error_line);
+		UART_NEWLINE();
+		return;
+	}
+	commit_settings();
+	uart_send_text_sram("OK\r\n");
+}
+
 /**
  * execute_time - execute command for setting startup and stop date and time
  * @command:		the command number that was recognized
@@ -556,6 +807,90 @@ execute_time_return:
 	return return_code;
 }
 
+/**
+ * split_parameter - split a parameter string at the first space
+ * @parameter:	the string to split, the space is replaced by 0
+ *
+ *		Return: pointer to the rest of the string after the spaces,
+ *		NULL if there is no space in the string
+ */
+static char *split_parameter(char *parameter)
+{
+	while (*parameter != ' ')	{
+		if (*parameter == 0)	{
+			return NULL;
+		}
+		parameter++;
+	}
+	*parameter = 0;
+	do {
+		parameter++;
+	} while (*parameter == ' ');
+	return parameter;
+}
+
+/**
+ * parse_numbers - parse three numbers separated by a separator
+ * @string:		the string like "2016-04-08" or "10:00:00", is modified
+ * @separator:	the separator between the numbers
+ * @val:		array to store the three numbers
+ *
+ *		Return: TRUE on success, FALSE if the string has not the right form
+ */
+static uint8_t parse_numbers(char *string, char separator, uint32_t *val)
+{
+	uint8_t num;
+	for (num = 0; num < 3; num++)	{
+		char *start = string;
+		while (*string != separator && *string != 0)	{
+			string++;
+		}
+		if ((*string == 0) != (num == 2))	{
+			return FALSE;
+		}
+		*string = 0;
+		string++;
+		if (str_to_int(start, &val[num]) != TRUE)	{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * parse_date_time - parse date and time to seconds since 2000-01-01
+ * @parameter:	string with date and time in format YYYY-MM-DD HH:MM:SS
+ * @seconds:	is set to the parsed time (see rtc_time_to_seconds)
+ *
+ *		Return: TRUE on success, FALSE if the string has not the right form
+ */
+static uint8_t parse_date_time(char *parameter, uint32_t *seconds)
+{
+	uint32_t date[3], clock[3];
+	uint8_t time[STARTUP_TIME_MAX + 1];
+
+	char *clock_string = split_parameter(parameter);
+	if (clock_string == NULL)	{
+		return FALSE;
+	}
+	if (parse_numbers(parameter, '-', date) != TRUE ||
+			parse_numbers(clock_string, ':', clock) != TRUE)	{
+		return FALSE;
+	}
+	if (date[1] < 1 || date[1] > 12 || date[2] < 1 || date[2] > 31 ||
+			clock[0] > 23 || clock[1] > 59 || clock[2] > 59)	{
+		return FALSE;
+	}
+	time[STARTUP_YEAR] = date[0] % 100;
+	time[STARTUP_MONTH] = date[1];
+	time[STARTUP_DATE] = date[2];
+	time[STARTUP_HOUR] = clock[0];
+	time[STARTUP_MINUTE] = clock[1];
+	time[STARTUP_SECOND] = clock[2];
+	*seconds = rtc_time_to_seconds(time);
+	return TRUE;
+}
+
 /**
  * execute_set_wpm - save words per minute
  * @parameter:	the string with the commands parameter
@@ -722,6 +1057,7 @@ static uint8_t execute_set_morsing(char *parameter)
  */
 static uint8_t execute_reload(char *parameter)
 {
+	main_mark_dirty(MAIN_RELOAD_ALL);
 	main_reload();
 	return CMD_STATUS_OK;
 }
@@ -797,8 +1133,11 @@ static uint8_t execute_help(char *parameter)
 static uint8_t execute_show_configuration(char *parameter)
 {
 	UART_NEWLINE();
+	config_show_configuration();
 	dds_show_configuration();
 	rtc_show_configuration();
+	twi_print_stats();
+	ext_eeprom_print_stats();
 	startup_show_configuration();
 	morse_show_configuration();
 	user_show_configuration();
@@ -825,19 +1164,17 @@ static uint8_t execute_set_amplitude(char *parameter)
 
 /**
  * execute_set_secret - save the given secret key
- * @parameter: string with secret key of fox between 1 and 65535
+ * @parameter: string with secret key of fox with up to 32 hex digits
  *
  *		Return: CMD_STATUS_OK on success, CMD_STATUS_ERR otherwise
  */
 static uint8_t execute_set_secret(char *parameter)
 {
-	uint32_t secret;
-	if (str_to_int(parameter, &secret) != TRUE)	{
-		return CMD_STATUS_ERR;
-	}
-	if (user_set_secret(secret) != TRUE)	{
+	uint8_t key[SIPHASH_KEY_SIZE];
+	if (str_to_bytes_hex(parameter, key, SIPHASH_KEY_SIZE) != TRUE)	{
 		return CMD_STATUS_ERR;
 	}
+	user_set_secret(key);
 	return CMD_STATUS_OK;
 }
 
@@ -949,6 +1286,224 @@ static uint8_t execute_set_reload(char *parameter)
 	return CMD_STATUS_ERR;
 }
 
+/**
+ * execute_query_tag - output punches of a tag saved in eeprom
+ * @parameter: string with tag id
+ *
+ *		Return: CMD_STATUS_OK_NO_OK on success, CMD_STATUS_ERR if tag id is invalid
+ */
+static uint8_t execute_query_tag(char *parameter)
+{
+	uint32_t tagid;
+	if (str_to_int(parameter, &tagid) != TRUE)	{
+		return CMD_STATUS_ERR;
+	}
+	if (tagid > 0xffff || tagid == 0x00)	{
+		return CMD_STATUS_ERR;
+	}
+	user_query_tag((uint16_t)tagid);
+	return CMD_STATUS_OK_NO_OK;
+}
+
+/**
+ * execute_get_rfid_stats - output statistics of tag polling
+ * @parameter: any string
+ *
+ *		Return: always CMD_STATUS_OK_NO_OK
+ */
+static uint8_t execute_get_rfid_stats(char *parameter)
+{
+	rfid_print_stats();
+	return CMD_STATUS_OK_NO_OK;
+}
+
+/**
+ * execute_set_repunch_window - save the re-punch window
+ * @parameter: string with time in seconds between 0 and 65534
+ *
+ *		Return: CMD_STATUS_OK on success, CMD_STATUS_ERR otherwise
+ */
+static uint8_t execute_set_repunch_window(char *parameter)
+{
+	uint32_t seconds;
+	if (str_to_int(parameter, &seconds) != TRUE || seconds > 0xffff)	{
+		return CMD_STATUS_ERR;
+	}
+	if (user_set_repunch_window(seconds) != TRUE)	{
+		return CMD_STATUS_ERR;
+	}
+	return CMD_STATUS_OK;
+}
+
+/**
+ * execute_set_compact_readout - choose the output format of read tags
+ * @parameter: either "on" or "off"
+ *
+ *		Return: CMD_STATUS_OK if parameter was "on" or "off", returns CMD_STATUS_ERR otherwise
+ */
+static uint8_t execute_set_compact_readout(char *parameter)
+{
+	if (str_compare_progmem(parameter, (uint16_t)&string_on) != UTILS_STR_FALSE)	{
+		user_set_compact_readout(TRUE);
+		return CMD_STATUS_OK;
+	} else if (str_compare_progmem(parameter, (uint16_t)&string_off) != UTILS_STR_FALSE)	{
+		user_set_compact_readout(FALSE);
+		return CMD_STATUS_OK;
+	}
+	return CMD_STATUS_ERR;
+}
+
+/**
+ * execute_set_station - set the station mode
+ * @parameter: "fox", "start" or "register"
+ *
+ *		Return: CMD_STATUS_OK if parameter is a station mode, returns CMD_STATUS_ERR otherwise
+ */
+static uint8_t execute_set_station(char *parameter)
+{
+	if (str_compare_progmem(parameter, (uint16_t)&string_fox) != UTILS_STR_FALSE)	{
+		user_set_station_mode(USER_STATION_FOX);
+	} else if (str_compare_progmem(parameter, (uint16_t)&string_start) != UTILS_STR_FALSE)	{
+		user_set_station_mode(USER_STATION_START);
+	} else if (str_compare_progmem(parameter, (uint16_t)&string_register) != UTILS_STR_FALSE)	{
+		user_set_station_mode(USER_STATION_REGISTER);
+	} else {
+		return CMD_STATUS_ERR;
+	}
+	return CMD_STATUS_OK;
+}
+
+/**
+ * execute_queue_id - add a tag id to the id queue
+ * @parameter: string with id
+ *
+ *		Unlike "set id" the command returns immediately, the id is written
+ *		by the registration station when the next tag is recognised.
+ *
+ *		Return: CMD_STATUS_OK on success, CMD_STATUS_ERR if id is not valid
+ *		or the queue is full
+ */
+static uint8_t execute_queue_id(char *parameter)
+{
+	uint32_t tagid;
+	if (str_to_int(parameter, &tagid) != TRUE)	{
+		return CMD_STATUS_ERR;
+	}
+	if (tagid > 0xffff || user_queue_id((uint16_t)tagid) != TRUE)	{
+		return CMD_STATUS_ERR;
+	}
+	return CMD_STATUS_OK;
+}
+
+/**
+ * execute_clear_id_queue - remove all ids from the id queue
+ * @parameter: any string
+ *
+ *		Return: always CMD_STATUS_OK
+ */
+static uint8_t execute_clear_id_queue(char *parameter)
+{
+	user_clear_id_queue();
+	return CMD_STATUS_OK;
+}
+
+/**
+ * execute_get_task_stats - output statistics of the scheduler tasks
+ * @parameter: any string
+ *
+ *		Return: always CMD_STATUS_OK_NO_OK
+ */
+static uint8_t execute_get_task_stats(char *parameter)
+{
+	scheduler_print_stats();
+	return CMD_STATUS_OK_NO_OK;
+}
+
+/**
+ * execute_set_window - set start, stop or parameters of a transmit window
+ * @parameter: window number followed by "start", "stop", "fox", "frequency"
+ *			   or "clear" and its values
+ *
+ *		Return: CMD_STATUS_OK on success, CMD_STATUS_ERR on failure
+ */
+static uint8_t execute_set_window(char *parameter)
+{
+	struct startup_window window;
+	uint32_t index, val;
+
+	char *type = split_parameter(parameter);
+	if (type == NULL || str_to_int(parameter, &index) != TRUE)	{
+		return CMD_STATUS_ERR;
+	}
+	if (index == 0 || startup_get_window(index, &window) != TRUE)	{
+		return CMD_STATUS_ERR;
+	}
+
+	char *value = split_parameter(type);
+	if (str_compare_progmem(type, (uint16_t)&string_clear) == UTILS_STR_EQUAL)	{
+		if (value != NULL || startup_clear_window(index) != TRUE)	{
+			return CMD_STATUS_ERR;
+		}
+		return CMD_STATUS_OK;
+	}
+	if (value == NULL)	{
+		return CMD_STATUS_ERR;
+	}
+
+	if (str_compare_progmem(type, (uint16_t)&string_start) == UTILS_STR_EQUAL)	{
+		if (parse_date_time(value, &window.start) != TRUE)	{
+			return CMD_STATUS_ERR;
+		}
+	} else if (str_compare_progmem(type, (uint16_t)&string_stop) == UTILS_STR_EQUAL)	{
+		if (parse_date_time(value, &window.stop) != TRUE)	{
+			return CMD_STATUS_ERR;
+		}
+	} else if (str_compare_progmem(type, (uint16_t)&string_fox) == UTILS_STR_EQUAL)	{
+		char *minute = split_parameter(value);
+		if (minute == NULL || str_to_int(value, &val) != TRUE || val > 0xff)	{
+			return CMD_STATUS_ERR;
+		}
+		window.fox_max = val;
+		if (str_to_int(minute, &val) != TRUE || val > 0xff)	{
+			return CMD_STATUS_ERR;
+		}
+		window.transmit_minute = val;
+	} else if (str_compare_progmem(type, (uint16_t)&string_frequency) == UTILS_STR_EQUAL)	{
+		if (str_to_int(value, &window.frequency) != TRUE)	{
+			return CMD_STATUS_ERR;
+		}
+	} else {
+		return CMD_STATUS_ERR;
+	}
+
+	if (startup_set_window(index, &window) != TRUE)	{
+		return CMD_STATUS_ERR;
+	}
+	return CMD_STATUS_OK;
+}
+
+/**
+ * execute_set_config - start a block of settings
+ * @parameter: must be empty
+ *
+ *		The following lines until "end" are executed as "set" commands
+ *		without saving them, see finish_config.
+ *
+ *		Return: CMD_STATUS_OK_NO_OK on success, CMD_STATUS_ERR if there is
+ *		a parameter
+ */
+static uint8_t execute_set_config(char *parameter)
+{
+	if (parameter[0] != 0)	{
+		return CMD_STATUS_ERR;
+	}
+	config_backup = config;
+	config_line = 0;
+	config_error_line = 0;
+	mode = CONFIG_MODE;
+	return CMD_STATUS_OK_NO_OK;
+}
+
 /*
  * public functions
  */
@@ -1012,10 +1567,33 @@ uint8_t commands_execute()
 		return FALSE;
 	}
 
+	char line[CONFIG_LINE_LENGTH];
+	if (mode == CONFIG_MODE)	{
+		if (str_compare_progmem(string, (uint16_t)string_end) == UTILS_STR_EQUAL)	{
+			finish_config();
+			ret = CMD_STATUS_OK_NO_OK;
+			goto execute_command_end;
+		}
+		config_line++;
+		if (config_error_line != 0)	{
+			ret = CMD_STATUS_OK_NO_OK; /* block has failed, skip the rest */
+			goto execute_command_end;
+		}
+		if (config_line_to_command(string, line) != TRUE)	{
+			ret = CMD_STATUS_ERR;
+			goto execute_command_end;
+		}
+		string = line;
+	}
+
 	ret = get_command_number(string, &cmd);
 	if (ret != CMD_STATUS_OK)	{
 		goto execute_command_end;
 	}
+	if (mode == CONFIG_MODE && is_config_command(cmd) != TRUE)	{
+		ret = CMD_STATUS_ERR;
+		goto execute_command_end;
+	}
 
 	char *parameter;
 	parameter = string;
@@ -1024,7 +1602,7 @@ uint8_t commands_execute()
 		goto execute_command_end;
 	}
 
-	if (mode == NO_MODE)	{
+	if (mode == NO_MODE || mode == CONFIG_MODE)	{
 		if (cmd == CMD_SET_TIME)	{
 			ret = execute_time(cmd, parameter, ':', RTC_HOUR, TIME);
 		} else if (cmd == CMD_SET_DATE)	{
@@ -1081,16 +1659,37 @@ uint8_t commands_execute()
 			ret = execute_print_fox_history(parameter);
 		} else if (cmd == CMD_SET_RELOAD)	{
 			ret = execute_set_reload(parameter);
+		} else if (cmd == CMD_QUERY_TAG)	{
+			ret = execute_query_tag(parameter);
+		} else if (cmd == CMD_GET_RFID_STATS)	{
+			ret = execute_get_rfid_stats(parameter);
+		} else if (cmd == CMD_SET_REPUNCH_WINDOW)	{
+			ret = execute_set_repunch_window(parameter);
+		} else if (cmd == CMD_SET_COMPACT_READOUT)	{
+			ret = execute_set_compact_readout(parameter);
+		} else if (cmd == CMD_SET_STATION)	{
+			ret = execute_set_station(parameter);
+		} else if (cmd == CMD_QUEUE_ID)	{
+			ret = execute_queue_id(parameter);
+		} else if (cmd == CMD_CLEAR_ID_QUEUE)	{
+			ret = execute_clear_id_queue(parameter);
+		} else if (cmd == CMD_GET_TASK_STATS)	{
+			ret = execute_get_task_stats(parameter);
+		} else if (cmd == CMD_SET_WINDOW)	{
+			ret = execute_set_window(parameter);
+		} else if (cmd == CMD_SET_CONFIG)	{
+			ret = execute_set_config(parameter);
 		} else {
 			/* message for command not in this mode */
 		}
+		if (mode == CONFIG_MODE)	{
+			goto execute_command_end; /* saved by finish_config */
+		}
 
-		if (ret == CMD_STATUS_OK || CMD_STATUS_OK_NO_OK)	{
-#ifdef EACH_COMMAND_RELOAD
-			if (reload_each_command == TRUE)	{
-				main_reload();
-			}
-#endif
+		if (ret == CMD_STATUS_OK || ret == CMD_STATUS_OK_NO_OK)	{
+			commit_settings();
+		} else {
+			config_commit(); /* settings changed before the error */
 		}
 		if (ret == CMD_STATUS_OK)	{
 			uart_send_text_sram("OK\r\n");
@@ -1098,6 +1697,13 @@ uint8_t commands_execute()
 	}
 
 execute_command_end:
+	if (mode == CONFIG_MODE)	{
+		/* errors are reported once at the end of the block */
+		if (ret != CMD_STATUS_OK && ret != CMD_STATUS_OK_NO_OK && config_error_line == 0)	{
+			config_error_line = config_line;
+		}
+		ret = CMD_STATUS_OK_NO_OK;
+	}
 	if (ret == CMD_STATUS_NOT_RECOGNIZED)	{
 		uart_send_text_flash((uint16_t)cmd_not_rec); /* output command not recognized */
 		UART_NEWLINE();
@@ -0,0 +1,163 @@
+/*
+ *  config.c - configuration of the fox saved in eeprom with a ram copy
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "main.h"
+#include "config.h"
+#include "dds.h"
+#include "morse.h"
+#include "startup.h"
+#include "user.h"
+#include "uart.h"
+
+#define CONFIG_CRC_INIT		0xffff
+
+struct config EEMEM config_eemem;
+struct config config;
+
+/* FALSE if the eeprom had a wrong version or crc and the defaults are used */
+static uint8_t config_valid = FALSE;
+
+const char PROGMEM config_text[] = "Configuration: ";
+const char PROGMEM config_valid_text[] = "valid";
+const char PROGMEM config_invalid_text[] = "eeprom invalid, defaults used";
+
+/*
+ * internal functions
+ */
+
+/**
+ * config_crc - calculate the crc of the configuration in ram
+ *
+ *		Return: crc over all bytes of config before the crc field
+ */
+static uint16_t config_crc(void)
+{
+	uint16_t crc = CONFIG_CRC_INIT;
+	const uint8_t *byte = (const uint8_t *)&config;
+	uint8_t i;
+	for (i = 0; i < offsetof(struct config, crc); i++)	{
+		crc = _crc16_update(crc, byte[i]);
+	}
+	return crc;
+}
+
+/**
+ * config_set_defaults - set all settings to their default values
+ *
+ *		Except for start and stop time the defaults are the values the
+ *		getters returned for an erased eeprom before the configuration was
+ *		saved as one block.
+ */
+static void config_set_defaults(void)
+{
+	uint8_t i;
+
+	memset(&config, 0, sizeof(config));
+	config.version = CONFIG_VERSION;
+
+	config.frequency = DDS_FREQUENCY_DEFAULT;
+	config.crystal_frequency = DDS_CRYSTAL_FREQUENCY_DEFAULT;
+	config.modulation = FALSE;
+	config.amplitude = DDS_AMPLITUDE_EEPROM_DEFAULT;
+
+	config.morsing_enabled = TRUE;
+	config.fox_number = FOX_NUMBER_DEMO;
+	config.transmit_minute = 0;
+	config.call_sign = CALL_MOE;
+	config.fox_max = FOX_MAX_MAX;
+	config.morse_unit = morse_convert_wpm_morse_unit(MORSE_WPM_DEFAULT);
+
+	/* start time == stop time -> window 0 is not used */
+	config.start_time[STARTUP_DATE] = 1;
+	config.start_time[STARTUP_MONTH] = 1;
+	config.stop_time[STARTUP_DATE] = 1;
+	config.stop_time[STARTUP_MONTH] = 1;
+	for (i = 0; i < STARTUP_WINDOWS - 1; i++)	{
+		config.windows[i].start = STARTUP_NEVER;
+		config.windows[i].stop = STARTUP_NEVER;
+	}
+
+	memset(config.secret, 0xff, SIPHASH_KEY_SIZE);
+	config.repunch_window_s = USER_REPUNCH_WINDOW_DEFAULT_S;
+	config.compact_readout = FALSE;
+	config.station_mode = USER_STATION_FOX;
+}
+
+/*
+ * public functions
+ */
+
+/**
+ * config_init - load the configuration from eeprom into ram
+ *
+ *		If the version or the crc of the configuration in eeprom is wrong
+ *		all settings are set to their defaults. The defaults are written to
+ *		eeprom with the next change of a setting.
+ *
+ *		Return: TRUE if the configuration in eeprom was valid, FALSE otherwise
+ */
+uint8_t config_init(void)
+{
+	eeprom_read_block(&config, &config_eemem, sizeof(config));
+	if (config.version == CONFIG_VERSION && config.crc == config_crc())	{
+		config_valid = TRUE;
+	} else {
+		config_valid = FALSE;
+		config_set_defaults();
+		config.crc = config_crc();
+	}
+	return config_valid;
+}
+
+/**
+ * config_commit - write the configuration to eeprom if it was changed
+ *
+ *		Only the bytes that differ are written (eeprom_update_block), so
+ *		the function can be called after each command. The crc is not used
+ *		to detect a change, a changed configuration can have the same crc.
+ */
+void config_commit(void)
+{
+	config.crc = config_crc();
+	eeprom_update_block(&config, &config_eemem, sizeof(config));
+	config_valid = TRUE;
+}
+
+/**
+ * config_show_configuration - output if the configuration in eeprom is valid
+ */
+void config_show_configuration(void)
+{
+	uart_send_text_flash((uint16_t)config_text);
+	if (config_valid == TRUE)	{
+		uart_send_text_flash((uint16_t)config_valid_text);
+	} else {
+		uart_send_text_flash((uint16_t)config_invalid_text);
+	}
+	UART_NEWLINE();
+}
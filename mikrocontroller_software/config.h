@@ -0,0 +1,76 @@
+/*
+ *  config.h - definitions for the configuration saved in eeprom
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "startup.h"
+#include "siphash.h"
+
+/* increase if struct config changes, the eeprom is then reset to defaults */
+#define CONFIG_VERSION		1
+
+/**
+ * struct config - all settings of the fox
+ *
+ *		The struct is loaded once from eeprom by config_init, the modules
+ *		read and change the copy in ram. config_commit writes it back.
+ *		The setters of the modules check the values, so the getters can
+ *		return the fields without checking them again.
+ */
+struct config {
+	uint8_t version;
+
+	/* dds.c */
+	uint32_t frequency;
+	uint32_t crystal_frequency;
+	uint8_t modulation;
+	uint8_t amplitude;				/* percentage */
+
+	/* morse.c */
+	uint8_t morsing_enabled;
+	uint8_t fox_number;
+	uint8_t transmit_minute;
+	uint8_t call_sign;
+	uint8_t fox_max;
+	uint16_t morse_unit;			/* time of one dot divided by 100us */
+
+	/* startup.c */
+	uint8_t start_time[STARTUP_TIME_MAX + 1];
+	uint8_t stop_time[STARTUP_TIME_MAX + 1];
+	struct startup_window windows[STARTUP_WINDOWS - 1]; /* windows 1 to STARTUP_WINDOWS - 1 */
+
+	/* user.c */
+	uint8_t secret[SIPHASH_KEY_SIZE];
+	uint16_t repunch_window_s;
+	uint8_t compact_readout;
+	uint8_t station_mode;
+
+	uint16_t crc;					/* over all bytes before */
+} __attribute__((packed));
+
+extern struct config config;
+
+uint8_t config_init(void);
+void config_commit(void);
+void config_show_configuration(void);
+
+#endif
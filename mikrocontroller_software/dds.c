@@ -21,10 +21,10 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <avr/eeprom.h>
 #include <util/delay.h>
 
 #include "dds.h"
+#include "config.h"
 #include "main.h"
 #include "pins.h"
 #include "uart.h"
@@ -70,11 +70,6 @@ const uint16_t sin_table[SIN_VALUES] = {8703, 13217, 16007, 16007, 13217, 8703,
 uint8_t sin_table_byte0[SIN_VALUES] = {0}; /* to store values temporary so that amplitude calculate does not have to be done in ISR */
 uint8_t sin_table_byte1[SIN_VALUES] = {0};
 
-uint32_t EEMEM frequency;
-uint32_t EEMEM calibrated_crystal;
-uint8_t EEMEM modulation;
-uint8_t EEMEM amplitude;
-
 volatile uint8_t on = DDS_OFF;
 volatile uint8_t current_modulation = FALSE;
 
@@ -88,10 +83,27 @@ uint8_t execute_command_buffer;
 #define CONTINUOUS_CARRIER_80M	2
 static uint8_t continuous_carrier = CONTINUOUS_CARRIER_OFF;
 
+/* frequency of the active transmit window, 0 if the eeprom frequency is used */
+static uint32_t window_frequency = 0;
+
 /*
  * internal functions
  */
 
+/**
+ * dds_get_output_frequency - frequency that is currently transmitted
+ *
+ *		Return: the frequency of the active transmit window if one is set,
+ *		the frequency saved in eeprom otherwise
+ */
+static uint32_t dds_get_output_frequency(void)
+{
+	if (window_frequency != 0)	{
+		return window_frequency;
+	}
+	return dds_get_frequency();
+}
+
 /**
  * wait_spi - wait until SPI transmit is ready
  */
@@ -194,7 +206,7 @@ static uint8_t dds_read_register(int8_t register_address, int8_t *data, int8_t l
 static void dds_set_amplitude(uint16_t amplitude)
 {
 	uint32_t dds_amplitude_max;
-	if (dds_get_frequency() < DDS_FREQ_MULTIPLIER)	{
+	if (dds_get_output_frequency() < DDS_FREQ_MULTIPLIER)	{
 		dds_amplitude_max = DDS_AMPLITUDE_MAX_80M / 100 * DDS_AMPLITUDE_MAX;
 	} else {
 		if (dds_get_modulation() == TRUE)	{
@@ -216,7 +228,7 @@ static uint16_t dds_get_amplitude(void)
 {
 	uint32_t dds_amplitude_max;
 	if (continuous_carrier == CONTINUOUS_CARRIER_OFF)	{
-		if (dds_get_frequency() < DDS_FREQ_MULTIPLIER)	{
+		if (dds_get_output_frequency() < DDS_FREQ_MULTIPLIER)	{
 			dds_amplitude_max = ((uint32_t)DDS_AMPLITUDE_MAX_80M * DDS_AMPLITUDE_MAX) / 100;
 		} else {
 			if (dds_get_modulation() == TRUE)	{
@@ -230,7 +242,7 @@ static uint16_t dds_get_amplitude(void)
 	} else {
 		dds_amplitude_max = ((uint32_t)DDS_AMPLITUDE_MAX_80M * DDS_AMPLITUDE_MAX) / 100;
 	}
-	return (eeprom_read_byte(&amplitude) / 100.0 * dds_amplitude_max);
+	return (config.amplitude / 100.0 * dds_amplitude_max);
 }
 
 /**
@@ -283,7 +295,7 @@ static void dds_write_output_ftw(uint32_t ftw_val)
  */
 static uint32_t dds_get_ftw(void)
 {
-	return FREQ_TO_FTW(dds_get_frequency());
+	return FREQ_TO_FTW(dds_get_output_frequency());
 }
 
 /**
@@ -463,7 +475,7 @@ void dds_load_configuration(void)
 
 #ifdef NEW_PROTOTYPE
 	/* turn on the amplifier */
-	if (dds_get_frequency() > DDS_FREQ_2M_80M_LIMIT)	{
+	if (dds_get_output_frequency() > DDS_FREQ_2M_80M_LIMIT)	{
 		PA_PORT &= ~(1 << PA_80M);
 		PA_PORT |= (1 << PA_2M);
 	} else {
@@ -503,7 +515,8 @@ uint8_t dds_set_amplitude_percentage(uint8_t amp)
 	if (amp < DDS_AMPLITUDE_EEPROM_MIN || amp > DDS_AMPLITUDE_EEPROM_MAX)	{
 		return FALSE;
 	}
-	eeprom_write_byte(&amplitude, amp);
+	config.amplitude = amp;
+	main_mark_dirty(MAIN_RELOAD_DDS);
 	return TRUE;
 }
 
@@ -512,11 +525,7 @@ uint8_t dds_set_amplitude_percentage(uint8_t amp)
  */
 uint8_t dds_get_amplitude_percentage(void)
 {
-	uint8_t amp = eeprom_read_byte(&amplitude);
-	if (amp < DDS_AMPLITUDE_EEPROM_MIN || amp > DDS_AMPLITUDE_EEPROM_MAX)	{
-		amp = DDS_AMPLITUDE_EEPROM_DEFAULT;
-	}
-	return amp;
+	return config.amplitude;
 }
 
 /**
@@ -594,7 +603,8 @@ uint8_t dds_set_frequency(uint32_t frequency_val)
 	if (frequency_val > DDS_FREQUENCY_MAX || frequency_val < DDS_FREQUENCY_MIN)	{
 		return FALSE;
 	}
-	eeprom_write_dword(&frequency, frequency_val);
+	config.frequency = frequency_val;
+	main_mark_dirty(MAIN_RELOAD_DDS);
 	return TRUE;
 }
 
@@ -605,11 +615,28 @@ uint8_t dds_set_frequency(uint32_t frequency_val)
  */
 uint32_t dds_get_frequency(void)
 {
-	uint32_t freq = eeprom_read_dword(&frequency);
-	if (freq > DDS_FREQUENCY_MAX || freq < DDS_FREQUENCY_MIN)	{
-		freq = DDS_FREQUENCY_DEFAULT;
+	return config.frequency;
+}
+
+/**
+ * dds_set_window_frequency - set the frequency of the active transmit window
+ * @frequency_val: frequency in Hz, 0 to use the frequency saved in eeprom
+ *
+ *		Is called by startup.c when a transmit window starts. The dds is
+ *		only reconfigured if the frequency changes.
+ *
+ *		Return: TRUE if frequency is 0 or in the correct range, FALSE otherwise
+ */
+uint8_t dds_set_window_frequency(uint32_t frequency_val)
+{
+	if (frequency_val != 0 && (frequency_val > DDS_FREQUENCY_MAX || frequency_val < DDS_FREQUENCY_MIN))	{
+		return FALSE;
+	}
+	if (frequency_val != window_frequency)	{
+		window_frequency = frequency_val;
+		dds_load_configuration();
 	}
-	return freq;
+	return TRUE;
 }
 
 /**
@@ -625,7 +652,8 @@ uint8_t dds_set_crystal_frequency(uint32_t frequency)
 	if (frequency > DDS_CRYSTAL_FREQUENCY_MAX || frequency < DDS_CRYSTAL_FREQUENCY_MIN)	{
 		return FALSE;
 	}
-	eeprom_write_dword(&calibrated_crystal, frequency);
+	config.crystal_frequency = frequency;
+	main_mark_dirty(MAIN_RELOAD_DDS);
 	return TRUE;
 }
 
@@ -636,11 +664,7 @@ uint8_t dds_set_crystal_frequency(uint32_t frequency)
  */
 uint32_t dds_get_crystal_frequency(void)
 {
-	uint32_t freq = eeprom_read_dword(&calibrated_crystal);
-	if (freq < DDS_CRYSTAL_FREQUENCY_MIN || freq > DDS_CRYSTAL_FREQUENCY_MAX)	{
-		freq = DDS_CRYSTAL_FREQUENCY_DEFAULT;
-	}
-	return freq;
+	return config.crystal_frequency;
 }
 
 /**
@@ -649,7 +673,8 @@ uint32_t dds_get_crystal_frequency(void)
  */
 void dds_set_modulation(uint8_t mod)
 {
-	eeprom_write_byte(&modulation, mod);
+	config.modulation = (mod == TRUE) ? TRUE : FALSE;
+	main_mark_dirty(MAIN_RELOAD_DDS);
 }
 
 /**
@@ -660,11 +685,7 @@ void dds_set_modulation(uint8_t mod)
  */
 uint8_t dds_get_modulation(void)
 {
-	uint8_t mod = eeprom_read_byte(&modulation);
-	if (mod != TRUE)	{
-		mod = FALSE;
-	}
-	return mod;
+	return config.modulation;
 }
 
 /**
@@ -85,6 +85,7 @@ void dds_load_configuration(void);
 
 uint8_t dds_set_frequency(uint32_t frequency);
 uint32_t dds_get_frequency(void);
+uint8_t dds_set_window_frequency(uint32_t frequency);
 
 uint8_t dds_set_crystal_frequency(uint32_t frequency);
 uint32_t dds_get_crystal_frequency(void);
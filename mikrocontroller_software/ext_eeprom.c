@@ -21,21 +21,55 @@
 
 #include <avr/io.h>
 #include <util/delay.h>
+#include <string.h>
 
 #include "main.h"
 #include "rtc.h"
 #include "twi.h"
 #include "uart.h"
 #include "ext_eeprom.h"
+#include "timer.h"
 
 #define EEPROM_ADDRESS		0b10100000
 #define EEPROM_ADDRESS_W	0b10100000
 #define EEPROM_ADDRESS_R	0b10100001
 
+/* the prefix functions return without stop condition, it is sent once by the caller */
 #define RETURN_IF_ERROR(ret)		if (ret != TWI_OK) { rtc_enable_avr_interrupt(); return ret; }
+#define STOP_IF_ERROR(ret)			if (ret != TWI_OK) { twi_stop(); rtc_enable_avr_interrupt(); return ret; }
 #define RETURN_MACRO(ret)				rtc_enable_avr_interrupt(); return ret;
 
 #define EEPROM_PAGE_SIZE	128
+#define EEPROM_WRITE_CYCLE_MS	5 /* maximum write cycle time of the 24AA512 */
+#define EEPROM_ASYNC_WRITE_MS	10 /* queued page write and write cycle */
+#define EEPROM_QUEUE_LENGTH		6 /* queued writes, a punch needs up to four */
+#define EEPROM_QUEUE_DATA		8 /* maximum number of bytes of one queued write */
+
+/* a write of ext_eeprom_queue_write, data is inside of one eeprom page */
+struct queued_write	{
+	uint16_t addr;
+	uint8_t number;
+	uint8_t tries; /* failed attempts */
+	uint8_t started; /* TRUE while async_transaction belongs to this write */
+	uint8_t data[EEPROM_QUEUE_DATA];
+};
+
+/*
+ * write_cycle_timer is active while the eeprom may still be in its write
+ * cycle, only then ext_eeprom_wait has to poll the eeprom
+ */
+static struct timer write_cycle_timer;
+
+/* transaction for ext_eeprom_write_page_async */
+static struct twi_transaction async_transaction;
+
+/* writes that are done in the background by ext_eeprom_process */
+static struct queued_write write_queue[EEPROM_QUEUE_LENGTH];
+static uint8_t write_queue_head = 0;
+static uint8_t write_queue_count = 0;
+static uint16_t failed_writes = 0; /* queued writes that could not be written at all */
+
+const char PROGMEM failed_writes_msg[] = "EEPROM failed writes: ";
 
 /*
  * internal functions
@@ -44,12 +78,17 @@
 /**
  * ext_eeprom_wait - wait until eeprom has finished its write process
  *
+ *		The eeprom is only polled if write_cycle_timer is still active
+ *
  *		Return: TWI_OK if writing ist finished, TWI_ERR if writing is not finished
  *		after 5ms or if eeprom is not responding at all
  */
 static uint8_t ext_eeprom_wait(void)
 {
 	uint8_t ret = TWI_OK, count = 0;
+	if (timer_is_active(&write_cycle_timer) == FALSE)	{
+		return TWI_OK;
+	}
 	while (ext_eeprom_is_ready() != TWI_OK)	{
 		if (count >= 10)	{
 			ret = TWI_ERR;
@@ -100,7 +139,7 @@ static uint8_t address_read_prefix(uint16_t addr)
 }
 
 /**
- * ext_eeprom_write_page - write maximum of one page to eeprom
+ * ext_eeprom_write_page_try - one attempt to write maximum of one page
  * @data:	pointer to data buffer with data to be written
  * @addr:	address of first byte written in eeprom
  * @number:	number of bytes to be written
@@ -111,7 +150,7 @@ static uint8_t address_read_prefix(uint16_t addr)
  *
  *		Return: TWI_OK on success, TWI_ERR on failure
  */
-static inline uint8_t ext_eeprom_write_page(const uint8_t *data, uint16_t addr, uint8_t number)
+static uint8_t ext_eeprom_write_page_try(const uint8_t *data, uint16_t addr, uint8_t number)
 {
 	if (ext_eeprom_wait() != TWI_OK)	{
 		return TWI_ERR;
@@ -120,16 +159,154 @@ static inline uint8_t ext_eeprom_write_page(const uint8_t *data, uint16_t addr,
 	rtc_disable_avr_interrupt();
 	uint8_t ret;
 	ret = address_write_prefix(addr);
-	RETURN_IF_ERROR(ret);
+	STOP_IF_ERROR(ret);
 	uint8_t i;
 	for (i = 0; i < number; i++)	{
 		ret = twi_send_byte(data[i]);
-		RETURN_IF_ERROR(ret);
+		STOP_IF_ERROR(ret);
+	}
+	twi_stop();
+	timer_start(&write_cycle_timer, EEPROM_WRITE_CYCLE_MS, 0, 0);
+	RETURN_MACRO(ret);
+}
+
+/**
+ * ext_eeprom_write_page - write maximum of one page to eeprom
+ * @data:	pointer to data buffer with data to be written
+ * @addr:	address of first byte written in eeprom
+ * @number:	number of bytes to be written
+ *
+ *		The addresses addr to (addr + number - 1) should be inside
+ *		a physical page of the eeprom. The write is repeated up to
+ *		TWI_TRIES times.
+ *
+ *		Return: TWI_OK on success, TWI_ERR on failure
+ */
+static uint8_t ext_eeprom_write_page(const uint8_t *data, uint16_t addr, uint8_t number)
+{
+	uint8_t ret = TWI_ERR, i;
+	for (i = 0; i < TWI_TRIES; i++)	{
+		if (i > 0)	{
+			twi_count_retry();
+		}
+		ret = ext_eeprom_write_page_try(data, addr, number);
+		if (ret == TWI_OK)	{
+			break;
+		}
+	}
+	return ret;
+}
+
+/**
+ * ext_eeprom_read_block_try - one attempt to read n bytes from eeprom
+ * @data:	pointer to data buffer where the bytes will be stored
+ * @addr:	address of first byte to read
+ * @number: number of bytes to read
+ *
+ *		Return: TWI_OK on success and TWI_ERR on failure
+ */
+static uint8_t ext_eeprom_read_block_try(uint8_t *data, uint16_t addr, uint16_t number)
+{
+	if (ext_eeprom_wait() != TWI_OK)	{
+		return TWI_ERR;
+	}
+
+	rtc_disable_avr_interrupt();
+	uint8_t ret;
+	ret = address_read_prefix(addr);
+	STOP_IF_ERROR(ret);
+	uint8_t i;
+	for (i = 0; i < (number - 1); i++)	{
+		ret = twi_read_byte(TWI_ACK, &data[i]);
+		STOP_IF_ERROR(ret);
 	}
+	ret = twi_read_byte(TWI_NACK, &data[number - 1]);
+	STOP_IF_ERROR(ret);
 	twi_stop();
 	RETURN_MACRO(ret);
 }
 
+/**
+ * ext_eeprom_write_page_async - write maximum of one page in the background
+ * @data:		data to write, must stay valid until finished
+ * @addr:		address of first byte written in eeprom
+ * @number:		number of bytes to write (at least one)
+ *
+ *		The addresses addr to (addr + number - 1) have to be inside one
+ *		physical page of the eeprom. The eeprom starts its write cycle
+ *		after the transaction, the blocking functions wait for it with
+ *		ext_eeprom_wait().
+ *
+ *		Return: TWI_OK if queued, TWI_ERR if the twi queue is full
+ */
+static uint8_t ext_eeprom_write_page_async(const uint8_t *data, uint16_t addr,
+		uint8_t number)
+{
+	async_transaction.address = EEPROM_ADDRESS;
+	async_transaction.header[0] = addr >> 8;
+	async_transaction.header[1] = addr & 0xFF;
+	async_transaction.header_length = 2;
+	async_transaction.write_data = data;
+	async_transaction.write_length = number;
+	async_transaction.read_data = 0;
+	async_transaction.read_length = 0;
+	async_transaction.callback = 0;
+	if (twi_queue_transaction(&async_transaction) != TWI_OK)	{
+		return TWI_ERR;
+	}
+	timer_start(&write_cycle_timer, EEPROM_ASYNC_WRITE_MS, 0, 0);
+	return TWI_OK;
+}
+
+/**
+ * write_queue_pop - remove the oldest queued write
+ */
+static void write_queue_pop(void)
+{
+	write_queue[write_queue_head].started = FALSE;
+	write_queue_head = (write_queue_head + 1) % EEPROM_QUEUE_LENGTH;
+	write_queue_count--;
+}
+
+/**
+ * write_queue_overlaps - check if a queued write touches an address range
+ * @addr:	address of first byte of the range
+ * @number:	number of bytes of the range
+ *
+ *		Return: TRUE if at least one queued write overlaps, FALSE otherwise
+ */
+static uint8_t write_queue_overlaps(uint16_t addr, uint16_t number)
+{
+	uint8_t i;
+	for (i = 0; i < write_queue_count; i++)	{
+		struct queued_write *write = &write_queue[(write_queue_head + i) % EEPROM_QUEUE_LENGTH];
+		if ((uint32_t)write->addr < (uint32_t)addr + number &&
+				(uint32_t)addr < (uint32_t)write->addr + write->number)	{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * ext_eeprom_flush - finish all queued writes with the blocking functions
+ *
+ *		Called before a blocking access to an address range with queued
+ *		writes, so that reads return the new data and the order of the
+ *		writes is kept
+ */
+static void ext_eeprom_flush(void)
+{
+	while (write_queue_count > 0)	{
+		struct queued_write *write = &write_queue[write_queue_head];
+		twi_wait_idle(); /* the active transaction is finished afterwards */
+		if (write->started == FALSE || async_transaction.status != TWI_OK)	{
+			ext_eeprom_write_page(write->data, write->addr, write->number);
+		}
+		write_queue_pop();
+	}
+}
+
 /*
  * public functions
  */
@@ -163,6 +340,9 @@ uint8_t ext_eeprom_write_block(const uint8_t *data, uint16_t addr, uint16_t numb
 	uint16_t current_number = 0;
 	uint8_t to_write;
 	uint8_t ret;
+	if (write_queue_overlaps(addr, number) == TRUE)	{
+		ext_eeprom_flush();
+	}
 	while (current_number < number)	{
 		to_write = EEPROM_PAGE_SIZE - (addr % EEPROM_PAGE_SIZE);
 		if (((uint32_t)current_addr + to_write) > ((uint32_t)addr + number))	{
@@ -186,29 +366,27 @@ uint8_t ext_eeprom_write_block(const uint8_t *data, uint16_t addr, uint16_t numb
  * @number: number of bytes to read
  *
  *		If number + addr is bigger than 64kByte ->
- *		Functions starts to read at beginning of eeprom
+ *		Functions starts to read at beginning of eeprom. The read is
+ *		repeated up to TWI_TRIES times.
  *
  *		Return: TWI_OK on success and TWI_ERR on failuer
  */
 uint8_t ext_eeprom_read_block(uint8_t *data, uint16_t addr, uint16_t number)
 {
-	if (ext_eeprom_wait() != TWI_OK)	{
-		return TWI_ERR;
+	uint8_t ret = TWI_ERR, i;
+	if (write_queue_overlaps(addr, number) == TRUE)	{
+		ext_eeprom_flush();
 	}
-
-	rtc_disable_avr_interrupt();
-	uint8_t ret;
-	ret = address_read_prefix(addr);
-	RETURN_IF_ERROR(ret);
-	uint8_t i;
-	for (i = 0; i < (number - 1); i++)	{
-		ret = twi_read_byte(TWI_ACK, &data[i]);
-		RETURN_IF_ERROR(ret);
+	for (i = 0; i < TWI_TRIES; i++)	{
+		if (i > 0)	{
+			twi_count_retry();
+		}
+		ret = ext_eeprom_read_block_try(data, addr, number);
+		if (ret == TWI_OK)	{
+			break;
+		}
 	}
-	ret = twi_read_byte(TWI_NACK, &data[number - 1]);
-	RETURN_IF_ERROR(ret);
-	twi_stop();
-	RETURN_MACRO(ret);
+	return ret;
 }
 
 /**
@@ -287,6 +465,120 @@ uint8_t ext_eeprom_read_dword(uint16_t addr, uint32_t *dword)
 	return ext_eeprom_read_block((uint8_t *)dword, addr, 4);
 }
 
+/**
+ * ext_eeprom_queue_write - write n bytes to eeprom in the background
+ * @data:	pointer to data buffer with data to be written, is copied
+ * @addr:	address of first byte written in eeprom
+ * @number:	number of bytes to be written
+ *
+ *		The write is done by ext_eeprom_process with the interrupt driven
+ *		twi engine, so the caller does not wait for the bus and the write
+ *		cycle. Blocking reads and writes of the same addresses finish the
+ *		queued writes first. Writes that do not fit into the queue are done
+ *		with ext_eeprom_write_block.
+ *
+ *		Return: TWI_OK if queued or written, TWI_ERR on failure
+ */
+uint8_t ext_eeprom_queue_write(const uint8_t *data, uint16_t addr, uint16_t number)
+{
+	uint8_t pieces[2]; /* bytes before and after a page boundary */
+	uint8_t i;
+
+	if (number > 2 * EEPROM_QUEUE_DATA)	{
+		return ext_eeprom_write_block(data, addr, number);
+	}
+	pieces[0] = EEPROM_PAGE_SIZE - (addr % EEPROM_PAGE_SIZE);
+	if (pieces[0] > number)	{
+		pieces[0] = number;
+	}
+	pieces[1] = number - pieces[0];
+	if (pieces[0] > EEPROM_QUEUE_DATA || pieces[1] > EEPROM_QUEUE_DATA ||
+			write_queue_count + 2 > EEPROM_QUEUE_LENGTH)	{
+		return ext_eeprom_write_block(data, addr, number);
+	}
+	for (i = 0; i < 2 && pieces[i] > 0; i++)	{
+		struct queued_write *write = &write_queue[(write_queue_head + write_queue_count) % EEPROM_QUEUE_LENGTH];
+		write->addr = addr;
+		write->number = pieces[i];
+		write->tries = 0;
+		write->started = FALSE;
+		memcpy(write->data, data, pieces[i]);
+		write_queue_count++;
+		data += pieces[i];
+		addr += pieces[i];
+	}
+	return TWI_OK;
+}
+
+/**
+ * ext_eeprom_pending - check if ext_eeprom_process has work to do
+ *
+ *		Return: TRUE if a queued write can be started or a started one
+ *		is finished, FALSE otherwise
+ */
+uint8_t ext_eeprom_pending(void)
+{
+	if (write_queue_count == 0 || async_transaction.status == TWI_BUSY)	{
+		return FALSE;
+	}
+	if (write_queue[write_queue_head].started == TRUE)	{
+		return TRUE;
+	}
+	return (timer_is_active(&write_cycle_timer) == FALSE) ? TRUE : FALSE;
+}
+
+/**
+ * ext_eeprom_process - advance the queued writes, called from the main loop
+ *
+ *		Completes the write of the finished transaction and starts the next
+ *		write after the write cycle of the eeprom. A failed write is
+ *		repeated up to TWI_TRIES times, then it is done with the blocking
+ *		functions. If this fails as well the write is counted in
+ *		failed_writes (see ext_eeprom_print_stats).
+ */
+void ext_eeprom_process(void)
+{
+	struct queued_write *write;
+
+	if (ext_eeprom_pending() != TRUE)	{
+		return;
+	}
+	write = &write_queue[write_queue_head];
+	if (write->started == TRUE)	{
+		write->started = FALSE;
+		if (async_transaction.status == TWI_OK)	{
+			write_queue_pop();
+			return;
+		}
+		write->tries++;
+		if (write->tries >= TWI_TRIES)	{
+			/* a lost pointer or index write would corrupt the log */
+			if (ext_eeprom_write_page(write->data, write->addr, write->number) != TWI_OK)	{
+				failed_writes++;
+			}
+			write_queue_pop();
+			return;
+		}
+		twi_count_retry();
+		/* the eeprom may not respond during the write cycle */
+		timer_start(&write_cycle_timer, EEPROM_WRITE_CYCLE_MS, 0, 0);
+		return;
+	}
+	if (ext_eeprom_write_page_async(write->data, write->addr, write->number) == TWI_OK)	{
+		write->started = TRUE;
+	}
+}
+
+/**
+ * ext_eeprom_print_stats - output the number of failed queued writes to uart
+ */
+void ext_eeprom_print_stats(void)
+{
+	uart_send_text_flash((uint16_t)failed_writes_msg);
+	uart_send_int(failed_writes);
+	UART_NEWLINE();
+}
+
 /**
  * ext_eeprom_is_ready - checks if eeprom is ready to send or receive new data
  *
@@ -303,10 +595,10 @@ uint8_t ext_eeprom_is_ready(void)
 	rtc_disable_avr_interrupt();
 
 	ret = address_read_prefix(0x00);
-	RETURN_IF_ERROR(ret);
+	STOP_IF_ERROR(ret);
 
 	ret = twi_read_byte(TWI_NACK, &temp);
-	RETURN_IF_ERROR(ret);
+	STOP_IF_ERROR(ret);
 
 	twi_stop();
 
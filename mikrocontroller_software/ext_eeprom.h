@@ -32,6 +32,11 @@ uint8_t ext_eeprom_read_word(uint16_t addr, uint16_t *word);
 uint8_t ext_eeprom_read_dword(uint16_t addr, uint32_t *dword);
 uint8_t ext_eeprom_read_block(uint8_t *data, uint16_t addr, uint16_t number);
 
+uint8_t ext_eeprom_queue_write(const uint8_t *data, uint16_t addr, uint16_t number);
+uint8_t ext_eeprom_pending(void);
+void ext_eeprom_process(void);
+void ext_eeprom_print_stats(void);
+
 uint8_t ext_eeprom_is_ready(void);
 
 #endif
@@ -21,6 +21,7 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 #include <util/twi.h>
 #include <stdio.h>
@@ -37,6 +38,9 @@
 #include "rfid.h"
 #include "ext_eeprom.h"
 #include "user.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "config.h"
 
 #define CARRIER_OFF		0
 #define CARRIER_2M		1
@@ -45,14 +49,28 @@
 uint8_t adc_2m_values[7] = {12, 13, 15, 20, 30, 50, 100}; /* swr values multiplied by ten as limits for leds */
 uint8_t adc_80m_values[7] = {12, 13, 15, 20, 30, 50, 100}; /* swr values multiplied by ten as limits for leds */
 
-uint8_t should_reload = FALSE;
+static uint8_t dirty_modules = 0;		/* changed since the last main_reload */
+static uint8_t reload_modules = 0;		/* to be reloaded by task_reload */
 
 static uint8_t is_started = FALSE;
 
-volatile uint8_t blinking = FALSE;
-
 static volatile uint8_t continuous_carrier = CARRIER_OFF;
 
+static volatile uint32_t timer1_ms = 0;
+
+#ifdef BLINKING_IS_LED_STATE
+#define BLINK_MS		250 /* status led toggles with this period while blinking */
+static struct timer blink_timer;
+#endif
+
+const char PROGMEM task_rtc_name[] = "RTC events";
+const char PROGMEM task_timer_name[] = "Timers";
+const char PROGMEM task_reload_name[] = "Reload";
+const char PROGMEM task_commands_name[] = "Commands";
+const char PROGMEM task_buttons_name[] = "Buttons/ADC";
+const char PROGMEM task_rfid_name[] = "RFID";
+const char PROGMEM task_ext_eeprom_name[] = "EEPROM writes";
+
 /*
  * internal functions
  */
@@ -85,10 +103,27 @@ static void led_bar_set(uint8_t val)
 }
 
 /**
- * reload_int - reload all modules to apply new eeprom settings
+ * reload_int - reload modules to apply new settings
+ * @modules:	MAIN_RELOAD_ALL to reinitialise all modules, otherwise the
+ *				MAIN_RELOAD_ bits of the modules which only load their settings
  */
-static void reload_int(void)
+static void reload_int(uint8_t modules)
 {
+	if (modules != MAIN_RELOAD_ALL)	{
+		if (modules & MAIN_RELOAD_DDS)	{
+			continuous_carrier = CARRIER_OFF; /* dds switches continuous carrier off */
+			RFID_PORT |= (1 << RFID_CS); /* otherwise spi is not seen as free by dds spi access */
+			dds_load_configuration();
+		}
+		if (modules & MAIN_RELOAD_MORSE)	{
+			morse_load_configuration();
+		}
+		if (modules & MAIN_RELOAD_STARTUP)	{
+			startup_init();
+		}
+		return;
+	}
+
 	continuous_carrier = CARRIER_OFF; /* after reload continuous carrier is off */
 
 	RFID_PORT |= (1 << RFID_CS); /* otherwise spi is not seen as free by dds spi access */
@@ -176,6 +211,157 @@ static uint8_t read_adc(uint8_t *data)
 	return FALSE;
 }
 
+/**
+ * get_timer1 - read millisecond counter and counter register of timer1 consistently
+ * @ms:			pointer where the milliseconds are stored
+ * @count:		pointer where the counter register value is stored
+ */
+static void get_timer1(uint32_t *ms, uint16_t *count)
+{
+	uint8_t sreg = SREG;
+	cli();
+	*ms = timer1_ms;
+	*count = TCNT1;
+	if ((TIFR1 & (1 << OCF1A)) && *count < TIMER1_TOP)	{
+		/* compare match is pending, timer1_ms was not incremented yet */
+		(*ms)++;
+	}
+	SREG = sreg;
+}
+
+#ifdef BLINKING_IS_LED_STATE
+/**
+ * blink_toggle - toggle the status led, callback of blink_timer
+ */
+static void blink_toggle(void)
+{
+#ifdef NEW_PROTOTYPE
+	RFID_LED_TOGGLE();
+#else
+	LED_TOGGLE();
+#endif
+}
+#endif
+
+/**
+ * task_reload_ready - check if the modules have to reload their settings
+ *
+ *		Return: TRUE if main_reload() was called for changed modules,
+ *		FALSE otherwise
+ */
+static uint8_t task_reload_ready(void)
+{
+	return reload_modules != 0;
+}
+
+/**
+ * task_reload - reload the changed modules, deferred until the command is finished
+ */
+static void task_reload(void)
+{
+	uint8_t modules = reload_modules;
+	reload_modules = 0;
+	reload_int(modules);
+}
+
+/**
+ * task_commands_ready - check if a command line was received over uart
+ *
+ *		Return: TRUE if there is a new line, FALSE otherwise
+ */
+static uint8_t task_commands_ready(void)
+{
+	return uart_receive_buffer_text(NULL);
+}
+
+/**
+ * task_commands - execute a received command
+ *
+ *		Is also released periodically to check the state of "set id"
+ */
+static void task_commands(void)
+{
+	commands_execute();
+}
+
+#ifdef NEW_PROTOTYPE
+/**
+ * task_buttons - switch the continuous carrier with the buttons and show the
+ *				  swr of the continuous carrier at the led bar
+ */
+static void task_buttons(void)
+{
+	static uint8_t button_2m_off = FALSE;
+	static uint8_t button_80m_off = FALSE;
+	if ((BUTTON_PIN & (1 << BUTTON_80M)) == 0 && continuous_carrier != CARRIER_80M && button_80m_off == TRUE)	{
+		continuous_carrier = CARRIER_80M;
+		button_80m_off = FALSE;
+		dds_enable_continuous_carrier_80m();
+		enable_adc(CARRIER_80M, 0);
+	}
+	if ((BUTTON_PIN & (1 << BUTTON_2M)) == 0 && continuous_carrier != CARRIER_2M && button_2m_off == TRUE)	{
+		continuous_carrier = CARRIER_2M;
+		button_2m_off = FALSE;
+		dds_enable_continuous_carrier_2m();
+		enable_adc(CARRIER_2M, 0);
+	}
+	if ((BUTTON_PIN & (1 << BUTTON_2M)) == 0 && continuous_carrier == CARRIER_2M && button_2m_off == TRUE)	{
+		continuous_carrier = CARRIER_OFF;
+		button_2m_off = FALSE;
+		dds_disable_continuous_carrier();
+		disable_adc();
+		led_bar_set(0);
+	}
+	if ((BUTTON_PIN & (1 << BUTTON_80M)) == 0 && continuous_carrier == CARRIER_80M && button_80m_off == TRUE)	{
+		continuous_carrier = CARRIER_OFF;
+		button_80m_off = FALSE;
+		dds_disable_continuous_carrier();
+		disable_adc();
+		led_bar_set(0);
+	}
+	if ((BUTTON_PIN & (1 << BUTTON_2M)) != 0)	{
+		button_2m_off = TRUE;
+	}
+	if ((BUTTON_PIN & (1 << BUTTON_80M)) != 0)	{
+		button_80m_off = TRUE;
+	}
+
+	if (continuous_carrier == CARRIER_2M || continuous_carrier == CARRIER_80M)	{
+		static uint8_t num = 0;
+		static uint8_t data[2];
+		if (read_adc(&data[num]) == TRUE)	{
+			num++;
+			if (num > 1)	{
+				num = 0;
+				float value;
+				if (data[1] - data[0] == 0)	{
+					value = 255;
+				} else {
+					value = ((float)(data[1] + data[0])) / (float)(data[0] - data[1]);
+				}
+				uint8_t i;
+				for (i = 0; i < 7; i++)	{
+					if (continuous_carrier == CARRIER_80M)	{
+						if ((value * 10) < adc_2m_values[i])	{
+							break;
+						}
+					} else if (continuous_carrier == CARRIER_2M)	{
+						if ((value * 10) < adc_80m_values[i])	{
+							break;
+						}
+					}
+				}
+				i = 8 - i;
+				led_bar_set(i);
+			}
+			enable_adc(continuous_carrier, num);
+			uint8_t temp;
+			read_adc(&temp); /* to clear ready flag for adc, so that really the next enabled adc ist used */
+		}
+	}
+}
+#endif
+
 /*
  * public functions
  */
@@ -186,15 +372,42 @@ static uint8_t read_adc(uint8_t *data)
  */
 void main_set_blinking(uint8_t mode)
 {
-	blinking = mode;
+#ifdef BLINKING_IS_LED_STATE
+	if (mode != FALSE)	{
+		if (timer_is_active(&blink_timer) == FALSE)	{
+			timer_start(&blink_timer, BLINK_MS, BLINK_MS, blink_toggle);
+		}
+	} else if (timer_is_active(&blink_timer) == TRUE)	{
+		timer_stop(&blink_timer);
+#ifdef NEW_PROTOTYPE
+		RFID_LED_OFF();
+#else
+		LED_OFF();
+#endif
+	}
+#endif
+}
+
+/**
+ * main_mark_dirty - remember that settings of modules have changed
+ * @modules:	MAIN_RELOAD_DDS, MAIN_RELOAD_MORSE etc. or MAIN_RELOAD_ALL
+ *
+ *		Is called by the setters, the modules are reloaded with the next
+ *		main_reload.
+ */
+void main_mark_dirty(uint8_t modules)
+{
+	dirty_modules |= modules;
 }
 
 /**
- * main_reload - tells the main module that all modules should reload their settings
+ * main_reload - tells the main module that the changed modules should reload
+ *				 their settings
  */
 void main_reload(void)
 {
-	should_reload = TRUE;
+	reload_modules |= dirty_modules;
+	dirty_modules = 0;
 }
 
 /**
@@ -207,6 +420,10 @@ int main(void)
 	uart_init();
 	commands_print_welcome_message();
 
+	if (config_init() != TRUE)	{
+		config_show_configuration(); /* warn that the defaults are used */
+	}
+
 	twi_init();
 
 	rtc_init();
@@ -225,86 +442,23 @@ int main(void)
 
 	led_bar_set(0);
 
-	while (1)	{
-		commands_execute();
-
-		if (should_reload == TRUE)	{
-			reload_int();
-			should_reload = FALSE;
-		}
-
-		rfid_loop();
-
+	scheduler_add_task(task_rtc_name, rtc_process_events, rtc_event_pending,
+			0, 0, 10);
+	scheduler_add_task(task_timer_name, timer_process, timer_pending,
+			1, 0, 5);
+	scheduler_add_task(task_reload_name, task_reload, task_reload_ready,
+			2, 0, 100);
+	scheduler_add_task(task_commands_name, task_commands, task_commands_ready,
+			3, 20, 50);
 #ifdef NEW_PROTOTYPE
-		static uint8_t button_2m_off = FALSE;
-		static uint8_t button_80m_off = FALSE;
-		if ((BUTTON_PIN & (1 << BUTTON_80M)) == 0 && continuous_carrier != CARRIER_80M && button_80m_off == TRUE)	{
-			continuous_carrier = CARRIER_80M;
-			button_80m_off = FALSE;
-			dds_enable_continuous_carrier_80m();
-			enable_adc(CARRIER_80M, 0);
-		}
-		if ((BUTTON_PIN & (1 << BUTTON_2M)) == 0 && continuous_carrier != CARRIER_2M && button_2m_off == TRUE)	{
-			continuous_carrier = CARRIER_2M;
-			button_2m_off = FALSE;
-			dds_enable_continuous_carrier_2m();
-			enable_adc(CARRIER_2M, 0);
-		}
-		if ((BUTTON_PIN & (1 << BUTTON_2M)) == 0 && continuous_carrier == CARRIER_2M && button_2m_off == TRUE)	{
-			continuous_carrier = CARRIER_OFF;
-			button_2m_off = FALSE;
-			dds_disable_continuous_carrier();
-			disable_adc();
-			led_bar_set(0);
-		}
-		if ((BUTTON_PIN & (1 << BUTTON_80M)) == 0 && continuous_carrier == CARRIER_80M && button_80m_off == TRUE)	{
-			continuous_carrier = CARRIER_OFF;
-			button_80m_off = FALSE;
-			dds_disable_continuous_carrier();
-			disable_adc();
-			led_bar_set(0);
-		}
-		if ((BUTTON_PIN & (1 << BUTTON_2M)) != 0)	{
-			button_2m_off = TRUE;
-		}
-		if ((BUTTON_PIN & (1 << BUTTON_80M)) != 0)	{
-			button_80m_off = TRUE;
-		}
-
-		if (continuous_carrier == CARRIER_2M || continuous_carrier == CARRIER_80M)	{
-			static uint8_t num = 0;
-			static uint8_t data[2];
-			if (read_adc(&data[num]) == TRUE)	{
-				num++;
-				if (num > 1)	{
-					num = 0;
-					float value;
-					if (data[1] - data[0] == 0)	{
-						value = 255;
-					} else {
-						value = ((float)(data[1] + data[0])) / (float)(data[0] - data[1]);
-					}
-					uint8_t i;
-					for (i = 0; i < 7; i++)	{
-						if (continuous_carrier == CARRIER_80M)	{
-							if ((value * 10) < adc_2m_values[i])	{
-								break;
-							}
-						} else if (continuous_carrier == CARRIER_2M)	{
-							if ((value * 10) < adc_80m_values[i])	{
-								break;
-							}
-						}
-					}
-					i = 8 - i;
-					led_bar_set(i);
-				}
-				enable_adc(continuous_carrier, num);
-				uint8_t temp;
-				read_adc(&temp); /* to clear ready flag for adc, so that really the next enabled adc ist used */
-			}
-		}
+	scheduler_add_task(task_buttons_name, task_buttons, 0, 4, 10, 50);
 #endif
+	scheduler_add_task(task_rfid_name, rfid_loop, rfid_ready, 5, 0, 20);
+	scheduler_add_task(task_ext_eeprom_name, ext_eeprom_process, ext_eeprom_pending,
+			6, 0, 50);
+
+	while (1)	{
+		scheduler_run();
 	}
 }
 
@@ -328,14 +482,45 @@ void main_init()
 	LED_BAR_DDR |= (1 << LED_BAR_CE);
 #endif
 
-	TCCR1B |= (1 << CS12) | (1 << CS10); /* prescaler 1024 of timer1 */
-	TCNT1H = (TIMER1_PRELOAD >> 8) & 0xff;
-	TCNT1L = TIMER1_PRELOAD & 0xff;
-	TIMSK1 |= (1 << TOIE1);
+	/* timer1 is the millisecond time base for main_get_time_ms and timer.c */
+	OCR1A = TIMER1_TOP;
+	TCCR1B |= (1 << WGM12) | (1 << CS11) | (1 << CS10); /* ctc mode, prescaler 64 */
+	TIMSK1 |= (1 << OCIE1A);
 
 	adc_init();
 }
 
+/**
+ * main_get_time_ms - returns milliseconds since startup
+ *
+ *		Can be used to measure the duration of operations.
+ *
+ *		Return: time since startup in milliseconds
+ */
+uint32_t main_get_time_ms(void)
+{
+	uint32_t ms;
+	uint16_t count;
+	get_timer1(&ms, &count);
+	return ms;
+}
+
+/**
+ * main_get_time_us - returns microseconds since startup
+ *
+ *		Resolution is one tick of timer1 (8us at 8MHz). The value
+ *		overflows after about 71 minutes, use it only for differences.
+ *
+ *		Return: time since startup in microseconds
+ */
+uint32_t main_get_time_us(void)
+{
+	uint32_t ms;
+	uint16_t count;
+	get_timer1(&ms, &count);
+	return ms * 1000 + (uint32_t)count * 64 / (F_CPU / 1000000);
+}
+
 /**
  * main_start_time - called to indicate that event has started
  */
@@ -355,37 +540,7 @@ void main_stop_time()
 	is_started = FALSE;
 }
 
-ISR(TIMER1_OVF_vect)
+ISR(TIMER1_COMPA_vect)
 {
-	TCNT1H = (TIMER1_PRELOAD >> 8) & 0xff;
-	TCNT1L = TIMER1_PRELOAD & 0xff;
-
-	user_time_tick();
-
-	static uint8_t count;
-	static uint8_t was_blinking;
-	count++;
-
-	if (count == 5)	{
-#ifdef BLINKING_IS_LED_STATE
-		if (blinking != FALSE)	{
-#ifdef NEW_PROTOTYPE
-			RFID_LED_TOGGLE();
-#else
-			LED_TOGGLE();
-#endif
-			was_blinking = TRUE;
-		} else {
-			if (was_blinking == TRUE)	{
-				was_blinking = FALSE;
-#ifdef NEW_PROTOTYPE
-				RFID_LED_OFF();
-#else
-				LED_OFF();
-#endif
-			}
-		}
-		count = 0;
-#endif
-	}
+	timer1_ms++;
 }
@@ -24,11 +24,11 @@
 #define MAIN_H
 
 /*
- * 8e6MHz / 1024 * (500ms / 1000ms) -> preload value for 500ms overflow time
- * 1024 = prescaler
+ * 8e6MHz / 64 / 1000 -> 125 ticks per millisecond, timer1 counts from 0 to
+ * TIMER1_TOP in ctc mode
+ * 64 = prescaler
  */
-#define TIMER1_MS		50
-#define TIMER1_PRELOAD	(65536 - F_CPU * TIMER1_MS / 1000 / 1024)
+#define TIMER1_TOP		(F_CPU / 64 / 1000 - 1)
 
 #define LED_ON()			LED_PORT |= (1 << LED)
 #define LED_TOGGLE()		LED_PORT ^= (1 << LED)
@@ -39,6 +39,13 @@
 
 void main_init(void);
 
+/* modules whose settings changed, see main_mark_dirty */
+#define MAIN_RELOAD_DDS			(1 << 0)
+#define MAIN_RELOAD_MORSE		(1 << 1)
+#define MAIN_RELOAD_STARTUP		(1 << 2)
+#define MAIN_RELOAD_ALL			0xff /* reinitialise twi, rtc, dds, morse and startup */
+
+void main_mark_dirty(uint8_t modules);
 void main_reload(void);
 
 void main_start_time(void);
@@ -46,4 +53,7 @@ void main_stop_time(void);
 
 void main_set_blinking(uint8_t mode);
 
+uint32_t main_get_time_ms(void);
+uint32_t main_get_time_us(void);
+
 #endif
@@ -19,13 +19,13 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <avr/eeprom.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
 
 #include "main.h"
 #include "startup.h"
 #include "morse.h"
+#include "config.h"
 #include "rtc.h"
 #include "uart.h"
 #include "pins.h"
@@ -47,19 +47,14 @@
 #define MORSE_MINUTE_IS_START			0
 #define MORSE_MINUTE_IS_STOP			1
 
-uint8_t EEMEM morsing_enabled;
-uint8_t EEMEM fox_number_eemem;
-uint8_t EEMEM transmit_minute_eemem;
-uint8_t EEMEM call_number_eemem;
-uint8_t EEMEM fox_max_eemem;
-
-uint16_t EEMEM morse_unit_eemem; /* time of one dot divided by 100us */
-
 const char PROGMEM fxn[] = "Fox number: ";
 const char PROGMEM cfm[] = "Maximum number of foxes used: ";
 const char PROGMEM call_sign_number_text[] = "Call sign: ";
 const char PROGMEM morse_mode_text[] = "Morse mode: ";
 const char PROGMEM transmit_minute_msg[] = "Transmit minute: ";
+#ifdef DEBUG_KEYING_JITTER
+const char PROGMEM keying_latency_msg[] = "Keying latency max: ";
+#endif
 
 /*
  * base = morse_unit * 100us
@@ -118,9 +113,16 @@ uint8_t current_fox_max;
 volatile uint8_t current_morsing_enabled; /* transmit continuous carrier (only in on-minutes) if morsing is disable */
 uint8_t current_transmit_minute;
 
+/* fox max and transmit minute of the active transmit window, 0 if not set */
+static uint8_t window_fox_max = 0;
+static uint8_t window_transmit_minute = 0;
+
 uint8_t morse_started = (1 << MORSE_STARTED_MINUTE);
 volatile uint8_t reset = TRUE;
 volatile uint8_t continuous_carrier = FALSE;
+#ifdef DEBUG_KEYING_JITTER
+volatile uint8_t keying_latency_max = 0; /* in ticks of timer2 (32us at 8MHz), 0xff means 8ms or more */
+#endif
 
 /*
  * internal functions
@@ -397,6 +399,14 @@ void morse_show_configuration()
 		uart_send_text_sram("off");
 	}
 	UART_NEWLINE();
+
+#ifdef DEBUG_KEYING_JITTER
+	uart_send_text_flash((uint16_t)keying_latency_msg);
+	uart_send_int((uint32_t)keying_latency_max * 256 / (F_CPU / 1000000));
+	uart_send_text_sram(" us");
+	UART_NEWLINE();
+	keying_latency_max = 0;
+#endif
 }
 
 /**
@@ -406,8 +416,13 @@ void morse_load_configuration()
 {
 	current_morse_unit = morse_get_morse_unit();
 	current_fox_number = morse_get_fox_number();
-	current_transmit_minute = morse_get_transmit_minute();
-	current_fox_max = morse_get_fox_max();
+	if (window_fox_max != 0)	{
+		current_transmit_minute = window_transmit_minute;
+		current_fox_max = window_fox_max;
+	} else {
+		current_transmit_minute = morse_get_transmit_minute();
+		current_fox_max = morse_get_fox_max();
+	}
 	current_morsing_enabled = morse_get_morse_mode();
 
 	uint8_t i, call = morse_get_call_sign();
@@ -416,6 +431,30 @@ void morse_load_configuration()
 	}
 }
 
+/**
+ * morse_set_window - set fox max and transmit minute of the active transmit window
+ * @fox_max:			number of foxes in this window, 0 to use the values
+ *						saved in eeprom
+ * @transmit_minute:	minute of this fox (between 0 and fox_max - 1)
+ *
+ *		Is called by startup.c before morse_start_time when a transmit window
+ *		starts.
+ *
+ *		Return: TRUE if the values were in correct range, FALSE otherwise
+ */
+uint8_t morse_set_window(uint8_t fox_max, uint8_t transmit_minute)
+{
+	if (fox_max != 0)	{
+		if (fox_max > FOX_MAX_MAX || fox_max < FOX_MAX_MIN || transmit_minute >= fox_max)	{
+			return FALSE;
+		}
+	}
+	window_fox_max = fox_max;
+	window_transmit_minute = transmit_minute;
+	morse_load_configuration();
+	return TRUE;
+}
+
 /**
  * morse_start_time - starts the morse module
  *
@@ -479,10 +518,21 @@ uint16_t morse_convert_morse_unit_wpm(uint16_t morse_unit)
 /**
  * morse_set_morse_unit - stores given morse unit in eeprom
  * @morse_unit_value:	the time for a did divided by 100us
+ *
+ *		The morse unit is not changed if it is not between MORSE_WPM_MIN
+ *		and MORSE_WPM_MAX words per minute.
  */
 void morse_set_morse_unit(uint16_t morse_unit_value)
 {
-	eeprom_write_word(&morse_unit_eemem, morse_unit_value);
+	if (morse_unit_value == 0)	{
+		return;
+	}
+	uint16_t wpm = morse_convert_morse_unit_wpm(morse_unit_value);
+	if (wpm > MORSE_WPM_MAX || wpm < MORSE_WPM_MIN)	{
+		return;
+	}
+	config.morse_unit = morse_unit_value;
+	main_mark_dirty(MAIN_RELOAD_MORSE);
 }
 
 /**
@@ -492,12 +542,7 @@ void morse_set_morse_unit(uint16_t morse_unit_value)
  */
 uint16_t morse_get_morse_unit()
 {
-	uint16_t unit = eeprom_read_word(&morse_unit_eemem);
-	uint16_t wpm = morse_convert_morse_unit_wpm(unit);
-	if (wpm > MORSE_WPM_MAX || wpm < MORSE_WPM_MIN)	{
-		return morse_convert_wpm_morse_unit(MORSE_WPM_DEFAULT);
-	}
-	return unit;
+	return config.morse_unit;
 }
 
 /**
@@ -514,7 +559,8 @@ uint8_t morse_set_fox_number(uint8_t fox_number_local)
 	if (fox_number_local > FOX_NUMBER_MAX)	{
 		return FALSE;
 	}
-	eeprom_write_byte(&fox_number_eemem, fox_number_local);
+	config.fox_number = fox_number_local;
+	main_mark_dirty(MAIN_RELOAD_MORSE);
 	return TRUE;
 }
 
@@ -526,11 +572,7 @@ uint8_t morse_set_fox_number(uint8_t fox_number_local)
  */
 uint8_t morse_get_fox_number(void)
 {
-	uint8_t byte = eeprom_read_byte(&fox_number_eemem);
-	if (byte > FOX_NUMBER_MAX)	{
-		byte = FOX_NUMBER_DEMO;
-	}
-	return byte;
+	return config.fox_number;
 }
 
 /**
@@ -548,7 +590,8 @@ uint8_t morse_set_transmit_minute(uint8_t transmit_minute_local)
 	if (transmit_minute_local > TRANSMIT_MINUTE_MAX)	{
 		return FALSE;
 	}
-	eeprom_write_byte(&transmit_minute_eemem, transmit_minute_local);
+	config.transmit_minute = transmit_minute_local;
+	main_mark_dirty(MAIN_RELOAD_MORSE);
 	return TRUE;
 }
 
@@ -559,11 +602,10 @@ uint8_t morse_set_transmit_minute(uint8_t transmit_minute_local)
  */
 uint8_t morse_get_transmit_minute(void)
 {
-	uint8_t byte = eeprom_read_byte(&transmit_minute_eemem);
-	if (byte >= morse_get_fox_max())	{
-		byte = 0;
+	if (config.transmit_minute >= config.fox_max)	{
+		return 0;
 	}
-	return byte;
+	return config.transmit_minute;
 }
 
 /**
@@ -573,13 +615,7 @@ uint8_t morse_get_transmit_minute(void)
  */
 uint8_t morse_get_fox_max(void)
 {
-	uint8_t byte = eeprom_read_byte(&fox_max_eemem);
-	if (byte > FOX_MAX_MAX || byte < FOX_MAX_MIN)	{
-		byte = FOX_MAX_MAX;
-	} else if (byte == 0)	{
-		byte = FOX_MAX_DEFAULT;
-	}
-	return byte;
+	return config.fox_max;
 }
 
 /**
@@ -597,7 +633,8 @@ uint8_t morse_set_fox_max(uint8_t max)
 	if (max > FOX_MAX_MAX || max < FOX_MAX_MIN)	{
 		return FALSE;
 	}
-	eeprom_write_byte(&fox_max_eemem, max);
+	config.fox_max = max;
+	main_mark_dirty(MAIN_RELOAD_MORSE);
 	return TRUE;
 }
 
@@ -608,7 +645,11 @@ uint8_t morse_set_fox_max(uint8_t max)
  */
 void morse_set_call_sign(uint8_t call)
 {
-	eeprom_write_byte(&call_number_eemem, call);
+	if (call > CALL_MAX)	{
+		return;
+	}
+	config.call_sign = call;
+	main_mark_dirty(MAIN_RELOAD_MORSE);
 }
 
 /**
@@ -619,11 +660,7 @@ void morse_set_call_sign(uint8_t call)
  */
 uint8_t morse_get_call_sign(void)
 {
-	uint8_t byte = eeprom_read_byte(&call_number_eemem);
-	if (byte > CALL_MAX)	{
-		byte = 0;
-	}
-	return byte;
+	return config.call_sign;
 }
 
 /**
@@ -633,7 +670,8 @@ uint8_t morse_get_call_sign(void)
  */
 void morse_set_morse_mode(uint8_t mode)
 {
-	eeprom_write_byte(&morsing_enabled, mode);
+	config.morsing_enabled = (mode != FALSE) ? TRUE : FALSE;
+	main_mark_dirty(MAIN_RELOAD_MORSE);
 }
 
 /**
@@ -646,11 +684,7 @@ void morse_set_morse_mode(uint8_t mode)
  */
 uint8_t morse_get_morse_mode(void)
 {
-	uint8_t byte = eeprom_read_byte(&morsing_enabled);
-	if (byte != FALSE)	{
-		byte = TRUE;
-	}
-	return byte;
+	return config.morsing_enabled;
 }
 
 /**
@@ -679,6 +713,17 @@ ISR(TIMER2_OVF_vect)
 	LED_ON();
 #endif
 
+#ifdef DEBUG_KEYING_JITTER
+	/* timer2 counts on from zero after the overflow until it is preloaded */
+	uint8_t latency = TCNT2;
+	if ((TIFR2 & (1 << TOV2)) > 0)	{
+		/* overflowed again, so TCNT2 has wrapped around */
+		latency = 0xff;
+	}
+	if (latency > keying_latency_max)	{
+		keying_latency_max = latency;
+	}
+#endif
 	TCNT2 = TIMER2_PRELOAD;
 	if (current_morsing_enabled == FALSE || continuous_carrier == TRUE)	{
 		/* so that dds_on is not executed that often (dds has problems
@@ -762,8 +807,8 @@ ISR(TIMER2_OVF_vect)
 /**
  * morse_interrupt - check the current minute and switch on or off morsing
  *
- *		this function is called by rtc.c when the an interrupt by the rtc
- *		occurs. The function checks if it is now time to start or stop
+ *		this function is called by rtc_process_events() from the main loop
+ *		after an interrupt by the rtc occured. The function checks if it is now time to start or stop
  *		morsing (depends on the fox_number during which minute the transmitter
  *		has to send its call sign)
  */
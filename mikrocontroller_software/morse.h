@@ -75,6 +75,8 @@ uint8_t morse_get_morse_mode(void);
 void morse_enable_continuous_carrier(void);
 void morse_disable_continuous_carrier(void);
 
+uint8_t morse_set_window(uint8_t fox_max, uint8_t transmit_minute);
+
 void morse_start_time(void);
 void morse_stop_time(void);
 
@@ -51,6 +51,12 @@
 #define BUTTON_80M			PC2 /* button is active low */
 #endif
 
+#define TWI_PORT			PORTC	/* pins of the twi module for bus recovery */
+#define TWI_DDR				DDRC
+#define TWI_PIN				PINC
+#define TWI_SCL				PC0
+#define TWI_SDA				PC1
+
 #define RTC_MFP				PD3
 #define RTC_MFP_PORT		PORTD
 #define RTC_MFP_DDR			DDRD
@@ -69,8 +75,10 @@
 #define RFID_PIN			PINA
 #define RFID_CS				PA0
 #define RFID_RESET			PA1
-/* RFID_IRQ is on INT0 */
 #endif
+#define RFID_IRQ_PORT		PORTD	/* IRQ pin of the MFRC522 is on INT0 */
+#define RFID_IRQ_DDR		DDRD
+#define RFID_IRQ			PD2
 
 
 #ifdef NEW_PROTOTYPE
@@ -20,6 +20,7 @@
  */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 
 #include "main.h"
@@ -27,60 +28,607 @@
 #include "uart.h"
 #include "rfid.h"
 #include "user.h"
+#include "timer.h"
 
 const char PROGMEM scan_picc_msg[] = "Scan PICC to see UID and type...\r\n";
 
+static uint8_t open_sector = RFID_NO_SECTOR; /* sector that is authenticated at the moment */
+static uint8_t tag_selected = FALSE; /* a tag is selected and has to be halted by rfid_close_tag */
+static uint8_t tag_type = RFID_TAG_NONE; /* backend of the selected tag */
+
+#define RFID_TAGS_MAX	8 /* maximum number of tags processed after one poll */
+
+/*
+ * tags are polled with a variable interval: after a tag was found the
+ * interval is RFID_POLL_FAST_MS, after each poll without tag it grows by an
+ * eighth up to RFID_POLL_SLOW_MS. Between two polls the MFRC522 is in soft
+ * power-down, so it draws less current and does not use the spi bus.
+ */
+#define RFID_POLL_FAST_MS	20
+#define RFID_POLL_SLOW_MS	400
+#define RFID_WAKEUP_MS		5 /* time for oscillator start and for the tags to power up in the field */
+#define RFID_STATS_PERIOD_MS	3600000UL /* one hour */
+
+#define RFID_STATE_POWER_DOWN	0 /* MFRC522 sleeps until next poll */
+#define RFID_STATE_WAKEUP		1 /* waiting for MFRC522 to leave power down */
+#define RFID_STATE_REQUEST		2 /* waiting for the answer to a request */
+
+static uint8_t rfid_state = RFID_STATE_POWER_DOWN;
+static uint16_t poll_interval = RFID_POLL_FAST_MS;
+static struct timer poll_timer; /* poll interval and wakeup time */
+static uint8_t poll_due = FALSE; /* set by poll_timer */
+
+static uint32_t stats_start;
+static uint16_t polls;				/* polls in the running hour */
+static uint16_t polls_found;		/* polls in the running hour that found a tag */
+static uint16_t polls_last;			/* polls in the last complete hour */
+static uint16_t polls_found_last;	/* polls in the last complete hour that found a tag */
+
+/*
+ * every authentication, read and write is counted with its result. The
+ * errors of the last RFID_GAIN_WINDOW operations decide about the receiver
+ * gain: if there were errors the gain is changed by one step, if the errors
+ * got more with the last step the direction is reversed. Without errors the
+ * gain is kept.
+ */
+#define RFID_OP_AUTH		0
+#define RFID_OP_READ		1
+#define RFID_OP_WRITE		2
+#define RFID_OP_MAX			2
+
+#define RFID_ERR_CRC		0
+#define RFID_ERR_TIMEOUT	1
+#define RFID_ERR_NAK		2
+#define RFID_ERR_OTHER		3
+#define RFID_ERR_MAX		3
+
+static uint16_t op_count[RFID_OP_MAX + 1];
+static uint16_t op_errors[RFID_OP_MAX + 1][RFID_ERR_MAX + 1];
+
+#define RFID_GAIN_WINDOW	32 /* operations after which the gain is adapted */
+#define RFID_GAIN_NUMBER	6
+#define RFID_GAIN_DEFAULT	2 /* 33 dB, default after reset of the MFRC522 */
+
+/* 010b and 011b are duplicates of 000b and 001b and are left out */
+static const uint8_t gains[RFID_GAIN_NUMBER] = {RxGain_18dB, RxGain_23dB, RxGain_33dB, RxGain_38dB, RxGain_43dB, RxGain_48dB};
+static const uint8_t gains_db[RFID_GAIN_NUMBER] = {18, 23, 33, 38, 43, 48};
+
+static uint8_t gain_index = RFID_GAIN_DEFAULT;
+static int8_t gain_step = 1;
+static uint8_t gain_changes;
+static uint8_t window_ops;
+static uint8_t window_errors;
+static uint8_t window_errors_last = 0xff; /* first step goes up */
+
+const char PROGMEM polls_msg[] = "Polls last hour: ";
+const char PROGMEM polls_current_msg[] = "Polls this hour: ";
+const char PROGMEM polls_found_msg[] = " with tag: ";
+const char PROGMEM poll_interval_msg[] = "Poll interval: ";
+const char PROGMEM ms_msg[] = " ms";
+const char PROGMEM gain_msg[] = "Rx gain: ";
+const char PROGMEM gain_changes_msg[] = " dB changes: ";
+const char PROGMEM op_auth_msg[] = "Auth: ";
+const char PROGMEM op_read_msg[] = "Read: ";
+const char PROGMEM op_write_msg[] = "Write: ";
+const PGM_P const op_msg[RFID_OP_MAX + 1] = {
+	op_auth_msg,
+	op_read_msg,
+	op_write_msg
+};
+const char PROGMEM op_errors_msg[] = " crc/timeout/nak/other: ";
+
+#ifdef DEBUG_RFID_TIMING
+static uint8_t authentications;
+#endif
+
+#ifdef DEBUG_RFID_BENCHMARK
+#define RFID_BENCHMARK_RUNS		4 /* RFID_BENCHMARK_RUNS * RFID_BLOCK_SIZE must fit into the fifo */
+#define RFID_BENCHMARK_NUMBER	5
+
+const char PROGMEM benchmark_msg[] = "rfid benchmark ";
+const char PROGMEM benchmark_cycles_msg[] = " cycles";
+const char PROGMEM benchmark_read_register[] = "PCD_ReadRegister_one: ";
+const char PROGMEM benchmark_write_register[] = "PCD_WriteRegister: ";
+const char PROGMEM benchmark_write_fifo[] = "fifo write 16 bytes: ";
+const char PROGMEM benchmark_read_fifo[] = "fifo read 16 bytes: ";
+const char PROGMEM benchmark_read_list[] = "PCD_ReadRegisterList 2 registers: ";
+
+const PGM_P const benchmark_names[RFID_BENCHMARK_NUMBER] =	{
+	benchmark_read_register,
+	benchmark_write_register,
+	benchmark_write_fifo,
+	benchmark_read_fifo,
+	benchmark_read_list,
+};
+
+static uint16_t benchmark_cycles[RFID_BENCHMARK_NUMBER];
+static uint8_t benchmark_printed = FALSE;
+
+#define RFID_BENCHMARK(index, call)	\
+	TCNT1 = 0;	\
+	for (j = 0; j < RFID_BENCHMARK_RUNS; j++)	{	\
+		call;	\
+	}	\
+	benchmark_cycles[index] = TCNT1 / RFID_BENCHMARK_RUNS;
+#endif
+
+/*
+ * internal functions
+ */
+
+/**
+ * rfid_poll_due - callback of poll_timer, lets rfid_loop continue
+ */
+static void rfid_poll_due(void)
+{
+	poll_due = TRUE;
+}
+
+/**
+ * rfid_count_poll - update statistics and poll interval after a poll
+ * @found:	TRUE if the poll found a tag, FALSE otherwise
+ */
+static void rfid_count_poll(uint8_t found)
+{
+	uint32_t now = main_get_time_ms();
+	if (now - stats_start >= RFID_STATS_PERIOD_MS)	{
+		polls_last = polls;
+		polls_found_last = polls_found;
+		polls = 0;
+		polls_found = 0;
+		stats_start = now;
+	}
+	polls++;
+
+	if (found == TRUE)	{
+		polls_found++;
+		poll_interval = RFID_POLL_FAST_MS;
+	} else {
+		poll_interval += poll_interval / 8 + 1;
+		if (poll_interval > RFID_POLL_SLOW_MS)	{
+			poll_interval = RFID_POLL_SLOW_MS;
+		}
+	}
+}
+
+/**
+ * rfid_adapt_gain - change the receiver gain after a window of operations
+ */
+static void rfid_adapt_gain(void)
+{
+	if (window_errors > 0)	{
+		if (window_errors > window_errors_last)	{
+			gain_step = -gain_step; /* last step made it worse */
+		}
+		if ((gain_step < 0 && gain_index == 0) ||
+				(gain_step > 0 && gain_index == RFID_GAIN_NUMBER - 1))	{
+			gain_step = -gain_step;
+		}
+		gain_index += gain_step;
+		PCD_SetAntennaGain(gains[gain_index]);
+		gain_changes++;
+	}
+	window_errors_last = window_errors;
+	window_ops = 0;
+	window_errors = 0;
+}
+
+/**
+ * rfid_count_result - count the result of an operation with the tag
+ * @op:		RFID_OP_AUTH, RFID_OP_READ or RFID_OP_WRITE
+ * @ret:	the STATUS_??? returned by the operation
+ *
+ *		Return: ret
+ */
+static uint8_t rfid_count_result(uint8_t op, uint8_t ret)
+{
+	op_count[op]++;
+	if (ret != STATUS_OK)	{
+		uint8_t err = RFID_ERR_OTHER;
+		if (ret == STATUS_CRC_WRONG)	{
+			err = RFID_ERR_CRC;
+		} else if (ret == STATUS_TIMEOUT)	{
+			err = RFID_ERR_TIMEOUT;
+		} else if (ret == STATUS_MIFARE_NACK)	{
+			err = RFID_ERR_NAK;
+		}
+		op_errors[op][err]++;
+		window_errors++;
+	}
+	window_ops++;
+	if (window_ops >= RFID_GAIN_WINDOW)	{
+		rfid_adapt_gain();
+	}
+	return ret;
+}
+
+/**
+ * rfid_check_ultralight_size - check if the selected ultralight tag is big enough
+ *
+ *		Return: TRUE if the user memory has at least RFID_ULTRALIGHT_BLOCKS
+ *		blocks, FALSE if it is smaller or the capability container can not
+ *		be read
+ */
+static uint8_t rfid_check_ultralight_size(void)
+{
+	uint8_t buffer[RFID_BLOCK_SIZE + 2];
+	uint8_t length = sizeof(buffer);
+
+	if (rfid_count_result(RFID_OP_READ, MIFARE_Read(RFID_CC_PAGE, buffer, &length)) != STATUS_OK)	{
+		return FALSE;
+	}
+	if ((uint16_t)buffer[RFID_CC_SIZE] * 8 < RFID_ULTRALIGHT_BLOCKS * RFID_BLOCK_SIZE)	{
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * rfid_select_tag - select a tag and choose the backend for it
+ *
+ *		Runs the anticollision and selects one of the tags that answered the
+ *		last request. The backend for rfid_read_block and rfid_write_block is
+ *		chosen from the SAK of the tag: MIFARE Classic tags are read with
+ *		crypto1 authentication, MIFARE Ultralight and NTAG21x tags page by
+ *		page without authentication. Other tags get RFID_TAG_NONE.
+ *
+ *		MIFARE Ultralight and NTAG21x tags all have SAK 0x00, so the size of
+ *		the user memory is read from the capability container. Tags with
+ *		less than RFID_ULTRALIGHT_BLOCKS blocks get RFID_TAG_NONE, because
+ *		writing behind their user memory could lock the tag.
+ *
+ *		Return: TRUE if a tag was selected, FALSE otherwise
+ */
+static uint8_t rfid_select_tag(void)
+{
+	tag_type = RFID_TAG_NONE;
+	if (!PICC_ReadCardSerial())	{
+		return FALSE;
+	}
+	tag_selected = TRUE;
+	switch (PICC_GetType(uid.sak))	{
+	case PICC_TYPE_MIFARE_MINI:
+	case PICC_TYPE_MIFARE_1K:
+	case PICC_TYPE_MIFARE_4K:
+		tag_type = RFID_TAG_CLASSIC;
+		break;
+	case PICC_TYPE_MIFARE_UL:
+		if (rfid_check_ultralight_size() == TRUE)	{
+			tag_type = RFID_TAG_ULTRALIGHT;
+		}
+		break;
+	default:
+		break;
+	}
+	return TRUE;
+}
+
+/**
+ * rfid_process_tags - process all tags in the field
+ *
+ *		Has to be called after a request was answered. The anticollision of
+ *		PICC_ReadCardSerial selects one of the tags in the field, which is
+ *		processed by the user module and halted by rfid_close_tag. Halted
+ *		tags do not answer further requests, so the next request only wakes
+ *		up the tags that are not processed yet. This is repeated until no
+ *		tag answers any more, so several runners can punch at the same time.
+ *
+ *		Return: number of processed tags
+ */
+static uint8_t rfid_process_tags(void)
+{
+	uint8_t tags = 0;
+#ifdef DEBUG_RFID_TIMING
+	authentications = 0;
+	uint32_t start = main_get_time_ms();
+#endif
+
+	do {
+		if (rfid_select_tag() != TRUE)	{
+			break;
+		}
+		/* successfully recognised new tag */
+		if (tag_type != RFID_TAG_NONE)	{
+			user_new_tag();
+		}
+		rfid_close_tag(); /* user_new_tag might have returned without closing the tag */
+		tags++;
+	} while (tags < RFID_TAGS_MAX && PICC_IsNewCardPresent());
+
+#ifdef DEBUG_RFID_TIMING
+	uint32_t duration = main_get_time_ms() - start;
+	uart_send_text_sram("rfid time: ");
+	uart_send_int(duration);
+	uart_send_text_sram(" ms authentications: ");
+	uart_send_int(authentications);
+	uart_send_text_sram(" tags: ");
+	uart_send_int(tags);
+	if (duration > 0)	{
+		uart_send_text_sram(" tags/s: ");
+		uart_send_int(tags * 1000UL / duration);
+	}
+	UART_NEWLINE();
+#endif
+	return tags;
+}
+
+#ifdef DEBUG_RFID_BENCHMARK
+/**
+ * rfid_benchmark - measure cpu cycles of the often used functions of the MFRC522 driver
+ *
+ *		Timer1 counts cpu cycles during the measurement and is restored
+ *		afterwards. Has to be called before the interrupts are enabled, so
+ *		that no interrupt is measured as well. The results are sent by the
+ *		first call of rfid_loop.
+ */
+static void rfid_benchmark(void)
+{
+	static const uint8_t regs[2] = {ErrorReg, FIFOLevelReg};
+	uint8_t buffer[RFID_BLOCK_SIZE] = {0};
+	uint8_t values[2];
+	uint8_t tccr1b = TCCR1B;
+	uint8_t timsk1 = TIMSK1;
+	uint8_t j;
+
+	TIMSK1 &= ~(1 << OCIE1A);
+	TCCR1B = (1 << CS10); /* normal mode without prescaler, timer1 counts cpu cycles */
+
+	RFID_BENCHMARK(0, PCD_ReadRegister_one(VersionReg));
+	RFID_BENCHMARK(1, PCD_WriteRegister(TReloadRegL, 0xE8)); /* same value as in PCD_Init */
+	PCD_WriteRegister(FIFOLevelReg, 0x80); /* flush fifo */
+	RFID_BENCHMARK(2, PCD_WriteRegister_pointer(FIFODataReg, RFID_BLOCK_SIZE, buffer));
+	RFID_BENCHMARK(3, PCD_ReadRegister(FIFODataReg, RFID_BLOCK_SIZE, buffer, 0));
+	RFID_BENCHMARK(4, PCD_ReadRegisterList(2, regs, values));
+	PCD_WriteRegister(FIFOLevelReg, 0x80);
+
+	TCCR1B = tccr1b;
+	TCNT1 = 0;
+	TIFR1 = (1 << OCF1A) | (1 << TOV1);
+	TIMSK1 = timsk1;
+}
+
+/**
+ * rfid_benchmark_print - send the results of rfid_benchmark over uart
+ */
+static void rfid_benchmark_print(void)
+{
+	uint8_t i;
+	for (i = 0; i < RFID_BENCHMARK_NUMBER; i++)	{
+		uart_send_text_flash((uint16_t)benchmark_msg);
+		uart_send_text_flash((uint16_t)benchmark_names[i]);
+		uart_send_int(benchmark_cycles[i]);
+		uart_send_text_flash((uint16_t)benchmark_cycles_msg);
+		UART_NEWLINE();
+	}
+}
+#endif
+
+/*
+ * public functions
+ */
+
 /**
  * rfid_init - initialise rfid module
  */
 void rfid_init(void)
 {
+	RFID_IRQ_DDR &= ~(1 << RFID_IRQ);
+	RFID_IRQ_PORT |= (1 << RFID_IRQ); /* pull up while MFRC522 is in reset */
+	EICRA |= (1 << ISC01); /* falling edge at int0 causes an interrupt */
+	EICRA &= ~(1 << ISC00);
+	EIFR = (1 << INTF0);
+	EIMSK |= (1 << INT0);
+
 	SPI_begin(); /* Init SPI bus */
 	MFRC522_init(SS_PIN, RST_PIN); /* prepare output pins */
 	PCD_Init();	/* Init MFRC522 card */
+	PCD_SetAntennaGain(gains[gain_index]);
+
+#ifdef DEBUG_RFID_BENCHMARK
+	rfid_benchmark();
+#endif
+
+	PCD_SoftPowerDown();
+	timer_start(&poll_timer, poll_interval, 0, rfid_poll_due);
+	stats_start = main_get_time_ms();
+}
+
+/**
+ * rfid_ready - check whether rfid_loop has work to do
+ *
+ *		Return: TRUE if the poll interval or the wakeup time has elapsed or
+ *		a request is running, FALSE otherwise
+ */
+uint8_t rfid_ready(void)
+{
+	return (poll_due == TRUE || rfid_state == RFID_STATE_REQUEST) ? TRUE : FALSE;
 }
 
 /**
  * rfid_loop - function gets call by main loop and checks for new transponders
  *
+ *		The function does not wait for the MFRC522. It wakes the MFRC522 up
+ *		when the poll interval elapsed, sends a request to the tags in the
+ *		field and returns. The following calls return immediately until the
+ *		MFRC522 signals the end of the request with its IRQ pin. So the main
+ *		loop keeps running during the request, which takes the whole MFRC522
+ *		timeout if there is no tag. After the request the MFRC522 is put into
+ *		soft power-down again.
+ *
  *		If a new transponder is found a function in the user-software-module
  *		is called to communicate with the tag.
  */
 void rfid_loop()
 {
-	if (PICC_IsNewCardPresent())	{
-		if (PICC_ReadCardSerial())	{
-			/* successfully recognised new tag */
-			//DN("tag");
-			user_new_tag();
+	uint8_t atqa[2];
+	uint8_t atqa_size = sizeof(atqa);
+	uint8_t found = FALSE;
+	uint8_t ret;
+
+#ifdef DEBUG_RFID_BENCHMARK
+	if (benchmark_printed == FALSE)	{
+		rfid_benchmark_print();
+		benchmark_printed = TRUE;
+	}
+#endif
+
+	if (rfid_state == RFID_STATE_POWER_DOWN)	{
+		if (poll_due == FALSE)	{
+			return;
 		}
+		poll_due = FALSE;
+		PCD_SoftPowerUp();
+		timer_start(&poll_timer, RFID_WAKEUP_MS, 0, rfid_poll_due);
+		rfid_state = RFID_STATE_WAKEUP;
+		return;
+	}
+
+	if (rfid_state == RFID_STATE_WAKEUP)	{
+		if (poll_due == FALSE || PCD_IsPoweredUp() == FALSE)	{
+			return;
+		}
+		poll_due = FALSE;
+		PICC_StartRequestA();
+		rfid_state = RFID_STATE_REQUEST;
+		return;
+	}
+
+	ret = PICC_PollRequestA(atqa, &atqa_size);
+	if (ret == STATUS_BUSY)	{
+		return;
+	}
+
+	if (ret == STATUS_OK || ret == STATUS_COLLISION)	{
+		found = TRUE;
+		rfid_process_tags();
 	}
 	rfid_close_tag(); /* to make sure that communication is close */
+
+	rfid_count_poll(found);
+	PCD_SoftPowerDown();
+	timer_start(&poll_timer, poll_interval, 0, rfid_poll_due);
+	rfid_state = RFID_STATE_POWER_DOWN;
+}
+
+/**
+ * rfid_print_stats - output statistics of tag polling to uart
+ *
+ *		Outputs how many polls were done and how many of them found a tag
+ *		in the last complete hour and in the running hour, and the current
+ *		poll interval.
+ */
+void rfid_print_stats(void)
+{
+	uart_send_text_flash((uint16_t)polls_msg);
+	uart_send_int(polls_last);
+	uart_send_text_flash((uint16_t)polls_found_msg);
+	uart_send_int(polls_found_last);
+	UART_NEWLINE();
+	uart_send_text_flash((uint16_t)polls_current_msg);
+	uart_send_int(polls);
+	uart_send_text_flash((uint16_t)polls_found_msg);
+	uart_send_int(polls_found);
+	UART_NEWLINE();
+	uart_send_text_flash((uint16_t)poll_interval_msg);
+	uart_send_int(poll_interval);
+	uart_send_text_flash((uint16_t)ms_msg);
+	UART_NEWLINE();
+	uart_send_text_flash((uint16_t)gain_msg);
+	uart_send_int(gains_db[gain_index]);
+	uart_send_text_flash((uint16_t)gain_changes_msg);
+	uart_send_int(gain_changes);
+	UART_NEWLINE();
+	uint8_t i, j;
+	for (i = 0; i <= RFID_OP_MAX; i++)	{
+		uart_send_text_flash((uint16_t)op_msg[i]);
+		uart_send_int(op_count[i]);
+		uart_send_text_flash((uint16_t)op_errors_msg);
+		for (j = 0; j <= RFID_ERR_MAX; j++)	{
+			if (j > 0)	{
+				uart_send_text_sram("/");
+			}
+			uart_send_int(op_errors[i][j]);
+		}
+		UART_NEWLINE();
+	}
+}
+
+/**
+ * ISR for interrupt on pin INT0
+ *
+ * is executed when the MFRC522 finished a command
+ */
+ISR(INT0_vect)
+{
+	PCD_IrqHandler();
+}
+
+/**
+ * rfid_open_sector - authenticate at a sector of the tag
+ * @sector:	number of sector between 0 and 15
+ *
+ *		After authentication all blocks inside this sector can be read and
+ *		written without further authentication. If the sector is already
+ *		authenticated the function returns immediately, so rfid_read_block and
+ *		rfid_write_block authenticate only once for all blocks of one sector.
+ *		The authentication is valid until another sector is opened or
+ *		rfid_close_tag is called.
+ *
+ *		Return: STATUS_OK on success and STATUS_??? error code on failure
+ */
+uint8_t rfid_open_sector(uint8_t sector)
+{
+	uint8_t ret;
+	uint8_t i;
+	MIFARE_Key key;
+
+	if (sector == open_sector || tag_type == RFID_TAG_ULTRALIGHT)	{
+		return STATUS_OK; /* ultralight tags have no sectors and no crypto */
+	}
+	for (i = 0; i < 6; i++)	{
+		key.keyByte[i] = 0xFF; /* standard key 0x FF FF FF FF FF FF */
+	}
+#ifdef DEBUG_RFID_TIMING
+	authentications++;
+#endif
+	ret = rfid_count_result(RFID_OP_AUTH,
+			PCD_Authenticate(PICC_CMD_MF_AUTH_KEY_A, RFID_SECTOR_TRAILER(sector), &key, &(uid)));
+	if (ret != STATUS_OK)	{
+		open_sector = RFID_NO_SECTOR;
+		return ret;
+	}
+	open_sector = sector;
+	return STATUS_OK;
 }
 
 /**
  * rfid_read_block - read and return a block from rfid tag
- * @block:	number of block between 0 and 15
+ * @block:	number of block between 0 and 63
  * @buff:	pointer to buffer where the block will be stored
  *			the first 16 bytes of the buffer are the 16 bytes of the block
  *			the last second bytes in buffer are checksum
  * @length:	pointer to byte with length of buffer in bytes (should be 18)
  *			bytes read are stored in this variable
  *
+ *		On MIFARE Classic tags the sector of the block is authenticated with
+ *		rfid_open_sector if it is not already open. On Ultralight tags the
+ *		block is made of the RFID_PAGES_PER_BLOCK pages from RFID_ULTRALIGHT_PAGE(block),
+ *		which are read with one command.
+ *
  *		Return: STATUS_OK on success and STATUS_??? error code on failure
  */
 uint8_t rfid_read_block(uint8_t block, uint8_t *buffer, uint8_t *length)	{
-	uint8_t ret;
-	uint8_t i;
-	MIFARE_Key key;
-	for (i = 0; i < 6; i++)	{
-		key.keyByte[i] = 0xFF; /* standard key 0x FF FF FF FF FF FF */
+	if (tag_type == RFID_TAG_ULTRALIGHT)	{
+		return rfid_count_result(RFID_OP_READ, MIFARE_Read(RFID_ULTRALIGHT_PAGE(block), buffer, length));
 	}
-	ret = PCD_Authenticate(PICC_CMD_MF_AUTH_KEY_A, block, &key, &(uid));
+	uint8_t ret = rfid_open_sector(RFID_SECTOR(block));
 	if (ret != STATUS_OK)	{
 		return ret;
 	}
-	ret = MIFARE_Read(block, buffer, length);
+	ret = rfid_count_result(RFID_OP_READ, MIFARE_Read(block, buffer, length));
+	if (ret != STATUS_OK)	{
+		open_sector = RFID_NO_SECTOR; /* tag drops authentication on error */
+	}
 	return ret;
 }
 
@@ -90,29 +638,62 @@ uint8_t rfid_read_block(uint8_t block, uint8_t *buffer, uint8_t *length)	{
  * @buffer: pointer to buffer where the data to write is stored
  * @length:	length of buffer (should be 16)
  *
+ *		On MIFARE Classic tags the sector of the block is authenticated with
+ *		rfid_open_sector if it is not already open. On Ultralight tags the
+ *		block is written page by page, because the compatibility write only
+ *		stores the first page.
+ *
  *		Return: STATUS_OK on success and STATUS_??? error code on failure
  */
 uint8_t rfid_write_block(uint8_t block, uint8_t *buffer, uint8_t length)	{
-	uint8_t i;
-	MIFARE_Key key;
-	for (i = 0; i < 6; i++)	{
-		key.keyByte[i] = 0xFF; /* standard key 0x FF FF FF FF FF FF */
+	if (tag_type == RFID_TAG_ULTRALIGHT)	{
+		uint8_t i;
+		if (length < RFID_BLOCK_SIZE)	{
+			return STATUS_INVALID;
+		}
+		for (i = 0; i < RFID_PAGES_PER_BLOCK; i++)	{
+			uint8_t ret = rfid_count_result(RFID_OP_WRITE, MIFARE_Ultralight_Write(
+					RFID_ULTRALIGHT_PAGE(block) + i, buffer + i * RFID_PAGE_SIZE, RFID_PAGE_SIZE));
+			if (ret != STATUS_OK)	{
+				return ret;
+			}
+		}
+		return STATUS_OK;
 	}
-	uint8_t ret = PCD_Authenticate(PICC_CMD_MF_AUTH_KEY_A, block, &key, &(uid));
+	uint8_t ret = rfid_open_sector(RFID_SECTOR(block));
 	if (ret != STATUS_OK)	{
 		return ret;
 	}
-	ret = MIFARE_Write(block, buffer, length);
+	ret = rfid_count_result(RFID_OP_WRITE, MIFARE_Write(block, buffer, length));
+	if (ret != STATUS_OK)	{
+		open_sector = RFID_NO_SECTOR; /* tag drops authentication on error */
+	}
 	return ret;
 }
 
+/**
+ * rfid_get_tag_type - return the backend of the selected tag
+ *
+ *		Return: RFID_TAG_CLASSIC, RFID_TAG_ULTRALIGHT or RFID_TAG_NONE
+ */
+uint8_t rfid_get_tag_type(void)
+{
+	return tag_type;
+}
+
 /*
- * rfid_close_tag - close encrypted connection to tag
+ * rfid_close_tag - halt tag and close encrypted connection to tag
  *
  *		If programme authenticated at the tag this function must
  *		to be called before programme is able to communicate with another
- *		tag
+ *		tag. The selected tag is halted before (the halt command has to be
+ *		encrypted), so that it does not answer until it leaves the field.
  */
 void rfid_close_tag(void)	{
+	if (tag_selected == TRUE)	{
+		PICC_HaltA();
+		tag_selected = FALSE;
+	}
 	PCD_StopCrypto1();
+	open_sector = RFID_NO_SECTOR;
 }
@@ -24,13 +24,44 @@
 #include "MFRC522.h"
 
 #define RFID_BLOCK_SIZE	16
+#define RFID_BLOCKS_PER_SECTOR	4
+#define RFID_SECTOR(block)		((block) / RFID_BLOCKS_PER_SECTOR)
+#define RFID_SECTOR_TRAILER(sector)	((sector) * RFID_BLOCKS_PER_SECTOR + RFID_BLOCKS_PER_SECTOR - 1)
+#define RFID_NO_SECTOR	0xff
+
+/*
+ * MIFARE Ultralight and NTAG21x tags are organised in pages of 4 bytes. The
+ * rfid functions group RFID_PAGES_PER_BLOCK pages to one block, so that the
+ * user module can use the same blocks as for MIFARE Classic tags. Block 0
+ * starts at the first user page.
+ */
+#define RFID_PAGE_SIZE			4
+#define RFID_PAGES_PER_BLOCK	(RFID_BLOCK_SIZE / RFID_PAGE_SIZE)
+#define RFID_ULTRALIGHT_FIRST_PAGE	4
+#define RFID_ULTRALIGHT_PAGE(block)	(RFID_ULTRALIGHT_FIRST_PAGE + (block) * RFID_PAGES_PER_BLOCK)
+/*
+ * blocks the user module needs, tags with a smaller user memory (plain
+ * Ultralight, NTAG213) are not supported because the pages behind their
+ * user memory are lock and configuration pages
+ */
+#define RFID_ULTRALIGHT_BLOCKS		16
+#define RFID_CC_PAGE				3 /* capability container */
+#define RFID_CC_SIZE				2 /* byte with the size of the user memory / 8 */
+
+#define RFID_TAG_NONE			0 /* no tag selected or tag not supported */
+#define RFID_TAG_CLASSIC		1 /* MIFARE Classic, sectors with crypto1 authentication */
+#define RFID_TAG_ULTRALIGHT		2 /* MIFARE Ultralight and NTAG21x, pages without crypto */
 
 void rfid_init(void);
 
 void rfid_loop(void);
+uint8_t rfid_ready(void);
+void rfid_print_stats(void);
 
+uint8_t rfid_open_sector(uint8_t sector);
 uint8_t rfid_read_block(uint8_t block, uint8_t *buff, uint8_t *length);
 uint8_t rfid_write_block(uint8_t block, uint8_t *buff, uint8_t length);
+uint8_t rfid_get_tag_type(void);
 
 void rfid_close_tag(void);
 
@@ -78,19 +78,20 @@
 
 uint8_t interrupt_was_enabled = FALSE;
 volatile uint8_t during_bitmask = FALSE;
+static volatile uint8_t alarm_pending = FALSE; /* set by INT1, see rtc_process_events */
 
 /*
  * internal functions
  */
 
 /**
- * rtc_write_register() - write a register of real time clock
+ * rtc_write_register_try() - one attempt to write a register of real time clock
  * @address:	address of the real time clock register
  * @byte:		byte to write into the register
  *
  * Return: TWI_OK on success, TWI_ERR on error
  **/
-uint8_t rtc_write_register(uint8_t address, uint8_t byte)
+static uint8_t rtc_write_register_try(uint8_t address, uint8_t byte)
 {
 	rtc_disable_avr_interrupt();
 	uint8_t ret = 0;
@@ -106,8 +107,8 @@ uint8_t rtc_write_register(uint8_t address, uint8_t byte)
 	ret |= twi_send_byte(byte);
 	if (ret != TWI_OK)
 		goto rtc_write_register_exit;
-	twi_stop();
 rtc_write_register_exit:
+	twi_stop();
 	if (during_bitmask == FALSE)	{
 		rtc_enable_avr_interrupt();
 	}
@@ -115,14 +116,14 @@ rtc_write_register_exit:
 }
 
 /**
- * rtc_read_register() - read a register of realt time clock
+ * rtc_read_register_try() - one attempt to read a register of realt time clock
  *
  * @address:	address of realt time clock register
  * @byte:		pointer to address where the read byte will be stored in
  *
  * Return: TWI_OK on success, TWI_ERR on error
  */
-uint8_t rtc_read_register(uint8_t address, uint8_t* byte)
+static uint8_t rtc_read_register_try(uint8_t address, uint8_t* byte)
 {
 	rtc_disable_avr_interrupt();
 	uint8_t ret = 0;
@@ -142,14 +143,129 @@ uint8_t rtc_read_register(uint8_t address, uint8_t* byte)
 	if (ret != TWI_OK)
 		goto rtc_read_register_exit;
 	ret |= twi_read_byte(TWI_NACK, byte);
-	twi_stop();
 rtc_read_register_exit:
+	twi_stop();
+	if (during_bitmask == FALSE)	{
+		rtc_enable_avr_interrupt();
+	}
+	return ret;
+}
+
+/**
+ * rtc_write_register() - write a register of real time clock
+ * @address:	address of the real time clock register
+ * @byte:		byte to write into the register
+ *
+ *		The access is repeated up to TWI_TRIES times
+ *
+ * Return: TWI_OK on success, TWI_ERR on error
+ **/
+uint8_t rtc_write_register(uint8_t address, uint8_t byte)
+{
+	uint8_t ret = TWI_ERR, i;
+	for (i = 0; i < TWI_TRIES; i++)	{
+		if (i > 0)	{
+			twi_count_retry();
+		}
+		ret = rtc_write_register_try(address, byte);
+		if (ret == TWI_OK)	{
+			break;
+		}
+	}
+	return ret;
+}
+
+/**
+ * rtc_read_register() - read a register of realt time clock
+ *
+ * @address:	address of realt time clock register
+ * @byte:		pointer to address where the read byte will be stored in
+ *
+ *		The access is repeated up to TWI_TRIES times
+ *
+ * Return: TWI_OK on success, TWI_ERR on error
+ */
+uint8_t rtc_read_register(uint8_t address, uint8_t* byte)
+{
+	uint8_t ret = TWI_ERR, i;
+	for (i = 0; i < TWI_TRIES; i++)	{
+		if (i > 0)	{
+			twi_count_retry();
+		}
+		ret = rtc_read_register_try(address, byte);
+		if (ret == TWI_OK)	{
+			break;
+		}
+	}
+	return ret;
+}
+
+/**
+ * rtc_read_registers_try - one attempt to read consecutive registers
+ * @address:	address of the first rtc register
+ * @data:		buffer where the register values are stored
+ * @number:		number of registers to read (at least one)
+ *
+ * Return: TWI_OK on success, TWI_ERR on error
+ */
+static uint8_t rtc_read_registers_try(uint8_t address, uint8_t *data, uint8_t number)
+{
+	rtc_disable_avr_interrupt();
+	uint8_t ret = 0, i;
+	ret |= twi_start();
+	if (ret != TWI_OK)
+		goto rtc_read_registers_exit;
+	ret |= twi_send_slave_address(TWI_WRITE, RTC_ADDRESS);
+	if (ret != TWI_OK)
+		goto rtc_read_registers_exit;
+	ret |= twi_send_byte(address);
+	if (ret != TWI_OK)
+		goto rtc_read_registers_exit;
+	ret |= twi_start();
+	if (ret != TWI_OK)
+		goto rtc_read_registers_exit;
+	ret |= twi_send_slave_address(TWI_READ, RTC_ADDRESS);
+	if (ret != TWI_OK)
+		goto rtc_read_registers_exit;
+	for (i = 0; i < (number - 1); i++)	{
+		ret |= twi_read_byte(TWI_ACK, &data[i]);
+		if (ret != TWI_OK)
+			goto rtc_read_registers_exit;
+	}
+	ret |= twi_read_byte(TWI_NACK, &data[number - 1]);
+rtc_read_registers_exit:
+	twi_stop();
 	if (during_bitmask == FALSE)	{
 		rtc_enable_avr_interrupt();
 	}
 	return ret;
 }
 
+/**
+ * rtc_read_registers() - read consecutive registers in one transaction
+ * @address:	address of the first rtc register
+ * @data:		buffer where the register values are stored
+ * @number:		number of registers to read (at least one)
+ *
+ *		The access is repeated up to TWI_TRIES times
+ *
+ * Return: TWI_OK on success, TWI_ERR on error
+ */
+static uint8_t rtc_read_registers(uint8_t address, uint8_t *data, uint8_t number)
+{
+	uint8_t ret = TWI_ERR, i;
+	for (i = 0; i < TWI_TRIES; i++)	{
+		if (i > 0)	{
+			twi_count_retry();
+		}
+		ret = rtc_read_registers_try(address, data, number);
+		if (ret == TWI_OK)	{
+			break;
+		}
+	}
+	return ret;
+}
+
 /**
  * rtc_set_bitmask - set a bit in a register of the rtc chip
  * @address:	address of the rtc register
@@ -718,10 +834,14 @@ uint8_t rtc_disable_alarm1()
  * @type: time type to be set (like RTC_SECOND, RTC_HOUR, ...)
  * @val: the value to set
  *
+ *		The startup module is marked to be reloaded because the current
+ *		transmit window depends on the time.
+ *
  *		Return: TWI_OK on success, TWI_ERR on failure
  */
 uint8_t rtc_set_time(uint8_t type, uint8_t val)
 {
+	main_mark_dirty(MAIN_RELOAD_STARTUP);
 	return rtc_set_time_internal(type, 0, val);
 }
 
@@ -737,6 +857,33 @@ uint8_t rtc_get_time(uint8_t type, uint8_t *val)
 	return rtc_get_time_internal(type, 0, val);
 }
 
+/**
+ * rtc_get_time_all - read time and date with one burst read
+ * @time:	array with RTC_TIME_MAX + 1 elements, the values are stored at
+ *			the indices RTC_SECOND, RTC_MINUTE, ...
+ *
+ *		All values belong to the same second, which is not guaranteed if
+ *		they are read with rtc_get_time() one after the other
+ *
+ *		Return: TWI_OK on success, TWI_ERR on failure
+ */
+uint8_t rtc_get_time_all(uint8_t *time)
+{
+	uint8_t reg[RTC_RTCYEAR + 1];
+	uint8_t ret = rtc_read_registers(RTC_RTCSEC, reg, sizeof(reg));
+	if (ret != TWI_OK)	{
+		return ret;
+	}
+	time[RTC_SECOND] = ((reg[RTC_RTCSEC] >> 4) & 0b111) * 10 + (reg[RTC_RTCSEC] & 0b1111);
+	time[RTC_MINUTE] = ((reg[RTC_RTCMIN] >> 4) & 0b111) * 10 + (reg[RTC_RTCMIN] & 0b1111);
+	time[RTC_HOUR] = ((reg[RTC_RTCHOUR] >> 4) & 0b11) * 10 + (reg[RTC_RTCHOUR] & 0b1111);
+	time[RTC_WEEKDAY] = reg[RTC_RTCWKDAY] & 0b111;
+	time[RTC_DATE] = ((reg[RTC_RTCDATE] >> 4) & 0b11) * 10 + (reg[RTC_RTCDATE] & 0b1111);
+	time[RTC_MONTH] = ((reg[RTC_RTCMONTH] >> 4) & 0b1) * 10 + (reg[RTC_RTCMONTH] & 0b1111);
+	time[RTC_YEAR] = (reg[RTC_RTCYEAR] >> 4) * 10 + (reg[RTC_RTCYEAR] & 0b1111);
+	return ret;
+}
+
 /**
  * rtc_set_alarm0_time - set time for alarm0
  * @type: time type to be set (RTC_SECOND, RTC_HOUR, ...)
@@ -835,15 +982,30 @@ void rtc_disable_avr_interrupt()
 }
 
 /**
- * ISR for interrupt on pin INT1
+ * rtc_event_pending - check whether an rtc alarm has to be handled
  *
- * is executed when rtc interrupt occurs
+ *		Return: TRUE if INT1 occured since the last rtc_process_events(),
+ *		FALSE otherwise
  */
-ISR(INT1_vect)
+uint8_t rtc_event_pending(void)
 {
-#ifdef ISR_LED
-	LED_ON();
-#endif
+	return alarm_pending;
+}
+
+/**
+ * rtc_process_events - handle a pending rtc alarm
+ *
+ *		Called as task from the scheduler. Reads the interrupt flags of both alarms,
+ *		executes startup_interrupt() and morse_interrupt() and clears the
+ *		flags. The i2c transactions are executed with global interrupts
+ *		enabled, so keying and modulation are not delayed.
+ */
+void rtc_process_events(void)
+{
+	if (alarm_pending == FALSE)	{
+		return;
+	}
+	alarm_pending = FALSE;
 
 	uint8_t flag, ret;
 	ret = rtc_get_alarm0_interrupt_flag(&flag);
@@ -856,6 +1018,20 @@ ISR(INT1_vect)
 	}
 	rtc_clear_alarm0_interrupt_flag();
 	rtc_clear_alarm1_interrupt_flag();
+}
+
+/**
+ * ISR for interrupt on pin INT1
+ *
+ * is executed when rtc interrupt occurs, the alarm is handled by
+ * rtc_process_events() from the main loop
+ */
+ISR(INT1_vect)
+{
+#ifdef ISR_LED
+	LED_ON();
+#endif
+	alarm_pending = TRUE;
 #ifdef ISR_LED
 	LED_OFF();
 #endif
@@ -48,9 +48,14 @@
 void rtc_init(void);
 void rtc_show_configuration(void);
 void rtc_load_configuration(void);
+uint8_t rtc_event_pending(void);
+void rtc_process_events(void);
 
 uint8_t rtc_set_time(uint8_t type, uint8_t val);
 uint8_t rtc_get_time(uint8_t type, uint8_t *val);
+uint8_t rtc_get_time_all(uint8_t *time);
+uint32_t rtc_time_to_seconds(const uint8_t *time);
+void rtc_seconds_to_time(uint32_t seconds, uint8_t *time);
 
 uint8_t rtc_set_alarm0_time(uint8_t type, uint8_t val);
 uint8_t rtc_get_alarm0_time(uint8_t type, uint8_t *val);
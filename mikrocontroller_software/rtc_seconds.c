@@ -0,0 +1,116 @@
+/*
+ *  rtc_seconds.c - conversion between rtc time and seconds since 2000
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include "rtc.h"
+
+/*
+ * The conversion does not access the rtc, so it is kept apart from rtc.c
+ * and can be tested on the host (see test/rtc_seconds_test.c)
+ */
+
+/* days of the year before the first day of each month (no leap year) */
+static const uint16_t days_before_month[12] = {
+	0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+/*
+ * public functions
+ */
+
+/**
+ * rtc_time_to_seconds - convert time and date to seconds since 2000-01-01 00:00:00
+ * @time:	array indexed with RTC_SECOND ... RTC_YEAR (weekday is not used),
+ *			year 0 to 99 means 2000 to 2099
+ *
+ *		Return: the seconds since 2000-01-01 00:00:00
+ */
+uint32_t rtc_time_to_seconds(const uint8_t *time)
+{
+	uint8_t year = time[RTC_YEAR];
+	uint8_t month = time[RTC_MONTH];
+	uint16_t days;
+
+	if (month < 1 || month > 12)	{
+		month = 1;
+	}
+	/* every fourth year is a leap year between 2000 and 2099 */
+	days = (uint16_t)year * 365 + (year + 3) / 4;
+	days += days_before_month[month - 1];
+	if (month > 2 && (year % 4) == 0)	{
+		days++;
+	}
+	if (time[RTC_DATE] > 0)	{
+		days += time[RTC_DATE] - 1;
+	}
+	return (((uint32_t)days * 24 + time[RTC_HOUR]) * 60 + time[RTC_MINUTE]) * 60
+			+ time[RTC_SECOND];
+}
+
+/**
+ * rtc_seconds_to_time - convert seconds since 2000-01-01 00:00:00 to time and date
+ * @seconds:	the seconds since 2000-01-01 00:00:00
+ * @time:		array indexed with RTC_SECOND ... RTC_WEEKDAY to store the result,
+ *				the weekday is set to 0
+ *
+ *		This is the inverse of rtc_time_to_seconds.
+ */
+void rtc_seconds_to_time(uint32_t seconds, uint8_t *time)
+{
+	uint16_t days = seconds / 86400UL;
+	uint32_t rest = seconds % 86400UL;
+	uint8_t year = 0;
+	uint8_t month = 1;
+	uint16_t year_days;
+
+	time[RTC_HOUR] = rest / 3600;
+	rest %= 3600;
+	time[RTC_MINUTE] = rest / 60;
+	time[RTC_SECOND] = rest % 60;
+
+	for (;;)	{
+		year_days = (year % 4) == 0 ? 366 : 365;
+		if (days < year_days)	{
+			break;
+		}
+		days -= year_days;
+		year++;
+	}
+	while (month < 12)	{
+		uint16_t next = days_before_month[month];
+		if (month >= 2 && (year % 4) == 0)	{
+			next++;
+		}
+		if (days < next)	{
+			break;
+		}
+		month++;
+	}
+	days -= days_before_month[month - 1];
+	if (month > 2 && (year % 4) == 0)	{
+		days--;
+	}
+	time[RTC_DATE] = days + 1;
+	time[RTC_MONTH] = month;
+	time[RTC_YEAR] = year;
+	time[RTC_WEEKDAY] = 0;
+}
@@ -0,0 +1,202 @@
+/*
+ *  scheduler.c - cooperative run-to-completion task scheduler with priorities
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "main.h"
+#include "uart.h"
+#include "scheduler.h"
+
+/*
+ * A task is released when its ready function returns TRUE or when its period
+ * has elapsed (a task without ready function and without period is always
+ * released and runs in the background). Each call of scheduler_run executes
+ * the released task with the lowest priority number, ties are broken by the
+ * earlier release. Tasks always run to completion, so a task should return as
+ * soon as possible.
+ */
+
+struct task	{
+	PGM_P name;
+	void (*run)(void);
+	uint8_t (*ready)(void);
+	uint8_t priority; /* 0 is the most urgent priority */
+	uint16_t period_ms; /* 0: task is only released by ready */
+	uint16_t deadline_ms; /* maximum delay between release and start */
+	uint32_t next_ms; /* next release by period */
+	uint32_t release_ms;
+	uint8_t released;
+
+	/* instrumentation */
+	uint32_t runs;
+	uint32_t runtime_max_us;
+	uint16_t deadline_misses;
+};
+
+static struct task tasks[SCHEDULER_TASKS_MAX];
+static uint8_t tasks_count = 0;
+
+const char PROGMEM runs_msg[] = ": runs ";
+const char PROGMEM runtime_max_msg[] = ", max ";
+const char PROGMEM deadline_misses_msg[] = " us, deadline misses ";
+
+/*
+ * internal functions
+ */
+
+/**
+ * task_release - check whether a task has to run and remember its release time
+ * @task:	the task to check
+ * @now:	current time in milliseconds
+ */
+static void task_release(struct task *task, uint32_t now)
+{
+	if (task->released == TRUE)	{
+		return;
+	}
+	if (task->period_ms != 0 && (int32_t)(now - task->next_ms) >= 0)	{
+		task->released = TRUE;
+		task->release_ms = task->next_ms;
+	} else if (task->ready != 0 && task->ready() == TRUE)	{
+		task->released = TRUE;
+		task->release_ms = now;
+	} else if (task->period_ms == 0 && task->ready == 0)	{
+		task->released = TRUE;
+		task->release_ms = now;
+	}
+}
+
+/**
+ * task_execute - run a released task and update its statistics
+ * @task:	the task to run
+ * @now:	time in milliseconds before the task is started
+ */
+static void task_execute(struct task *task, uint32_t now)
+{
+	if (task->deadline_ms != SCHEDULER_NO_DEADLINE &&
+			(now - task->release_ms) > task->deadline_ms)	{
+		task->deadline_misses++;
+	}
+	task->released = FALSE;
+	if (task->period_ms != 0)	{
+		task->next_ms += task->period_ms;
+		if ((int32_t)(now - task->next_ms) >= 0)	{
+			/* more than one period late -> do not try to catch up */
+			task->next_ms = now + task->period_ms;
+		}
+	}
+
+	uint32_t start = main_get_time_us();
+	task->run();
+	uint32_t runtime = main_get_time_us() - start;
+
+	task->runs++;
+	if (runtime > task->runtime_max_us)	{
+		task->runtime_max_us = runtime;
+	}
+}
+
+/*
+ * public functions
+ */
+
+/**
+ * scheduler_add_task - add a task to the scheduler
+ * @name:			name of the task in flash for the statistics output
+ * @run:			function executed when the task is released
+ * @ready:			function returning TRUE if the task has work to do, may be 0
+ * @priority:		0 is the most urgent priority
+ * @period_ms:		the task is released every period_ms, 0 for no period
+ * @deadline_ms:	maximum delay between release and start before a deadline
+ *					miss is counted, SCHEDULER_NO_DEADLINE for none
+ *
+ *		Return: SCHEDULER_OK on success, SCHEDULER_ERR if there are already
+ *		SCHEDULER_TASKS_MAX tasks
+ */
+uint8_t scheduler_add_task(PGM_P name, void (*run)(void), uint8_t (*ready)(void),
+		uint8_t priority, uint16_t period_ms, uint16_t deadline_ms)
+{
+	if (tasks_count >= SCHEDULER_TASKS_MAX)	{
+		return SCHEDULER_ERR;
+	}
+	struct task *task = &tasks[tasks_count];
+	task->name = name;
+	task->run = run;
+	task->ready = ready;
+	task->priority = priority;
+	task->period_ms = period_ms;
+	task->deadline_ms = deadline_ms;
+	task->next_ms = main_get_time_ms() + period_ms;
+	task->released = FALSE;
+	task->runs = 0;
+	task->runtime_max_us = 0;
+	task->deadline_misses = 0;
+	tasks_count++;
+	return SCHEDULER_OK;
+}
+
+/**
+ * scheduler_run - release the tasks and execute the most urgent one
+ *
+ *		Called in the main loop
+ */
+void scheduler_run(void)
+{
+	uint32_t now = main_get_time_ms();
+	struct task *next = 0;
+	uint8_t i;
+
+	for (i = 0; i < tasks_count; i++)	{
+		task_release(&tasks[i], now);
+		if (tasks[i].released == FALSE)	{
+			continue;
+		}
+		if (next == 0 || tasks[i].priority < next->priority ||
+				(tasks[i].priority == next->priority &&
+				(int32_t)(tasks[i].release_ms - next->release_ms) < 0))	{
+			next = &tasks[i];
+		}
+	}
+
+	if (next != 0)	{
+		task_execute(next, now);
+	}
+}
+
+/**
+ * scheduler_print_stats - output runs, worst case runtime and deadline misses
+ *						   of each task to uart
+ */
+void scheduler_print_stats(void)
+{
+	uint8_t i;
+	for (i = 0; i < tasks_count; i++)	{
+		uart_send_text_flash((uint16_t)tasks[i].name);
+		uart_send_text_flash((uint16_t)runs_msg);
+		uart_send_int(tasks[i].runs);
+		uart_send_text_flash((uint16_t)runtime_max_msg);
+		uart_send_int(tasks[i].runtime_max_us);
+		uart_send_text_flash((uint16_t)deadline_misses_msg);
+		uart_send_int(tasks[i].deadline_misses);
+		UART_NEWLINE();
+	}
+}
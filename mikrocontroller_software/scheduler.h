@@ -0,0 +1,37 @@
+/*
+ *  scheduler.h - definitions for the cooperative task scheduler
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#define SCHEDULER_TASKS_MAX		8
+
+#define SCHEDULER_OK			0
+#define SCHEDULER_ERR			1
+
+#define SCHEDULER_NO_DEADLINE	0
+
+uint8_t scheduler_add_task(PGM_P name, void (*run)(void), uint8_t (*ready)(void),
+		uint8_t priority, uint16_t period_ms, uint16_t deadline_ms);
+void scheduler_run(void);
+void scheduler_print_stats(void);
+
+#endif
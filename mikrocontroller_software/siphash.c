@@ -0,0 +1,108 @@
+/*
+ *  siphash.c - SipHash-2-4 keyed hash function
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SipHash-2-4 by Jean-Philippe Aumasson and Daniel J. Bernstein, refer to:
+ * https://131002.net/siphash/siphash.pdf
+ *
+ * It is used as message authentication code for the history copies on the
+ * tags. pc_software/tag_history.py contains the same function for the pc side.
+ */
+
+#include <stdint.h>
+
+#include "siphash.h"
+
+#define ROTL(x, b)	(uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND	\
+	do {	\
+		v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32);	\
+		v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;	\
+		v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;	\
+		v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32);	\
+	} while (0)
+
+/*
+ * internal functions
+ */
+
+/**
+ * get_le64 - read 64 bit little endian value
+ * @p:		pointer to the first byte
+ * @length:	number of bytes to read (at most 8), the other bytes are zero
+ */
+static uint64_t get_le64(const uint8_t *p, uint8_t length)
+{
+	uint64_t val = 0;
+	while (length > 0)	{
+		length--;
+		val = (val << 8) | p[length];
+	}
+	return val;
+}
+
+/*
+ * public functions
+ */
+
+/**
+ * siphash24 - calculate SipHash-2-4 of a message
+ * @key:	pointer to the SIPHASH_KEY_SIZE bytes of the key
+ * @data:	pointer to the message
+ * @length:	length of the message in bytes
+ *
+ *		Return: the 64 bit hash
+ */
+uint64_t siphash24(const uint8_t *key, const uint8_t *data, uint8_t length)
+{
+	uint64_t k0 = get_le64(key, 8);
+	uint64_t k1 = get_le64(key + 8, 8);
+	uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+	uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+	uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+	uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+	uint64_t m;
+	uint8_t left = length;
+
+	while (left >= 8)	{
+		m = get_le64(data, 8);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+		data += 8;
+		left -= 8;
+	}
+
+	m = get_le64(data, left) | ((uint64_t)length << 56);
+	v3 ^= m;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= m;
+
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	return v0 ^ v1 ^ v2 ^ v3;
+}
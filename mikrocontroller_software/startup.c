@@ -20,13 +20,14 @@
  */
 
 #include <avr/io.h>
-#include <avr/eeprom.h>
 #include <util/delay.h>
 #include <avr/pgmspace.h>
 
 #include "main.h"
+#include "dds.h"
 #include "morse.h"
 #include "startup.h"
+#include "config.h"
 #include "uart.h"
 #include "rtc.h"
 #include "user.h"
@@ -35,8 +36,6 @@
 #define START_TIME		0
 #define STOP_TIME		0
 
-uint8_t EEMEM start_time[STARTUP_TIME_MAX + 1];
-uint8_t EEMEM stop_time[STARTUP_TIME_MAX + 1];
 
 const char PROGMEM start_time_text[] = "Start time: ";
 const char PROGMEM start_date_text[] = "Start date: ";
@@ -50,136 +49,215 @@ const char PROGMEM stop_date_text[] = "Stop date: ";
 uint8_t type_max[STARTUP_TIME_MAX + 1] = {59, 59, 23, 31, 12, 99};
 /* second, minute, hour, date, month, weekday */
 
+/* all windows with start and stop in seconds, window 0 is start and stop time */
+static struct startup_window windows[STARTUP_WINDOWS];
+static uint8_t active_window = STARTUP_NO_WINDOW;
+
+const char PROGMEM window_text[] = "Window ";
+const char PROGMEM window_fox_max_text[] = "  Maximum number of foxes used: ";
+const char PROGMEM window_transmit_minute_text[] = "  Transmit minute: ";
+const char PROGMEM window_frequency_text[] = "  Frequency: ";
+
 
 /*
  * internal functions
  */
 
 /**
- * is_time_between_start_and_stop - checks if time is between start and stop time
+ * is_window_used - check if start and stop of a window are set
+ * @window:	the window to check
  *
- *		Return: TRUE if time is between start and stop time, false otherwise.
- *		If time == start_time then TRUE will be returned.
- *		If time == stop_time then FALSE will be returned.
+ *		Return: TRUE if the window is used, FALSE otherwise
  */
-uint8_t is_time_between_start_and_stop(void)
+static uint8_t is_window_used(const struct startup_window *window)
 {
-	uint8_t is_started = TRUE; /* if competition is already started while power up */
-	int8_t j;
-	for (j = STARTUP_YEAR; j >= STARTUP_SECOND; j--)	{
-		/* do not compare weekday because it is not needed! */
-		uint8_t time, start_time;
-		start_time = startup_get_start_time(j);
-		rtc_get_time(j, &time);
-		if (time > start_time)	{
-			break; /* if it is in between start and stop time it is started */
-			/*
-			 * if it is same as start_time or stop_time in this type then the
-			 * next type has to be checked too -> continue loop
-			 */
-		} else if(time != start_time)	{
-			is_started = FALSE;
-			break;
-			/* if it is outside start and stop time it is not started */
-		}
+	if (window->start == STARTUP_NEVER || window->stop == STARTUP_NEVER)	{
+		return FALSE;
 	}
-	for (j = STARTUP_YEAR; j >= STARTUP_SECOND; j--)	{
-		/* do not compare weekday because it is not needed! */
-		uint8_t time, stop_time;
-		stop_time = startup_get_stop_time(j);
-		rtc_get_time(j, &time);
-		if (time < stop_time)	{
-			break; /* if it is in between start and stop time it is started */
-			/*
-			 * if it is same as start_time or stop_time in this type then the
-			 * next type has to be checked too -> continue loop
-			 */
-		} else if(time != stop_time)	{
-			is_started = FALSE;
-			break;
-			/* if it is outside start and stop time it is not started */
+	return window->start < window->stop ? TRUE : FALSE;
+}
+
+/**
+ * find_window - search the window for a time and the next transition
+ * @now:	the time in seconds since 2000-01-01
+ * @next:	is set to the next start or stop of a window after now,
+ *			STARTUP_NEVER if there is none
+ *
+ *		If windows overlap then the window with the lower index is used.
+ *		If time == start of a window then the window is active,
+ *		if time == stop of a window then the window is not active.
+ *
+ *		Return: index of the active window, STARTUP_NO_WINDOW if now is
+ *		not in a window
+ */
+static uint8_t find_window(uint32_t now, uint32_t *next)
+{
+	uint8_t i;
+	uint8_t found = STARTUP_NO_WINDOW;
+
+	*next = STARTUP_NEVER;
+	for (i = 0; i < STARTUP_WINDOWS; i++)	{
+		const struct startup_window *window = &windows[i];
+		if (is_window_used(window) != TRUE)	{
+			continue;
 		}
-		if (j == STARTUP_SECOND && time == stop_time) {
-			/* so that if time == stop time false is returned! */
-			is_started = FALSE;
+		if (now >= window->start && now < window->stop)	{
+			if (found == STARTUP_NO_WINDOW)	{
+				found = i;
+			}
+			if (window->stop < *next)	{
+				*next = window->stop;
+			}
+		} else if (window->start > now && window->start < *next)	{
+			*next = window->start;
 		}
 	}
-	return is_started;
+	return found;
 }
 
 /**
- * set_rtc_alarm_start_time - set the rtc alarm to start time value
+ * startup_get_seconds - convert start or stop time in eeprom to seconds
+ * @get_time:	startup_get_start_time or startup_get_stop_time
  *
- *		Return: TWI_OK on success and TWI_ERR on failure
+ *		Return: the time in seconds since 2000-01-01 00:00:00
  */
-static uint8_t set_rtc_alarm_start_time(void)
+static uint32_t startup_get_seconds(uint8_t (*get_time)(uint8_t))
 {
+	uint8_t time[STARTUP_TIME_MAX + 1];
 	uint8_t type;
-	uint8_t ret;
-	for (type = STARTUP_SECOND; type < STARTUP_YEAR; type++)	{
-		uint8_t time = startup_get_start_time(type);
-		ret = rtc_set_alarm0_time(type, time);
-		if (ret != TWI_OK)	{
-			return ret;
+	for (type = STARTUP_SECOND; type <= STARTUP_YEAR; type++)	{
+		time[type] = get_time(type);
+	}
+	return rtc_time_to_seconds(time);
+}
+
+/**
+ * check_window - check if the parameters of a window are in correct range
+ * @window:	the window to check
+ *
+ *		Return: TRUE if fox max, transmit minute and frequency are valid,
+ *		FALSE otherwise
+ */
+static uint8_t check_window(const struct startup_window *window)
+{
+	if (window->fox_max != 0)	{
+		if (window->fox_max > FOX_MAX_MAX || window->fox_max < FOX_MAX_MIN ||
+				window->transmit_minute >= window->fox_max)	{
+			return FALSE;
 		}
 	}
-	uint8_t time = startup_get_start_time(STARTUP_WEEKDAY);
-	ret = rtc_set_alarm0_time(STARTUP_WEEKDAY, time);
-	return ret;
+	if (window->frequency != 0)	{
+		if (window->frequency > DDS_FREQUENCY_MAX || window->frequency < DDS_FREQUENCY_MIN)	{
+			return FALSE;
+		}
+	}
+	return TRUE;
 }
 
 /**
- * set_rtc_alarm_stop_time - set the rtc alarm to stop time value
+ * set_rtc_alarm - set the rtc alarm to the next start or stop of a window
+ * @seconds:	time of the alarm in seconds since 2000-01-01
  *
- *		Return: TWI_OK on success an TWI_ERR on failure
+ *		Return: TWI_OK on success and TWI_ERR on failure
  */
-static uint8_t set_rtc_alarm_stop_time(void)
+static uint8_t set_rtc_alarm(uint32_t seconds)
 {
+	uint8_t time[STARTUP_TIME_MAX + 1];
 	uint8_t type;
 	uint8_t ret;
+
+	rtc_seconds_to_time(seconds, time);
 	for (type = STARTUP_SECOND; type < STARTUP_YEAR; type++)	{
-		uint8_t time = startup_get_stop_time(type);
-		ret = rtc_set_alarm0_time(type, time);
+		ret = rtc_set_alarm0_time(type, time[type]);
 		if (ret != TWI_OK)	{
 			return ret;
 		}
 	}
-	uint8_t time = startup_get_stop_time(STARTUP_WEEKDAY);
-	ret = rtc_set_alarm0_time(STARTUP_WEEKDAY, time);
+	ret = rtc_set_alarm0_time(STARTUP_WEEKDAY, time[STARTUP_WEEKDAY]);
 	return ret;
 }
 
 /**
- * check_start_time - check if time is between start time and turn on or off the
+ * check_start_time - check in which window the time is and turn on or off the
  *					  morsing
+ *
+ *		When a window starts its parameters are applied before the modules
+ *		are started, so back to back windows switch the parameters directly.
+ *		The rtc alarm is set to the next start or stop of any window.
+ *		If the rtc could not be read then the current state is kept.
  */
 static void check_start_time(void)
 {
 	static uint8_t last_mode = IS_NOT_SET;
+	uint8_t time[STARTUP_TIME_MAX + 1];
+	uint32_t next;
 
 	rtc_disable_alarm0();
 
-	if (is_time_between_start_and_stop() == TRUE && last_mode != IS_BETWEEN_START_AND_STOP)	{
+	if (rtc_get_time_all(time) != TWI_OK)	{
+		rtc_enable_alarm0();
+		return;
+	}
+	uint8_t window = find_window(rtc_time_to_seconds(time), &next);
+
+	if (window != STARTUP_NO_WINDOW &&
+			(window != active_window || last_mode != IS_BETWEEN_START_AND_STOP))	{
 #ifdef DEBUG_START_TIME
 		DP(start_time_text);
 #endif
-		set_rtc_alarm_stop_time();
+		morse_set_window(windows[window].fox_max, windows[window].transmit_minute);
+		dds_set_window_frequency(windows[window].frequency);
 		morse_start_time();
 		main_start_time();
 		user_start_time();
 		last_mode = IS_BETWEEN_START_AND_STOP;
-	} else if (is_time_between_start_and_stop() != TRUE && last_mode != IS_NOT_BETWEEN_START_AND_STOP)	{
+	} else if (window == STARTUP_NO_WINDOW && last_mode != IS_NOT_BETWEEN_START_AND_STOP)	{
 #ifdef DEBUG_START_TIME
 		DP(stop_time_text);
 #endif
 		morse_stop_time();
 		main_stop_time();
 		user_stop_time();
-		set_rtc_alarm_start_time();
+		morse_set_window(0, 0);
+		dds_set_window_frequency(0);
 		last_mode = IS_NOT_BETWEEN_START_AND_STOP;
 	}
+	active_window = window;
 
-	rtc_enable_alarm0();
+	if (next != STARTUP_NEVER)	{
+		set_rtc_alarm(next);
+		rtc_enable_alarm0();
+	}
+}
+
+/**
+ * send_seconds - output a time in seconds since 2000-01-01 as date and time
+ * @seconds:	the time to output
+ */
+static void send_seconds(uint32_t seconds)
+{
+	uint8_t time[STARTUP_TIME_MAX + 1];
+	char text[3];
+	rtc_seconds_to_time(seconds, time);
+
+	uart_send_text_sram("20"); /* for 20xx (year between 2000 and 2099) */
+	int_to_string_fixed_length(text, 3, time[STARTUP_YEAR]);
+	uart_send_text_buffer(text);
+	uart_send_text_sram("-");
+	int_to_string_fixed_length(text, 3, time[STARTUP_MONTH]);
+	uart_send_text_buffer(text);
+	uart_send_text_sram("-");
+	int_to_string_fixed_length(text, 3, time[STARTUP_DATE]);
+	uart_send_text_buffer(text);
+	uart_send_text_sram(" ");
+	int_to_string_fixed_length(text, 3, time[STARTUP_HOUR]);
+	uart_send_text_buffer(text);
+	uart_send_text_sram(":");
+	int_to_string_fixed_length(text, 3, time[STARTUP_MINUTE]);
+	uart_send_text_buffer(text);
+	uart_send_text_sram(":");
+	int_to_string_fixed_length(text, 3, time[STARTUP_SECOND]);
+	uart_send_text_buffer(text);
 }
 
 /*
@@ -258,6 +336,33 @@ void startup_show_configuration(void)
 	uart_send_text_buffer(date[0]);
 	UART_NEWLINE();
 
+	for (i = 1; i < STARTUP_WINDOWS; i++)	{
+		const struct startup_window *window = &windows[i];
+		if (is_window_used(window) != TRUE)	{
+			continue;
+		}
+		uart_send_text_flash((uint16_t)window_text);
+		uart_send_int(i);
+		uart_send_text_sram(": ");
+		send_seconds(window->start);
+		uart_send_text_sram(" - ");
+		send_seconds(window->stop);
+		UART_NEWLINE();
+		if (window->fox_max != 0)	{
+			uart_send_text_flash((uint16_t)window_fox_max_text);
+			uart_send_int(window->fox_max);
+			UART_NEWLINE();
+			uart_send_text_flash((uint16_t)window_transmit_minute_text);
+			uart_send_int(window->transmit_minute);
+			UART_NEWLINE();
+		}
+		if (window->frequency != 0)	{
+			uart_send_text_flash((uint16_t)window_frequency_text);
+			uart_send_int(window->frequency);
+			uart_send_text_sram("Hz");
+			UART_NEWLINE();
+		}
+	}
 }
 
 /**
@@ -265,7 +370,17 @@ void startup_show_configuration(void)
  */
 void startup_load_configuration(void)
 {
-	/* nothing to do */
+	uint8_t i;
+
+	windows[0].start = startup_get_seconds(startup_get_start_time);
+	windows[0].stop = startup_get_seconds(startup_get_stop_time);
+	windows[0].fox_max = 0;
+	windows[0].transmit_minute = 0;
+	windows[0].frequency = 0;
+
+	for (i = 1; i < STARTUP_WINDOWS; i++)	{
+		windows[i] = config.windows[i - 1];
+	}
 }
 
 /**
@@ -288,7 +403,9 @@ uint8_t startup_set_start_time(uint8_t type, uint8_t time)
 			return FALSE;
 		}
 	}
-	eeprom_write_byte(&start_time[type], time);
+	config.start_time[type] = time;
+	main_mark_dirty(MAIN_RELOAD_STARTUP);
+	windows[0].start = startup_get_seconds(startup_get_start_time);
 	return TRUE;
 }
 
@@ -312,7 +429,9 @@ uint8_t startup_set_stop_time(uint8_t type, uint8_t time)
 			return FALSE;
 		}
 	}
-	eeprom_write_byte(&stop_time[type], time);
+	config.stop_time[type] = time;
+	main_mark_dirty(MAIN_RELOAD_STARTUP);
+	windows[0].stop = startup_get_seconds(startup_get_stop_time);
 	return TRUE;
 }
 
@@ -324,16 +443,7 @@ uint8_t startup_set_stop_time(uint8_t type, uint8_t time)
  */
 uint8_t startup_get_start_time(uint8_t type)
 {
-	uint8_t byte = eeprom_read_byte(&start_time[type]);
-	if (byte > type_max[type])	{
-		byte = type_max[type];
-	}
-	if (type == STARTUP_MONTH || type == STARTUP_DATE)	{
-		if (byte == 0){
-			byte = 1;
-		}
-	}
-	return byte;
+	return config.start_time[type];
 }
 
 /**
@@ -344,20 +454,80 @@ uint8_t startup_get_start_time(uint8_t type)
  */
 uint8_t startup_get_stop_time(uint8_t type)
 {
-	uint8_t byte = eeprom_read_byte(&stop_time[type]);
-	if (byte > type_max[type])	{
-		byte = type_max[type];
+	return config.stop_time[type];
+}
+
+/**
+ * startup_get_start_seconds - get start time of the competition
+ *
+ *		Return: the start time in seconds since 2000-01-01 00:00:00
+ */
+uint32_t startup_get_start_seconds(void)
+{
+	return windows[0].start;
+}
+
+/**
+ * startup_get_window - read a transmit window
+ * @index:	number of the window (between 0 and STARTUP_WINDOWS - 1)
+ * @window:	is filled with start, stop and parameters of the window
+ *
+ *		Return: TRUE on success, FALSE if index is out of range
+ */
+uint8_t startup_get_window(uint8_t index, struct startup_window *window)
+{
+	if (index >= STARTUP_WINDOWS)	{
+		return FALSE;
 	}
-	if (type == STARTUP_MONTH || type == STARTUP_DATE)	{
-		if (byte == 0){
-			byte = 1;
-		}
+	*window = windows[index];
+	return TRUE;
+}
+
+/**
+ * startup_set_window - save a transmit window in eeprom
+ * @index:	number of the window (between 1 and STARTUP_WINDOWS - 1), window 0
+ *			is set with startup_set_start_time and startup_set_stop_time
+ * @window:	start, stop and parameters of the window
+ *
+ *		Start or stop may be STARTUP_NEVER while the window is set up,
+ *		the window is only used if both are set.
+ *
+ *		Return: TRUE on success, FALSE if index or parameters are out of range
+ */
+uint8_t startup_set_window(uint8_t index, const struct startup_window *window)
+{
+	if (index == 0 || index >= STARTUP_WINDOWS)	{
+		return FALSE;
+	}
+	if (check_window(window) != TRUE)	{
+		return FALSE;
 	}
-	return byte;
+	config.windows[index - 1] = *window;
+	main_mark_dirty(MAIN_RELOAD_STARTUP);
+	windows[index] = *window;
+	return TRUE;
+}
+
+/**
+ * startup_clear_window - remove a transmit window
+ * @index:	number of the window (between 1 and STARTUP_WINDOWS - 1)
+ *
+ *		Return: TRUE on success, FALSE if index is out of range
+ */
+uint8_t startup_clear_window(uint8_t index)
+{
+	struct startup_window window = {
+		.start = STARTUP_NEVER,
+		.stop = STARTUP_NEVER,
+		.fox_max = 0,
+		.transmit_minute = 0,
+		.frequency = 0
+	};
+	return startup_set_window(index, &window);
 }
 
 /**
- * startup_interrupt - function is called by rtc-interrupt to indicate rtc alarm
+ * startup_interrupt - function is called by rtc_process_events() to indicate rtc alarm
  */
 void startup_interrupt()
 {
@@ -37,6 +37,31 @@
 #define STARTUP_WEEKDAY		RTC_WEEKDAY
 #define STARTUP_TIME_MAX	RTC_TIME_MAX
 
+/*
+ * window 0 is given by the start and stop time, windows 1 to
+ * STARTUP_WINDOWS - 1 are configured with startup_set_window()
+ */
+#define STARTUP_WINDOWS		4
+#define STARTUP_NO_WINDOW	0xff
+#define STARTUP_NEVER		0xffffffffUL /* start or stop of a window that is not set */
+
+/**
+ * struct startup_window - a time window in which the fox transmits
+ * @start:				start in seconds since 2000-01-01 (see rtc_time_to_seconds)
+ * @stop:				stop in seconds since 2000-01-01, the window is only used
+ *						if start and stop are set and start < stop
+ * @fox_max:			number of foxes in this window, 0 to use the morse settings
+ * @transmit_minute:	transmit minute of this fox in this window
+ * @frequency:			frequency in Hz in this window, 0 to use the dds settings
+ */
+struct startup_window {
+	uint32_t start;
+	uint32_t stop;
+	uint8_t fox_max;
+	uint8_t transmit_minute;
+	uint32_t frequency;
+};
+
 void startup_init(void);
 void startup_show_configuration(void);
 void startup_load_configuration(void);
@@ -45,6 +70,11 @@ uint8_t startup_set_start_time(uint8_t type, uint8_t time);
 uint8_t startup_set_stop_time(uint8_t type, uint8_t time);
 uint8_t startup_get_start_time(uint8_t type);
 uint8_t startup_get_stop_time(uint8_t type);
+uint32_t startup_get_start_seconds(void);
+
+uint8_t startup_get_window(uint8_t index, struct startup_window *window);
+uint8_t startup_set_window(uint8_t index, const struct startup_window *window);
+uint8_t startup_clear_window(uint8_t index);
 
 void startup_interrupt(void);
 
@@ -0,0 +1,198 @@
+/*
+ *  config_test.c - host test of loading and saving the configuration
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compiled with the host compiler (see Makefile in this directory) together
+ * with config.c. EEMEM is empty on the host, so config_eemem is a normal
+ * variable and stands for the eeprom.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <util/crc16.h>
+
+#include "main.h"
+#include "morse.h"
+#include "config.h"
+
+#define CHECK(cond)	check((cond), #cond, __LINE__)
+
+extern struct config config_eemem;
+
+static unsigned int eeprom_writes = 0; /* bytes changed by eeprom_update_block */
+static unsigned int errors = 0;
+
+/*
+ * replacements of the functions used by config.c
+ */
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++)	{
+		if (((uint8_t *)dst)[i] != ((const uint8_t *)src)[i])	{
+			((uint8_t *)dst)[i] = ((const uint8_t *)src)[i];
+			eeprom_writes++;
+		}
+	}
+}
+
+uint16_t morse_convert_wpm_morse_unit(uint16_t wpm)
+{
+	return wpm;
+}
+
+void uart_send_text_flash(uint16_t text)
+{
+}
+
+void uart_send_text_sram(const char *text)
+{
+}
+
+/*
+ * helper functions
+ */
+
+/**
+ * crc - crc of a configuration like config.c calculates it
+ */
+static uint16_t crc(const struct config *c)
+{
+	uint16_t crc = 0xffff;
+	size_t i;
+	for (i = 0; i < offsetof(struct config, crc); i++)	{
+		crc = _crc16_update(crc, ((const uint8_t *)c)[i]);
+	}
+	return crc;
+}
+
+static void check(int cond, const char *text, int line)
+{
+	if (!cond)	{
+		printf("line %d: %s failed\n", line, text);
+		errors++;
+	}
+}
+
+/**
+ * power_cycle - lose the copy in ram and load the configuration again
+ *
+ *		Return: the return value of config_init
+ */
+static uint8_t power_cycle(void)
+{
+	memset(&config, 0x55, sizeof(config));
+	return config_init();
+}
+
+int main(void)
+{
+	struct config saved;
+	uint16_t old_crc;
+	uint16_t table[3][256];
+	unsigned int value, i;
+	uint8_t found;
+
+	/* erased eeprom -> defaults */
+	memset(&config_eemem, 0xff, sizeof(config_eemem));
+	CHECK(power_cycle() == FALSE);
+	CHECK(config.version == CONFIG_VERSION);
+	CHECK(config.fox_max == FOX_MAX_MAX);
+
+	/* a committed configuration is loaded again */
+	config.fox_number = 3;
+	config.frequency = 3579000;
+	config_commit();
+	CHECK(eeprom_writes > 0);
+	CHECK(power_cycle() == TRUE);
+	CHECK(config.fox_number == 3);
+	CHECK(config.frequency == 3579000);
+
+	/* nothing is written if nothing changed */
+	eeprom_writes = 0;
+	config_commit();
+	CHECK(eeprom_writes == 0);
+
+	/* wrong version -> defaults */
+	saved = config_eemem;
+	config_eemem.version = CONFIG_VERSION + 1;
+	CHECK(power_cycle() == FALSE);
+	CHECK(config.fox_number == FOX_NUMBER_DEMO);
+
+	/* one flipped byte -> defaults */
+	config_eemem = saved;
+	CHECK(power_cycle() == TRUE);
+	((uint8_t *)&config_eemem)[5] ^= 0x10;
+	CHECK(power_cycle() == FALSE);
+	CHECK(config.frequency != 3579000);
+
+	/* a change with the same crc as before is saved as well */
+	config_eemem = saved;
+	CHECK(power_cycle() == TRUE);
+	old_crc = config.crc;
+	/*
+	 * the crc is linear, so the change of the crc by xoring the first three
+	 * bytes of the secret is the xor of the changes of each byte
+	 */
+	for (i = 0; i < 3; i++)	{
+		for (value = 0; value < 256; value++)	{
+			config.secret[i] ^= value;
+			table[i][value] = crc(&config) ^ old_crc;
+			config.secret[i] ^= value;
+		}
+	}
+	found = FALSE;
+	for (value = 1; value < 0x10000 && found == FALSE; value++)	{
+		uint16_t change = table[0][value & 0xff] ^ table[1][value >> 8];
+		for (i = 1; i < 256; i++)	{
+			if (table[2][i] == change)	{
+				config.secret[0] ^= value & 0xff;
+				config.secret[1] ^= value >> 8;
+				config.secret[2] ^= i;
+				found = TRUE;
+				break;
+			}
+		}
+	}
+	CHECK(found == TRUE);
+	CHECK(crc(&config) == old_crc);
+	saved = config;
+	config_commit();
+	CHECK(config.crc == old_crc);
+	CHECK(memcmp(&config_eemem, &saved, sizeof(saved)) == 0);
+	CHECK(power_cycle() == TRUE);
+	CHECK(memcmp(config.secret, saved.secret, 3) == 0);
+
+	if (errors > 0)	{
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("config_test: ok\n");
+	return 0;
+}
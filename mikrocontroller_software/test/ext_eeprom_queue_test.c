@@ -0,0 +1,258 @@
+/*
+ *  ext_eeprom_queue_test.c - host test of the queued writes in ext_eeprom.c
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compiled with the host compiler (see Makefile in this directory) together
+ * with ext_eeprom.c. The twi functions are replaced by a simulated 24AA512,
+ * queued transactions are finished by complete_transaction().
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "main.h"
+#include "twi.h"
+#include "timer.h"
+#include "ext_eeprom.h"
+
+#define CHECK(cond)	check((cond), #cond, __LINE__)
+
+static uint8_t memory[65536]; /* content of the simulated eeprom */
+static uint16_t pointer; /* address counter of the simulated eeprom */
+static uint8_t bytes_sent; /* bytes after the slave address */
+static uint8_t fail_sync = FALSE; /* blocking transfers fail */
+static uint8_t fail_async = FALSE; /* queued transactions fail */
+static struct twi_transaction *active; /* queued transaction */
+static unsigned int async_writes = 0; /* queued transactions executed */
+static struct timer *write_cycle_timer;
+static uint32_t last_int; /* last number sent with uart_send_int */
+static unsigned int errors = 0;
+
+/*
+ * replacements of the functions used by ext_eeprom.c
+ */
+
+uint8_t twi_start(void)
+{
+	bytes_sent = 0;
+	return fail_sync ? TWI_ERR : TWI_OK;
+}
+
+uint8_t twi_send_slave_address(uint8_t rw, uint8_t address)
+{
+	return fail_sync ? TWI_ERR : TWI_OK;
+}
+
+uint8_t twi_send_byte(uint8_t byte)
+{
+	if (bytes_sent == 0)	{
+		pointer = byte << 8;
+	} else if (bytes_sent == 1)	{
+		pointer |= byte;
+	} else	{
+		memory[pointer++] = byte;
+	}
+	bytes_sent++;
+	return TWI_OK;
+}
+
+uint8_t twi_read_byte(uint8_t ack, uint8_t *byte)
+{
+	*byte = memory[pointer++];
+	return TWI_OK;
+}
+
+void twi_stop(void)
+{
+}
+
+uint8_t twi_queue_transaction(struct twi_transaction *transaction)
+{
+	transaction->status = TWI_BUSY;
+	active = transaction;
+	return TWI_OK;
+}
+
+void twi_count_retry(void)
+{
+}
+
+void timer_start(struct timer *timer, uint16_t delay_ms, uint16_t period_ms,
+		void (*callback)(void))
+{
+	timer->active = TRUE;
+	write_cycle_timer = timer;
+}
+
+uint8_t timer_is_active(struct timer *timer)
+{
+	return timer->active;
+}
+
+void rtc_enable_avr_interrupt(void)
+{
+}
+
+void rtc_disable_avr_interrupt(void)
+{
+}
+
+void _delay_us(double us)
+{
+}
+
+void uart_send_text_sram(const char *text)
+{
+}
+
+void uart_send_text_flash(uint16_t text)
+{
+}
+
+uint8_t uart_send_int(uint32_t val)
+{
+	last_int = val;
+	return 0;
+}
+
+/*
+ * helper functions
+ */
+
+/**
+ * complete_transaction - execute the queued transaction on the simulated eeprom
+ */
+static void complete_transaction(void)
+{
+	if (active == 0)	{
+		return;
+	}
+	if (fail_async)	{
+		active->status = TWI_ERR;
+	} else	{
+		uint16_t addr = (active->header[0] << 8) | active->header[1];
+		memcpy(&memory[addr], active->write_data, active->write_length);
+		active->status = TWI_OK;
+	}
+	async_writes++;
+	active = 0;
+}
+
+void twi_wait_idle(void)
+{
+	complete_transaction();
+}
+
+/**
+ * run_queue - let the scheduler task work until no write is queued any more
+ */
+static void run_queue(void)
+{
+	int i;
+	for (i = 0; i < 100; i++)	{
+		if (write_cycle_timer != 0)	{
+			write_cycle_timer->active = FALSE; /* the write cycle is over */
+		}
+		if (ext_eeprom_pending() == TRUE)	{
+			ext_eeprom_process();
+		}
+		complete_transaction();
+	}
+}
+
+static void check(int cond, const char *text, int line)
+{
+	if (!cond)	{
+		printf("line %d: %s failed\n", line, text);
+		errors++;
+	}
+}
+
+int main(void)
+{
+	const uint8_t data[6] = {1, 2, 3, 4, 5, 6};
+	const uint8_t zero[6] = {0};
+	uint8_t buffer[6];
+	uint16_t word = 0x1234, read_word;
+	int i;
+
+	/* a write over a page boundary is split and written in the background */
+	CHECK(ext_eeprom_queue_write(data, 125, 6) == TWI_OK);
+	CHECK(memcmp(&memory[125], zero, 6) == 0);
+	run_queue();
+	CHECK(memcmp(&memory[125], data, 6) == 0);
+	CHECK(async_writes == 2);
+
+	/* a read of other addresses does not wait for the queue */
+	CHECK(ext_eeprom_queue_write((uint8_t *)&word, 0, 2) == TWI_OK);
+	CHECK(ext_eeprom_read_block(buffer, 1000, 6) == TWI_OK);
+	CHECK(memory[0] == 0 && memory[1] == 0);
+
+	/* a read of a queued address returns the new data */
+	CHECK(ext_eeprom_read_word(0, &read_word) == TWI_OK);
+	CHECK(read_word == 0x1234);
+
+	/* a started write is finished before the read */
+	CHECK(ext_eeprom_queue_write(data, 200, 6) == TWI_OK);
+	if (write_cycle_timer != 0)	{
+		write_cycle_timer->active = FALSE;
+	}
+	ext_eeprom_process();
+	CHECK(active != 0);
+	CHECK(ext_eeprom_read_block(buffer, 200, 6) == TWI_OK);
+	CHECK(memcmp(buffer, data, 6) == 0);
+
+	/* a write that does not fit into the queue is written at once */
+	for (i = 0; i < 5; i++)	{
+		CHECK(ext_eeprom_queue_write(data, 300 + i * 8, 6) == TWI_OK);
+	}
+	CHECK(ext_eeprom_queue_write(data, 500, 6) == TWI_OK);
+	CHECK(memcmp(&memory[500], data, 6) == 0);
+	CHECK(memcmp(&memory[300], zero, 6) == 0);
+	run_queue();
+	for (i = 0; i < 5; i++)	{
+		CHECK(memcmp(&memory[300 + i * 8], data, 6) == 0);
+	}
+
+	/* after failed queued transactions the write is done blocking */
+	fail_async = TRUE;
+	CHECK(ext_eeprom_queue_write(data, 600, 6) == TWI_OK);
+	run_queue();
+	CHECK(memcmp(&memory[600], data, 6) == 0);
+	ext_eeprom_print_stats();
+	CHECK(last_int == 0);
+
+	/* if the blocking write fails as well the write is counted */
+	fail_sync = TRUE;
+	CHECK(ext_eeprom_queue_write(data, 700, 6) == TWI_OK);
+	run_queue();
+	CHECK(memcmp(&memory[700], zero, 6) == 0);
+	ext_eeprom_print_stats();
+	CHECK(last_int == 1);
+
+	if (errors > 0)	{
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("ext_eeprom_queue_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,359 @@
+/*
+ *  rfid_process_test.c - host test of processing several tags after one poll
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compiled with the host compiler (see Makefile in this directory) together
+ * with rfid.c. The MFRC522 driver is replaced by a simulated field with
+ * several cards: a request is answered by every card that is not halted and
+ * the anticollision selects the first of them. user_new_tag is replaced by a
+ * function that accesses the tag like the user module: it reads the tag id
+ * block in sector 0 and the history blocks in another sector and writes one
+ * of them.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "main.h"
+#include "rfid.h"
+#include "user.h"
+#include "timer.h"
+
+#define CHECK(cond)	check((cond), #cond, __LINE__)
+
+#define CARDS_MAX		16
+#define SAK_CLASSIC_1K	0x08
+#define SAK_ULTRALIGHT	0x00
+#define CC_NTAG213		0x12 /* 144 bytes user memory, too small */
+#define CC_NTAG215		0x3e /* 496 bytes user memory */
+
+#define USER_ID_BLOCK		1 /* sector 0 */
+#define USER_HISTORY_BLOCK	8 /* sector 2, blocks 8 to 10 are read */
+
+volatile uint8_t PORTD, DDRD, EICRA, EIFR, EIMSK;
+
+Uid uid;
+
+struct card	{
+	uint8_t sak;
+	uint8_t cc_size; /* capability container of ultralight tags */
+	uint8_t halted;
+	unsigned int processed; /* calls of user_new_tag while selected */
+	unsigned int authentications;
+};
+
+static struct card cards[CARDS_MAX];
+static uint8_t card_count;
+static int selected = -1; /* index of selected card, -1 if none */
+static uint8_t crypto = FALSE; /* crypto1 is on */
+static uint8_t auth_sector = RFID_NO_SECTOR;
+static uint8_t authenticated = FALSE; /* selected card was authenticated */
+static unsigned int unauthenticated = 0; /* classic blocks accessed without authentication */
+static unsigned int plain_halts = 0; /* authenticated tags halted without crypto1 */
+static void (*poll_callback)(void);
+static uint32_t time_ms = 0;
+static unsigned int errors = 0;
+
+/*
+ * replacements of the functions used by rfid.c
+ */
+
+uint32_t main_get_time_ms(void)
+{
+	return time_ms;
+}
+
+void timer_start(struct timer *timer, uint16_t delay_ms, uint16_t period_ms,
+		void (*callback)(void))
+{
+	time_ms += delay_ms;
+	poll_callback = callback;
+}
+
+void uart_send_text_sram(const char *text)	{}
+void uart_send_text_flash(uint16_t text)	{}
+uint8_t uart_send_int(uint32_t val)
+{
+	return 0;
+}
+
+void SPI_begin(void)	{}
+void MFRC522_init(byte chipSelectPin, byte resetPowerDownPin)	{}
+void PCD_Init(void)	{}
+void PCD_SoftPowerDown(void)	{}
+void PCD_SoftPowerUp(void)	{}
+void PCD_SetAntennaGain(byte mask)	{}
+void PCD_IrqHandler(void)	{}
+void PICC_StartRequestA(void)	{}
+
+bool PCD_IsPoweredUp(void)
+{
+	return true;
+}
+
+/**
+ * cards_in_field - number of cards that answer a request
+ */
+static uint8_t cards_in_field(void)
+{
+	uint8_t i, n = 0;
+	for (i = 0; i < card_count; i++)	{
+		if (!cards[i].halted)	{
+			n++;
+		}
+	}
+	return n;
+}
+
+byte PICC_PollRequestA(byte *bufferATQA, byte *bufferSize)
+{
+	uint8_t n = cards_in_field();
+	if (n == 0)	{
+		return STATUS_TIMEOUT;
+	}
+	return n > 1 ? STATUS_COLLISION : STATUS_OK;
+}
+
+bool PICC_IsNewCardPresent(void)
+{
+	return cards_in_field() > 0;
+}
+
+bool PICC_ReadCardSerial(void)
+{
+	uint8_t i;
+	for (i = 0; i < card_count; i++)	{
+		if (!cards[i].halted)	{
+			selected = i;
+			authenticated = FALSE;
+			uid.size = 4;
+			uid.uidByte[0] = i;
+			uid.sak = cards[i].sak;
+			return true;
+		}
+	}
+	return false;
+}
+
+byte PICC_GetType(byte sak)
+{
+	if (sak == SAK_CLASSIC_1K)	{
+		return PICC_TYPE_MIFARE_1K;
+	}
+	if (sak == SAK_ULTRALIGHT)	{
+		return PICC_TYPE_MIFARE_UL;
+	}
+	return PICC_TYPE_UNKNOWN;
+}
+
+byte PICC_HaltA(void)
+{
+	if (selected >= 0)	{
+		if (authenticated == TRUE && crypto == FALSE)	{
+			plain_halts++; /* the tag would not understand the halt */
+		} else	{
+			cards[selected].halted = TRUE;
+		}
+	}
+	selected = -1;
+	return STATUS_OK;
+}
+
+byte PCD_Authenticate(byte command, byte blockAddr, MIFARE_Key *key, Uid *uid)
+{
+	if (selected < 0)	{
+		return STATUS_TIMEOUT;
+	}
+	cards[selected].authentications++;
+	auth_sector = RFID_SECTOR(blockAddr);
+	authenticated = TRUE;
+	crypto = TRUE;
+	return STATUS_OK;
+}
+
+void PCD_StopCrypto1(void)
+{
+	crypto = FALSE;
+	auth_sector = RFID_NO_SECTOR;
+}
+
+/**
+ * check_access - count an access to a classic block without authentication
+ */
+static void check_access(byte block)
+{
+	if (cards[selected].sak == SAK_CLASSIC_1K
+			&& (crypto == FALSE || auth_sector != RFID_SECTOR(block)))	{
+		unauthenticated++;
+	}
+}
+
+byte MIFARE_Read(byte blockAddr, byte *buffer, byte *bufferSize)
+{
+	if (selected < 0 || *bufferSize < RFID_BLOCK_SIZE + 2)	{
+		return STATUS_ERROR;
+	}
+	memset(buffer, 0, RFID_BLOCK_SIZE + 2);
+	if (cards[selected].sak == SAK_ULTRALIGHT && blockAddr == RFID_CC_PAGE)	{
+		buffer[RFID_CC_SIZE] = cards[selected].cc_size;
+	} else	{
+		check_access(blockAddr);
+	}
+	*bufferSize = RFID_BLOCK_SIZE + 2;
+	return STATUS_OK;
+}
+
+byte MIFARE_Write(byte blockAddr, byte *buffer, byte bufferSize)
+{
+	if (selected < 0)	{
+		return STATUS_ERROR;
+	}
+	check_access(blockAddr);
+	return STATUS_OK;
+}
+
+byte MIFARE_Ultralight_Write(byte page, byte *buffer, byte bufferSize)
+{
+	return selected < 0 ? STATUS_ERROR : STATUS_OK;
+}
+
+uint8_t user_new_tag(void)
+{
+	uint8_t buffer[RFID_BLOCK_SIZE + 2];
+	uint8_t len, i;
+
+	cards[selected].processed++;
+	len = sizeof(buffer);
+	rfid_read_block(USER_ID_BLOCK, buffer, &len);
+	for (i = 0; i < 3; i++)	{
+		len = sizeof(buffer);
+		rfid_read_block(USER_HISTORY_BLOCK + i, buffer, &len);
+	}
+	rfid_write_block(USER_HISTORY_BLOCK + 1, buffer, RFID_BLOCK_SIZE);
+	return TRUE;
+}
+
+/*
+ * test
+ */
+
+static void check(int cond, const char *text, int line)
+{
+	if (!cond)	{
+		printf("line %d: %s failed\n", line, text);
+		errors++;
+	}
+}
+
+/**
+ * new_field - put new cards into the field
+ * @n:			number of cards
+ * @sak:		sak of the cards
+ * @cc_size:	capability container of ultralight cards
+ */
+static void new_field(uint8_t n, uint8_t sak, uint8_t cc_size)
+{
+	memset(cards, 0, sizeof(cards));
+	card_count = 0;
+	while (card_count < n)	{
+		cards[card_count].sak = sak;
+		cards[card_count].cc_size = cc_size;
+		card_count++;
+	}
+}
+
+/**
+ * poll - run rfid_loop through one poll: wakeup, request and processing
+ *
+ *		Return: number of cards processed by this poll
+ */
+static unsigned int poll(void)
+{
+	unsigned int before = 0, after = 0;
+	uint8_t i;
+	for (i = 0; i < card_count; i++)	{
+		before += cards[i].processed;
+	}
+	poll_callback(); /* poll interval elapsed */
+	rfid_loop(); /* power up */
+	poll_callback(); /* wakeup time elapsed */
+	rfid_loop(); /* request */
+	rfid_loop(); /* answer of the request */
+	CHECK(rfid_ready() == FALSE);
+	for (i = 0; i < card_count; i++)	{
+		after += cards[i].processed;
+	}
+	return after - before;
+}
+
+int main(void)
+{
+	uint8_t i;
+
+	rfid_init();
+
+	/* empty field */
+	new_field(0, SAK_CLASSIC_1K, 0);
+	CHECK(poll() == 0);
+
+	/* three classic cards are processed by one poll, two sectors each */
+	new_field(3, SAK_CLASSIC_1K, 0);
+	CHECK(poll() == 3);
+	for (i = 0; i < 3; i++)	{
+		CHECK(cards[i].processed == 1);
+		CHECK(cards[i].authentications == 2);
+		CHECK(cards[i].halted == TRUE);
+	}
+	CHECK(poll() == 0);
+
+	/* at most eight cards per poll, the rest in the next poll */
+	new_field(10, SAK_CLASSIC_1K, 0);
+	CHECK(poll() == 8);
+	CHECK(cards_in_field() == 2);
+	CHECK(poll() == 2);
+	for (i = 0; i < 10; i++)	{
+		CHECK(cards[i].processed == 1);
+		CHECK(cards[i].authentications == 2);
+	}
+
+	/* ultralight cards need no authentication, too small ones are skipped */
+	new_field(3, SAK_ULTRALIGHT, CC_NTAG215);
+	cards[1].cc_size = CC_NTAG213;
+	CHECK(poll() == 2);
+	CHECK(cards[0].processed == 1);
+	CHECK(cards[1].processed == 0);
+	CHECK(cards[2].processed == 1);
+	for (i = 0; i < 3; i++)	{
+		CHECK(cards[i].authentications == 0);
+		CHECK(cards[i].halted == TRUE);
+	}
+
+	CHECK(unauthenticated == 0);
+	CHECK(plain_halts == 0);
+
+	if (errors > 0)	{
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("rfid_process_test: ok\n");
+	return 0;
+}
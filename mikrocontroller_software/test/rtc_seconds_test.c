@@ -0,0 +1,109 @@
+/*
+ *  rtc_seconds_test.c - host test of the conversion in rtc_seconds.c
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compiled with the host compiler (see Makefile in this directory), compares
+ * rtc_time_to_seconds and rtc_seconds_to_time with timegm() of the c library
+ * for the whole range of the rtc from 2000 to 2099.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "rtc.h"
+
+#define STEP_S		(7 * 3600UL + 13 * 60 + 17) /* odd step to hit all hours and minutes */
+#define LAST_S		3155759999UL /* 2099-12-31 23:59:59 */
+
+static time_t epoch_2000;
+static unsigned long errors = 0;
+
+/**
+ * check_seconds - check both conversions for one point in time
+ * @seconds:	seconds since 2000-01-01 00:00:00
+ */
+static void check_seconds(uint32_t seconds)
+{
+	time_t t = epoch_2000 + seconds;
+	struct tm tm;
+	uint8_t time[RTC_TIME_MAX + 1];
+
+	gmtime_r(&t, &tm);
+	rtc_seconds_to_time(seconds, time);
+	if (time[RTC_YEAR] != tm.tm_year - 100 || time[RTC_MONTH] != tm.tm_mon + 1 ||
+			time[RTC_DATE] != tm.tm_mday || time[RTC_HOUR] != tm.tm_hour ||
+			time[RTC_MINUTE] != tm.tm_min || time[RTC_SECOND] != tm.tm_sec)	{
+		printf("rtc_seconds_to_time(%lu): 20%02u-%02u-%02u %02u:%02u:%02u, "
+				"expected %04d-%02d-%02d %02d:%02d:%02d\n", (unsigned long)seconds,
+				time[RTC_YEAR], time[RTC_MONTH], time[RTC_DATE], time[RTC_HOUR],
+				time[RTC_MINUTE], time[RTC_SECOND], tm.tm_year + 1900, tm.tm_mon + 1,
+				tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+		errors++;
+		return;
+	}
+	if (rtc_time_to_seconds(time) != seconds)	{
+		printf("rtc_time_to_seconds(20%02u-%02u-%02u %02u:%02u:%02u): %lu, expected %lu\n",
+				time[RTC_YEAR], time[RTC_MONTH], time[RTC_DATE], time[RTC_HOUR],
+				time[RTC_MINUTE], time[RTC_SECOND],
+				(unsigned long)rtc_time_to_seconds(time), (unsigned long)seconds);
+		errors++;
+	}
+}
+
+int main(void)
+{
+	struct tm tm = {0};
+	uint32_t seconds;
+	int year, month;
+
+	tm.tm_year = 100;
+	tm.tm_mday = 1;
+	epoch_2000 = timegm(&tm);
+
+	/* the first and the last second of every month, covers all rollovers */
+	for (year = 100; year < 200; year++)	{
+		for (month = 0; month < 12; month++)	{
+			struct tm first = {0};
+			first.tm_year = year;
+			first.tm_mon = month;
+			first.tm_mday = 1;
+			seconds = timegm(&first) - epoch_2000;
+			check_seconds(seconds);
+			if (seconds > 0)	{
+				check_seconds(seconds - 1);
+			}
+		}
+	}
+	check_seconds(LAST_S);
+
+	/* points in time spread over the whole range */
+	for (seconds = 0; seconds <= LAST_S - STEP_S; seconds += STEP_S)	{
+		check_seconds(seconds);
+	}
+
+	if (errors > 0)	{
+		printf("%lu errors\n", errors);
+		return 1;
+	}
+	printf("rtc_seconds_test: ok\n");
+	return 0;
+}
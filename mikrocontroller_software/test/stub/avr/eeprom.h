@@ -0,0 +1,12 @@
+/* host replacement of <avr/eeprom.h>, the test implements the functions */
+#ifndef STUB_AVR_EEPROM_H
+#define STUB_AVR_EEPROM_H
+
+#include <stddef.h>
+
+#define EEMEM
+
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#endif
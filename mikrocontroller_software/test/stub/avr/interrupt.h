@@ -0,0 +1,11 @@
+/* host replacement of <avr/interrupt.h>, an ISR is a normal function */
+#ifndef STUB_AVR_INTERRUPT_H
+#define STUB_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector, ...)	void vector(void)
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,18 @@
+/* host replacement of <avr/io.h> for the tests in this directory */
+#ifndef STUB_AVR_IO_H
+#define STUB_AVR_IO_H
+
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+/* registers are variables, a test that needs them has to define them */
+extern volatile uint8_t PORTD, DDRD, EICRA, EIFR, EIMSK;
+
+#define PD2		2
+#define INT0	0
+#define INTF0	0
+#define ISC00	0
+#define ISC01	1
+
+#endif
@@ -0,0 +1,12 @@
+/* host replacement of <avr/pgmspace.h>, flash is normal memory on the host */
+#ifndef STUB_AVR_PGMSPACE_H
+#define STUB_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PGM_P				const char *
+#define PSTR(s)				(s)
+#define pgm_read_byte(a)	(*(const uint8_t *)(a))
+
+#endif
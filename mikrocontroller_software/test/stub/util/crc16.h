@@ -0,0 +1,22 @@
+/* host replacement of <util/crc16.h>, c code from the avr-libc documentation */
+#ifndef STUB_UTIL_CRC16_H
+#define STUB_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+	int i;
+
+	crc ^= a;
+	for (i = 0; i < 8; ++i)	{
+		if (crc & 1)	{
+			crc = (crc >> 1) ^ 0xA001;
+		} else	{
+			crc = (crc >> 1);
+		}
+	}
+	return crc;
+}
+
+#endif
@@ -0,0 +1,8 @@
+/* host replacement of <util/delay.h>, the test implements the functions */
+#ifndef STUB_UTIL_DELAY_H
+#define STUB_UTIL_DELAY_H
+
+void _delay_us(double us);
+void _delay_ms(double ms);
+
+#endif
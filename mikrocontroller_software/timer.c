@@ -0,0 +1,182 @@
+/*
+ *  timer.c - software timer wheel on the millisecond time base of timer1
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <avr/io.h>
+
+#include "main.h"
+#include "timer.h"
+
+/*
+ * Each active timer is in the slot (expires % TIMER_WHEEL_SLOTS) of the wheel.
+ * Starting and stopping a timer only links or unlinks it from a doubly linked
+ * slot list. timer_process() visits one slot per elapsed millisecond and
+ * expires the timers of the slot that are due, timers with a delay of more
+ * than TIMER_WHEEL_SLOTS ms stay in the slot until their round has come.
+ *
+ * The callbacks are executed by timer_process() from the scheduler and not
+ * from an interrupt, so they can use uart, spi and twi. The timer functions
+ * must not be called from an interrupt.
+ */
+
+#define TIMER_SLOT(ms)		((ms) & (TIMER_WHEEL_SLOTS - 1))
+
+static struct timer *wheel[TIMER_WHEEL_SLOTS];
+static uint32_t processed_ms = 0; /* last millisecond visited by timer_process */
+
+/*
+ * internal functions
+ */
+
+/**
+ * timer_link - insert a timer into the slot of its expiry time
+ * @timer:	the timer to insert
+ */
+static void timer_link(struct timer *timer)
+{
+	struct timer **slot = &wheel[TIMER_SLOT(timer->expires)];
+	timer->prev = 0;
+	timer->next = *slot;
+	if (*slot != 0)	{
+		(*slot)->prev = timer;
+	}
+	*slot = timer;
+	timer->active = TRUE;
+}
+
+/**
+ * timer_unlink - remove a timer from its slot
+ * @timer:	the timer to remove
+ */
+static void timer_unlink(struct timer *timer)
+{
+	if (timer->prev != 0)	{
+		timer->prev->next = timer->next;
+	} else	{
+		wheel[TIMER_SLOT(timer->expires)] = timer->next;
+	}
+	if (timer->next != 0)	{
+		timer->next->prev = timer->prev;
+	}
+	timer->active = FALSE;
+}
+
+/*
+ * public functions
+ */
+
+/**
+ * timer_start - start or restart a software timer
+ * @timer:		the timer, must stay valid while it is active
+ * @delay_ms:	time until the first expiry, at least one millisecond
+ * @period_ms:	time between the following expiries, 0 for a one-shot timer
+ * @callback:	function executed at each expiry, may be 0 if only
+ *				timer_is_active() is used
+ */
+void timer_start(struct timer *timer, uint16_t delay_ms, uint16_t period_ms,
+		void (*callback)(void))
+{
+	if (timer->active == TRUE)	{
+		timer_unlink(timer);
+	}
+	if (delay_ms == 0)	{
+		delay_ms = 1;
+	}
+	timer->expires = main_get_time_ms() + delay_ms;
+	timer->period_ms = period_ms;
+	timer->callback = callback;
+	timer_link(timer);
+}
+
+/**
+ * timer_stop - stop a software timer, nothing happens if it is not active
+ * @timer:		the timer to stop
+ */
+void timer_stop(struct timer *timer)
+{
+	if (timer->active == TRUE)	{
+		timer_unlink(timer);
+	}
+}
+
+/**
+ * timer_is_active - check whether a timer is running
+ * @timer:		the timer to check
+ *
+ *		Return: TRUE if the timer is started and has not expired yet (or
+ *		is periodic), FALSE otherwise
+ */
+uint8_t timer_is_active(struct timer *timer)
+{
+	return timer->active;
+}
+
+/**
+ * timer_pending - check whether timer_process has work to do
+ *
+ *		Return: TRUE if at least one millisecond has elapsed since the last
+ *		call of timer_process, FALSE otherwise
+ */
+uint8_t timer_pending(void)
+{
+	return (main_get_time_ms() != processed_ms) ? TRUE : FALSE;
+}
+
+/**
+ * timer_process - expire all timers that are due
+ *
+ *		Called as task from the scheduler. If more than TIMER_WHEEL_SLOTS ms
+ *		have elapsed since the last call each slot is visited only once.
+ */
+void timer_process(void)
+{
+	uint32_t now = main_get_time_ms();
+	if (now - processed_ms > TIMER_WHEEL_SLOTS)	{
+		processed_ms = now - TIMER_WHEEL_SLOTS;
+	}
+
+	while (processed_ms != now)	{
+		processed_ms++;
+		struct timer *timer = wheel[TIMER_SLOT(processed_ms)];
+		while (timer != 0)	{
+			if ((int32_t)(processed_ms - timer->expires) < 0)	{
+				/* expires in a later round of the wheel */
+				timer = timer->next;
+				continue;
+			}
+			timer_unlink(timer);
+			if (timer->period_ms != 0)	{
+				timer->expires += timer->period_ms;
+				if ((int32_t)(timer->expires - processed_ms) <= 0)	{
+					timer->expires = processed_ms + timer->period_ms;
+				}
+				timer_link(timer);
+			}
+			if (timer->callback != 0)	{
+				timer->callback();
+			}
+			/*
+			 * the callback can start or stop other timers of this slot,
+			 * so begin again at the head of the slot
+			 */
+			timer = wheel[TIMER_SLOT(processed_ms)];
+		}
+	}
+}
@@ -0,0 +1,45 @@
+/*
+ *  timer.h - definitions for the software timer wheel
+ *  Copyright (C) 2016  Simon Kaufmann, HeKa
+ *
+ *  This file is part of ADRF transmitter firmware.
+ *
+ *  ADRF transmitter firmware is free software: you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ADRF transmitter firmware is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ADRF transmitter firmware.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#define TIMER_WHEEL_SLOTS	64 /* must be a power of two */
+
+/* one software timer, the memory is owned by the module using the timer */
+struct timer	{
+	struct timer *next;
+	struct timer *prev;
+	uint32_t expires; /* main_get_time_ms() when the timer expires */
+	uint16_t period_ms; /* 0 for a one-shot timer */
+	void (*callback)(void);
+	uint8_t active;
+};
+
+void timer_start(struct timer *timer, uint16_t delay_ms, uint16_t period_ms,
+		void (*callback)(void));
+void timer_stop(struct timer *timer);
+uint8_t timer_is_active(struct timer *timer);
+
+uint8_t timer_pending(void);
+void timer_process(void);
+
+#endif
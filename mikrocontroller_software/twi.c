@@ -20,12 +20,250 @@
  */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 #include <util/twi.h>
 
+#include "main.h"
+#include "pins.h"
+#include "uart.h"
 #include "twi.h"
 
+#define TWI_TIMEOUT_US		1000 /* maximum time for one byte or condition */
+#define TWI_IDLE_TIMEOUT_US	20000 /* maximum time for one queued transaction */
+#define TWI_RECOVERY_CLOCKS	9 /* clocks to free a slave holding sda low */
+
+/*
+ * scl = F_CPU / (16 + 2 * TWBR), the datasheet requires TWBR >= 10 in master
+ * mode, so at 8 MHz the bus runs at 222 kHz instead of 400 kHz
+ */
+#define TWI_SCL_HZ			400000UL
+#define TWI_TWBR_MIN		10
+#define TWI_TWBR			((F_CPU / TWI_SCL_HZ - 16) / 2)
+
+#define TWI_STOP_NONE		0 /* no stop condition outstanding */
+#define TWI_STOP_DUE		1 /* the finished transaction still needs a stop */
+#define TWI_STOP_SENT		2 /* stop requested, may still be on the bus */
+
 uint8_t twcr_init = 0; /* the initial set bits in the TWCR */
 
+/* queue of pending asynchronous transactions, queue[queue_head] is active */
+static struct twi_transaction *queue[TWI_QUEUE_LENGTH];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_count = 0;
+
+static volatile uint8_t async_active = FALSE; /* TWI_vect engine owns the bus */
+static volatile uint8_t sync_active = FALSE; /* blocking functions own the bus */
+static volatile uint8_t stop_state = TWI_STOP_NONE; /* stop after a queued transaction */
+
+static uint8_t write_index; /* next header/write byte of the active transaction */
+static uint8_t read_index; /* next read byte of the active transaction */
+
+static uint16_t timeouts = 0; /* number of waits for the twi module timed out */
+static uint16_t recoveries = 0; /* number of bus recoveries */
+static uint16_t retries = 0; /* number of repeated rtc/eeprom accesses */
+
+const char PROGMEM timeouts_msg[] = "TWI timeouts: ";
+const char PROGMEM recoveries_msg[] = ", recoveries: ";
+const char PROGMEM retries_msg[] = ", retries: ";
+
+/*
+ * internal functions
+ */
+
+/**
+ * twi_wait_twint - wait until the twi module has finished the current operation
+ *
+ *		If TWINT is not set after TWI_TIMEOUT_US the bus is recovered
+ *
+ *		Return: TWI_OK on success, TWI_ERR on timeout
+ */
+static uint8_t twi_wait_twint(void)
+{
+	uint16_t count = 0;
+	while (!(TWCR & (1 << TWINT)))	{
+		if (count >= TWI_TIMEOUT_US)	{
+			timeouts++;
+			twi_recover_bus();
+			return TWI_ERR;
+		}
+		_delay_us(1);
+		count++;
+	}
+	return TWI_OK;
+}
+
+/**
+ * twi_send_stop - send a stop condition and wait until it is transmitted
+ *
+ *		If the stop condition is not transmitted after TWI_TIMEOUT_US the
+ *		bus is recovered
+ */
+static void twi_send_stop(void)
+{
+	uint16_t count = 0;
+	TWCR = (1 << TWINT) | (1 << TWSTO) | twcr_init;
+	while (TWCR & (1 << TWSTO))	{
+		if (count >= TWI_TIMEOUT_US)	{
+			timeouts++;
+			twi_recover_bus();
+			break;
+		}
+		_delay_us(1);
+		count++;
+	}
+}
+
+/**
+ * twi_wait_stop - wait until the stop condition of a queued transaction is transmitted
+ *
+ *		TWI_vect does not wait for the stop condition (TWINT is not set
+ *		afterwards), so the next user of the bus waits for it. Mostly it is
+ *		transmitted long before. If it is not transmitted after
+ *		TWI_TIMEOUT_US the bus is recovered.
+ */
+static void twi_wait_stop(void)
+{
+	uint16_t count = 0;
+	if (stop_state != TWI_STOP_SENT)	{
+		return;
+	}
+	while (TWCR & (1 << TWSTO))	{
+		if (count >= TWI_TIMEOUT_US)	{
+			timeouts++;
+			twi_recover_bus();
+			break;
+		}
+		_delay_us(1);
+		count++;
+	}
+	stop_state = TWI_STOP_NONE;
+}
+
+/**
+ * twi_async_start_next - start the transaction at the head of the queue
+ *
+ *		Must be called with interrupts disabled, the bus has to be free. If
+ *		the transaction before still needs its stop condition, the twi
+ *		module sends the stop followed by the start, so TWI_vect does not
+ *		wait for the stop.
+ */
+static void twi_async_start_next(void)
+{
+	if (queue_count == 0 || async_active == TRUE || sync_active == TRUE)	{
+		return;
+	}
+	async_active = TRUE;
+	write_index = 0;
+	read_index = 0;
+	if (stop_state == TWI_STOP_DUE)	{
+		TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWSTA) | (1 << TWIE) | twcr_init;
+	} else	{
+		twi_wait_stop();
+		TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWIE) | twcr_init;
+	}
+	stop_state = TWI_STOP_NONE;
+}
+
+/**
+ * twi_async_complete - complete the active transaction
+ * @status:		TWI_OK or TWI_ERR, stored in the transaction
+ *
+ *		The callback of the transaction is executed and the next queued
+ *		transaction is started
+ */
+static void twi_async_complete(uint8_t status)
+{
+	struct twi_transaction *transaction = queue[queue_head];
+
+	queue_head = (queue_head + 1) % TWI_QUEUE_LENGTH;
+	queue_count--;
+	async_active = FALSE;
+
+	transaction->status = status;
+	if (transaction->callback != 0)	{
+		transaction->callback(transaction);
+	}
+	twi_async_start_next();
+}
+
+/**
+ * twi_async_finish - complete the active transaction and send stop condition
+ * @status:		TWI_OK or TWI_ERR, stored in the transaction
+ *
+ *		If the next transaction is started by twi_async_complete the stop
+ *		is sent together with its start. Otherwise the stop is requested
+ *		here and twi_wait_stop checks before the bus is used again.
+ */
+static void twi_async_finish(uint8_t status)
+{
+	stop_state = TWI_STOP_DUE;
+	twi_async_complete(status);
+	if (stop_state == TWI_STOP_DUE)	{
+		TWCR = (1 << TWINT) | (1 << TWSTO) | twcr_init;
+		stop_state = TWI_STOP_SENT;
+	}
+}
+
+/**
+ * twi_async_step - advance the active transaction by one bus event
+ *
+ *		Called from TWI_vect or from twi_wait_idle() when interrupts are
+ *		disabled. TWINT has to be set.
+ */
+static void twi_async_step(void)
+{
+	struct twi_transaction *transaction = queue[queue_head];
+	uint8_t write_length = transaction->header_length + transaction->write_length;
+
+	switch (TWSR & 0xF8)	{
+		case TW_START:
+		case TW_REP_START:
+			if (write_index < write_length)	{
+				TWDR = transaction->address & (~(1 << 0));
+			} else	{
+				TWDR = transaction->address | (1 << 0);
+			}
+			TWCR = (1 << TWINT) | (1 << TWIE) | twcr_init;
+			break;
+		case TW_MT_SLA_ACK:
+		case TW_MT_DATA_ACK:
+			if (write_index < transaction->header_length)	{
+				TWDR = transaction->header[write_index];
+			} else if (write_index < write_length)	{
+				TWDR = transaction->write_data[write_index - transaction->header_length];
+			} else if (transaction->read_length > 0)	{
+				TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWIE) | twcr_init;
+				break;
+			} else	{
+				twi_async_finish(TWI_OK);
+				break;
+			}
+			write_index++;
+			TWCR = (1 << TWINT) | (1 << TWIE) | twcr_init;
+			break;
+		case TW_MR_DATA_ACK:
+			transaction->read_data[read_index++] = TWDR;
+			/* no break */
+		case TW_MR_SLA_ACK:
+			if (read_index < (transaction->read_length - 1))	{
+				TWCR = (1 << TWINT) | (1 << TWEA) | (1 << TWIE) | twcr_init;
+			} else	{
+				TWCR = (1 << TWINT) | (1 << TWIE) | twcr_init;
+			}
+			break;
+		case TW_MR_DATA_NACK:
+			transaction->read_data[read_index] = TWDR;
+			twi_async_finish(TWI_OK);
+			break;
+		default:
+			/* nack from slave, arbitration lost or bus error */
+			twi_async_finish(TWI_ERR);
+			break;
+	}
+}
+
 /*
  * public functions
  */
@@ -35,9 +273,74 @@ uint8_t twcr_init = 0; /* the initial set bits in the TWCR */
  */
 void twi_init()
 {
-	TWBR = ((F_CPU / 100000) - 16) / 2; /* set the clock rate of TWI to 100 kHz */
+	twi_wait_idle();
+	TWBR = (TWI_TWBR < TWI_TWBR_MIN) ? TWI_TWBR_MIN : TWI_TWBR; /* set the clock rate of TWI */
 	TWSR = 0x00; /* set prescaler TWI */
 	twcr_init = (1 << TWEN);
+	if (!(TWI_PIN & (1 << TWI_SDA)))	{
+		/* a slave still holds sda low, e.g. after a brown-out */
+		twi_recover_bus();
+	}
+}
+
+/**
+ * twi_recover_bus - free the bus from a slave stuck in a transaction
+ *
+ *		The twi module is disabled and scl is clocked up to
+ *		TWI_RECOVERY_CLOCKS times until the slave releases sda, then a
+ *		stop condition is generated and the twi module is enabled again.
+ *		The pins are driven open drain by switching the data direction.
+ */
+void twi_recover_bus(void)
+{
+	uint8_t i;
+
+	TWCR = 0;
+	TWI_PORT &= ~((1 << TWI_SCL) | (1 << TWI_SDA));
+	TWI_DDR &= ~((1 << TWI_SCL) | (1 << TWI_SDA));
+	_delay_us(5);
+	for (i = 0; i < TWI_RECOVERY_CLOCKS && !(TWI_PIN & (1 << TWI_SDA)); i++)	{
+		TWI_DDR |= (1 << TWI_SCL);
+		_delay_us(5);
+		TWI_DDR &= ~(1 << TWI_SCL);
+		_delay_us(5);
+	}
+
+	/* stop condition: sda goes high while scl is high */
+	TWI_DDR |= (1 << TWI_SCL);
+	_delay_us(5);
+	TWI_DDR |= (1 << TWI_SDA);
+	_delay_us(5);
+	TWI_DDR &= ~(1 << TWI_SCL);
+	_delay_us(5);
+	TWI_DDR &= ~(1 << TWI_SDA);
+	_delay_us(5);
+
+	recoveries++;
+	stop_state = TWI_STOP_NONE;
+	TWCR = twcr_init;
+}
+
+/**
+ * twi_count_retry - count a repeated rtc or eeprom access for the statistics
+ */
+void twi_count_retry(void)
+{
+	retries++;
+}
+
+/**
+ * twi_print_stats - output the timeout, recovery and retry counters to uart
+ */
+void twi_print_stats(void)
+{
+	uart_send_text_flash((uint16_t)timeouts_msg);
+	uart_send_int(timeouts);
+	uart_send_text_flash((uint16_t)recoveries_msg);
+	uart_send_int(recoveries);
+	uart_send_text_flash((uint16_t)retries_msg);
+	uart_send_int(retries);
+	UART_NEWLINE();
 }
 
 /**
@@ -47,14 +350,29 @@ void twi_init()
  *		condition before with no stop condition afterwards
  *
  *		Start condition is transmitted if the last operation was a
- *		stop condition
+ *		stop condition. Before that the bus is claimed from the interrupt
+ *		driven engine, the check and the claim are atomic so that no
+ *		queued transaction can be started in between.
  *
  *		Return: TWI_OK on success, TWI_ERR on failure
  */
 uint8_t twi_start()
 {
+	uint8_t claimed = sync_active;
+	while (claimed == FALSE)	{
+		twi_wait_idle();
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)	{
+			if (async_active == FALSE)	{
+				sync_active = TRUE;
+				claimed = TRUE;
+			}
+		}
+	}
+	twi_wait_stop();
 	TWCR = (1 << TWINT) | (1 << TWSTA) | twcr_init;
-	while (!(TWCR & (1 << TWINT)));
+	if (twi_wait_twint() != TWI_OK)	{
+		return TWI_ERR;
+	}
 	if ((TWSR & 0xF8) != TW_START && (TWSR & 0xF8) != TW_REP_START)	{
 		return TWI_ERR;
 	}
@@ -79,7 +397,9 @@ uint8_t twi_send_slave_address(uint8_t rw, uint8_t address)
 		return TWI_ERR;
 	}
 	TWCR = (1 << TWINT) | twcr_init;
-	while (!(TWCR & (1 << TWINT)));
+	if (twi_wait_twint() != TWI_OK)	{
+		return TWI_ERR;
+	}
 	if (rw == TWI_WRITE)	{
 		if ((TWSR & 0xF8) != TW_MT_SLA_ACK)	{
 			return TWI_ERR;
@@ -105,7 +425,9 @@ uint8_t twi_send_byte(uint8_t byte)
 {
 	TWDR = byte;
 	TWCR = (1 << TWINT) | twcr_init;
-	while (!(TWCR & (1 << TWINT)));
+	if (twi_wait_twint() != TWI_OK)	{
+		return TWI_ERR;
+	}
 	if ((TWSR & 0xF8) != TW_MT_DATA_ACK)	{
 		return TWI_ERR;
 	}
@@ -132,7 +454,9 @@ uint8_t twi_read_byte(uint8_t ack, uint8_t* byte)
 	} else	{
 		return TWI_ERR;
 	}
-	while (!(TWCR & (1 << TWINT)));
+	if (twi_wait_twint() != TWI_OK)	{
+		return TWI_ERR;
+	}
 	if (ack == TWI_ACK)	{
 		if ((TWSR & 0xF8) != TW_MR_DATA_ACK)	{
 			return TWI_ERR;
@@ -148,10 +472,92 @@ uint8_t twi_read_byte(uint8_t ack, uint8_t* byte)
 
 /**
  * twi_stop - send a stop condition
+ *
+ *		Releases the bus for queued asynchronous transactions
  */
 void twi_stop()
 {
-		TWCR = (1<<TWINT) | (1<<TWSTO) | twcr_init;
-		while (TWCR & (1<<TWSTO));
+	twi_send_stop();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)	{
+		sync_active = FALSE;
+		twi_async_start_next();
+	}
+}
+
+/**
+ * twi_queue_transaction - queue a transaction for the interrupt driven engine
+ * @transaction:	the transaction to execute, must stay valid until its
+ *					status is not TWI_BUSY any more
+ *
+ *		The header bytes and write_data are sent first (if any), then
+ *		read_length bytes are read after a repeated start (if any). When
+ *		the transaction is finished its status is set to TWI_OK or TWI_ERR
+ *		and the callback (if not 0) is called from interrupt context.
+ *
+ *		Return: TWI_OK if queued, TWI_ERR if the queue is full
+ */
+uint8_t twi_queue_transaction(struct twi_transaction *transaction)
+{
+	uint8_t ret = TWI_ERR;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)	{
+		if (queue_count < TWI_QUEUE_LENGTH)	{
+			transaction->status = TWI_BUSY;
+			queue[(queue_head + queue_count) % TWI_QUEUE_LENGTH] = transaction;
+			queue_count++;
+			twi_async_start_next();
+			ret = TWI_OK;
+		}
+	}
+	return ret;
+}
+
+/**
+ * twi_is_idle - check whether all queued transactions are finished
+ *
+ *		Return: TRUE if the queue is empty, FALSE otherwise
+ */
+uint8_t twi_is_idle(void)
+{
+	return (queue_count == 0) ? TRUE : FALSE;
+}
+
+/**
+ * twi_wait_idle - wait until the interrupt driven engine has released the bus
+ *
+ *		If interrupts are disabled (e.g. inside of an ISR) the engine is
+ *		advanced by polling TWINT, otherwise TWI_vect does the work. If the
+ *		active transaction does not finish within TWI_IDLE_TIMEOUT_US it
+ *		is aborted with TWI_ERR and the bus is recovered.
+ */
+void twi_wait_idle(void)
+{
+	uint16_t count = 0;
+	while (async_active == TRUE)	{
+		if (!(SREG & (1 << SREG_I)) && (TWCR & (1 << TWINT)))	{
+			twi_async_step();
+		}
+		if (count >= TWI_IDLE_TIMEOUT_US)	{
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)	{
+				if (async_active == TRUE)	{
+					timeouts++;
+					twi_recover_bus();
+					twi_async_complete(TWI_ERR);
+				}
+			}
+			count = 0;
+		}
+		_delay_us(1);
+		count++;
+	}
+}
+
+/**
+ * ISR for the TWI interrupt
+ *
+ * advances the active asynchronous transaction
+ */
+ISR(TWI_vect)
+{
+	twi_async_step();
 }
 
@@ -24,6 +24,7 @@
 
 #define TWI_OK		0 /* do not change these values! is needed for rtc.c */
 #define TWI_ERR		1 /* do not change these values! is needed for rtc.c */
+#define TWI_BUSY	2 /* status of a queued transaction that is not finished */
 
 #define TWI_READ	0
 #define TWI_WRITE	1
@@ -31,7 +32,31 @@
 #define TWI_ACK		0
 #define TWI_NACK	1
 
+#define TWI_QUEUE_LENGTH	8 /* maximum number of queued transactions */
+#define TWI_HEADER_MAX		2 /* maximum number of register/memory address bytes */
+#define TWI_TRIES			3 /* attempts for one rtc or eeprom access */
+
+struct twi_transaction;
+
+typedef void (*twi_callback_t)(struct twi_transaction *transaction);
+
+/* one transaction for the interrupt driven engine */
+struct twi_transaction	{
+	uint8_t address; /* 7 bit slave address (from bit 7 to bit 1) */
+	uint8_t header[TWI_HEADER_MAX]; /* register or memory address to write first */
+	uint8_t header_length;
+	const uint8_t *write_data; /* written after the header */
+	uint8_t write_length;
+	uint8_t *read_data; /* read after a repeated start */
+	uint8_t read_length;
+	twi_callback_t callback; /* called from interrupt context when finished */
+	volatile uint8_t status; /* TWI_BUSY, then TWI_OK or TWI_ERR */
+};
+
 void twi_init(void);
+void twi_recover_bus(void);
+void twi_count_retry(void);
+void twi_print_stats(void);
 
 uint8_t twi_start(void); /* for start or repeated start condition */
 void twi_stop(void);
@@ -40,5 +65,9 @@ uint8_t twi_send_slave_address(uint8_t rw, uint8_t address);
 uint8_t twi_send_byte(uint8_t byte);
 uint8_t twi_read_byte(uint8_t ack, uint8_t* byte);
 
+uint8_t twi_queue_transaction(struct twi_transaction *transaction);
+uint8_t twi_is_idle(void);
+void twi_wait_idle(void);
+
 
 #endif
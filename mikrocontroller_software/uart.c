@@ -33,7 +33,7 @@
 #define UART_SEND_BUFFER_LENGTH		10
 
 #define UART_RECEIVE_BUFFER_NUMBER	30
-#define UART_RECEIVE_BUFFER_LENGTH	40
+#define UART_RECEIVE_BUFFER_LENGTH	48 /* "set secret" with 32 hex digits has to fit */
 
 /* uart send buffer types: */
 #define IN_BUFFER		0
@@ -412,6 +412,29 @@ uint8_t uart_send_int_hex(uint32_t val)	{
 	return TRUE;
 }
 
+/**
+ * uart_send_hex_byte - send one byte as two hexadecimal digits over uart
+ * @val: the byte to send
+ *
+ *		Unlike uart_send_int_hex the output is always two digits wide, so
+ *		several bytes can be sent back to back to form a hex dump
+ */
+void uart_send_hex_byte(uint8_t val)	{
+	char *str = (char *)uart_send_buffer[uart_send_buffer_count];
+	uint8_t nibble;
+
+	nibble = val >> 4;
+	str[0] = (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
+	nibble = val & 0x0f;
+	str[1] = (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
+	str[2] = '\0';
+
+	uart_send_buffer_type[uart_send_buffer_count][0] = 0;
+	uart_send_buffer_type[uart_send_buffer_count][1] = IN_BUFFER;
+
+	increment_uart_send_buffer();
+}
+
 /**
  * uart_receive_buffer_text - check if some data has been received and get the
  *							  latest received string
@@ -46,5 +46,6 @@ uint8_t uart_receive_buffer_text(char **text);
 
 uint8_t uart_send_int(uint32_t val);
 uint8_t uart_send_int_hex(uint32_t val);
+void uart_send_hex_byte(uint8_t val);
 
 #endif
@@ -20,7 +20,8 @@
  */
 
 #include <avr/io.h>
-#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <string.h>
 
 #include "uart.h"
 #include "rfid.h"
@@ -31,52 +32,179 @@
 #include "startup.h"
 #include "ext_eeprom.h"
 #include "pins.h"
+#include "twi.h"
+#include "siphash.h"
+#include "timer.h"
+#include "config.h"
 
-#define USER_READ_TIMEOUT_MS	4000 /* should be a multiple of TIMER1_MS in main.h */
-#define USER_RFID_LED_ON_MS		700 /* should be a multiple of TIMER1_MS in main.h */
+#define USER_READ_TIMEOUT_MS	4000
+#define USER_RFID_LED_ON_MS		700
+#define USER_RFID_LED_BLINK_MS	50
 
 #define TAG_ID_BLOCK	0x01
+#define TAG_ID_BLOCK_ULTRALIGHT	0x00
 #define TAG_ID_BYTE		0x00 /* stored with little endian in TAG_ID_BYTE and (TAG_ID_BYTE + 1) */
 #define TAG_ID_SIZE		0x02 /* in bytes */
+#define TAG_START_BYTE	0x02 /* start timestamp of start station, little endian */
+#define TAG_START_SIZE	0x04 /* in bytes */
+
+#define TIMESTAMP_DIVISOR	1	/* timestamp is in steps of TIMESTAMP_DIVISOR seconds */
 
 /*
- * fox secret is a number that is set in the fox so that you cannot imitate the
- * data which the fox writes onto the tag (at least if you do not know the secret)
+ * each fox has HISTORY_COPIES blocks on the tag (in the sector with the fox
+ * number). Every block is a complete copy of the history of the fox with a
+ * version number and a crc. A new history is always written to the block
+ * after the newest valid copy (copy-on-write). If the tag is removed during
+ * writing only this block is broken and the readers use the copy before.
+ *
+ * layout of a copy:
+ * byte 0:		version (incremented with each write, wraps around)
+ * byte 1-12:	packed entries, newest entry first
+ * byte 13-14:	mac (little endian)
+ * byte 15:		crc over byte 0-14
+ *
+ * mac: the lowest 16 bits of SipHash-2-4 with the secret key of the fox over
+ * the tag id (2 bytes, little endian), the fox number and byte 0-12 of the
+ * copy. Without the key nobody can write a valid copy, and a copy cannot be
+ * moved to another tag or fox. The key is not stored on the tag, so reading
+ * a tag does not reveal it.
  *
- * fox secret ist stored on tag in little endian!
+ * Only 16 bits of the mac fit into the copy besides the crc and the payload.
+ * The foxes never check the mac (they select copies by the crc and write
+ * only entries from their own history array), it is only checked by the pc
+ * software at the readout. So there is no oracle: a forged copy is accepted
+ * with probability 2^-16 and every failed attempt shows up at the readout.
+ *
+ * packed entries: every entry is the tag id followed by a time, both as
+ * varint (7 bits per byte, least significant group first, bit 7 set if
+ * another byte follows). The time of the first entry is the full timestamp,
+ * the time of each further entry is the difference to the timestamp of the
+ * entry before (which is newer). Small tag ids and the short times between
+ * two punches only need one or two bytes, so a block holds about twice as
+ * many entries as with fixed 16-bit fields and timestamps are not limited to
+ * 16 bits. Only complete entries are stored, the rest of the payload is
+ * zero. Tag id 0 is not allowed, so a zero byte ends the entries.
+ *
+ * pc_software/tag_history.py contains the same encoding for the pc side.
  */
-#define FOX_SECRET_BLOCK	0x01
-#define FOX_SECRET_ADDRESS(call)	(TAG_ID_BYTE + TAG_ID_SIZE + call * FOX_SECRET_SIZE)
-#define FOX_SECRET_SIZE	0x02 /* bytes */
-
-#define TIMESTAMP_DIVISOR	1	/* timestamp is in steps of TIMESTAMP_DIVISOR seconds */
+#define HISTORY_COPIES				3
+#define HISTORY_NO_COPY				0xff
+#define HISTORY_VERSION_BYTE		0
+#define HISTORY_PAYLOAD_BYTE		1
+#define HISTORY_PAYLOAD_END			13 /* first byte after the packed entries */
+#define HISTORY_MAC_BYTE			13
+#define HISTORY_MAC_MESSAGE_SIZE	16 /* tag id, fox number and byte 0-12 */
+#define HISTORY_CRC_BYTE			15
+#define HISTORY_CRC_INIT			0xff /* a block with only zeros is not a valid copy */
+
+#define VARINT_MAX_SIZE				5 /* bytes needed for 32 bit */
 
-#define HISTORY_BLOCKS				3
-#define HISTORY_ENTRY_SIZE			4		/* in bytes */
-#define HISTORY_ENTRIES_PER_BLOCK	4
-#define HISTORY_ENTRIES_MAX			12 //(HISTORY_BLOCKS * HISTORY_ENTRIES_PER_BLOCK)
-#define HISTORY_WRITE_MAX_TRIES		5
+/*
+ * entries in the history array and in the ext_eeprom: tag id (2 bytes) and
+ * timestamp (4 bytes), both little endian
+ */
+#define HISTORY_ENTRY_SIZE			6		/* in bytes */
+#define HISTORY_ENTRY_TAG_ID		0
+#define HISTORY_ENTRY_TIMESTAMP		2
+#define HISTORY_ENTRIES_MAX			12
+#define HISTORY_WRITE_MAX_TRIES		2 /* a broken write does not destroy the last copy, so do not try long */
 
-#define MIFARE_BLOCK_MIN	1
-#define MIFARE_BLOCK_MAX	15
+/*
+ * MIFARE Ultralight and NTAG21x tags have no sector trailers, so the tag id
+ * and the copies of all foxes are stored in consecutive blocks (of
+ * RFID_PAGES_PER_BLOCK pages each, see rfid.h): block 0 is the tag id, then
+ * HISTORY_COPIES blocks for each fox. This needs 64 user pages, so NTAG215
+ * or NTAG216 tags have to be used.
+ */
+#define ULTRALIGHT_BLOCK_MIN	1
+#if ULTRALIGHT_BLOCK_MIN + FOX_NUMBER_MAX * HISTORY_COPIES > RFID_ULTRALIGHT_BLOCKS
+#error "history does not fit into the user memory of the supported ultralight tags"
+#endif
 
 uint8_t history[HISTORY_ENTRIES_MAX][HISTORY_ENTRY_SIZE] = {{0}}; /* zero the array, refer to: http://stackoverflow.com/questions/5636070/zero-an-array-in-c-code */
 uint8_t history_pointer_write = 0; /* points to next place that should be written in history array */
 
 #define EXT_EEPROM_ENTRY_SIZE		HISTORY_ENTRY_SIZE
-#define EXT_EEPROM_START_ADDRESS	10 /* some addresses free for things that might have to be stored additionally */
 #define EXT_EEPROM_WRITE_POINTER_ADDRESS	0 /* this is address of the pointer in ext_eeprom that shows address of next free element */
 #define EXT_EEPROM_WRITE_POINTER_SIZE		2 /* bytes */
 #define EXT_EEPROM_MAX_ADDRESS				65535
 
-uint16_t EEMEM secret;
+/*
+ * tag index in ext_eeprom: hash table with one slot for each tag id that
+ * was found by this fox. A slot stores the tag id, the ext_eeprom address of
+ * the first and of the last history entry of this tag and the number of
+ * entries. The slot of a tag id is tag_id % EXT_EEPROM_INDEX_SLOTS, on a
+ * collision the next slot is used (linear probing). Tag ids are mostly given
+ * in ascending order, so there are hardly any collisions.
+ *
+ * Tag id 0 is not allowed (see user_set_id), therefore tag id 0 marks an
+ * empty slot. The index is cleared by user_clear_history.
+ */
+#define EXT_EEPROM_INDEX_ADDRESS	128 /* first page is kept free for the write pointer and further settings */
+#define EXT_EEPROM_INDEX_SLOTS		512 /* must be a power of two */
+#define EXT_EEPROM_INDEX_SLOT_SIZE	8 /* bytes, slots do not cross eeprom pages */
+#define EXT_EEPROM_INDEX_SIZE		(EXT_EEPROM_INDEX_SLOTS * EXT_EEPROM_INDEX_SLOT_SIZE)
+#define INDEX_SLOT_TAG_ID	0
+#define INDEX_SLOT_FIRST	2
+#define INDEX_SLOT_LAST		4
+#define INDEX_SLOT_COUNT	6
+#define INDEX_EMPTY_TAG_ID	0x0000
+#define INDEX_CLEAR_CHUNK	32 /* bytes written at once when clearing the index */
+
+#define INDEX_FOUND		0
+#define INDEX_NEW		1 /* tag id is not in index, slot address points to free slot */
+#define INDEX_FULL		2 /* tag id is not in index and there is no free slot */
+#define INDEX_ERR		3
+
+#define EXT_EEPROM_START_ADDRESS	(EXT_EEPROM_INDEX_ADDRESS + EXT_EEPROM_INDEX_SIZE)
+
+/*
+ * recently punched tags: a tag that is punched again within the re-punch
+ * window is only acknowledged with the led, without writing the tag or the
+ * ext_eeprom. The list is ordered by use, index 0 is the tag used last and
+ * the least recently used tag is dropped when a new tag is added.
+ */
+#define RECENT_TAGS_MAX				8
+
+uint16_t recent_tag_ids[RECENT_TAGS_MAX];
+uint32_t recent_tag_times[RECENT_TAGS_MAX]; /* main_get_time_ms of the last written punch */
+uint8_t recent_tags_count = 0;
+
+/*
+ * compact readout: instead of the decoded text user_read_tag sends one line
+ * per tag, which is tag_record_msg followed by the hex dump of the record:
+ * byte 0-1:	tag id (little endian)
+ * byte 2-5:	start timestamp written by a start station (little endian)
+ * then RFID_BLOCK_SIZE bytes for each fox from FOX_NUMBER_FIRST to
+ * FOX_NUMBER_MAX with the newest valid copy of its history (see above)
+ * last byte:	crc over all bytes before, to detect transmission errors
+ *
+ * pc_software/tag_history.py decodes the record.
+ */
+#define RECORD_CRC_INIT		0xff
+
+/*
+ * station mode: a fox station adds punches to the history of the tags, a
+ * start station clears the history of all foxes on the tags and stores the
+ * start time in the tag id block, a registration station writes the tag ids
+ * from the id queue to successive tags. A tag whose id was written or started
+ * within the re-punch window is not written again.
+ */
+
+#define ID_QUEUE_MAX	32
+uint16_t id_queue[ID_QUEUE_MAX];
+uint8_t id_queue_read = 0;	/* index of the next id to write */
+uint8_t id_queue_count = 0;
+
 
 uint8_t is_started = FALSE;
 uint8_t write_id = FALSE;
 uint16_t next_write_id = 0x00;
 
-volatile uint8_t read_timeout = TRUE;
-volatile uint8_t rfid_led_on = FALSE;
+uint8_t read_timeout = TRUE;
+static struct timer read_timeout_timer;
+static struct timer rfid_led_timer; /* toggles the rfid led */
+static struct timer rfid_led_off_timer;
 
 const char PROGMEM tag_id[] = "Tag ID: ";
 const char PROGMEM fox1[] = "Fox 1";
@@ -85,16 +213,24 @@ const char PROGMEM fox3[] = "Fox 3";
 const char PROGMEM fox4[] = "Fox 4";
 const char PROGMEM fox5[] = "Fox 5";
 
-const char PROGMEM secret_msg[] = " Secret: ";
+const char PROGMEM mac_msg[] = " MAC: ";
 const char PROGMEM history_msg[] = ": ";
+const char PROGMEM data_msg[] = " Data: ";
 const char PROGMEM tag_msg[] = "Tag ID: ";
 const char PROGMEM timestamp_msg[] = " Timestamp: ";
 const char PROGMEM tag_read_begin_msg[] = "--- NEW TAG 0x55005500 ---";
 const char PROGMEM tag_read_end_msg[] = "--- END TAG 0x55005500 ---";
 const char PROGMEM tag_read_error_msg[] = "--- ERROR TAG 0x55005500 ---";
+const char PROGMEM tag_record_msg[] = "--- TAG RECORD 0x55005500 --- ";
 const char PROGMEM history_written_msg[] = "History written\r\n";
+const char PROGMEM start_written_msg[] = "Start written tag id: ";
+const char PROGMEM start_timestamp_msg[] = "Start timestamp: ";
 const char PROGMEM eeprom_read_begin_msg[] = "--- BEGIN FOX HISTORY 0x66006600 ---";
 const char PROGMEM eeprom_read_end_msg[] = "--- END FOX HISTORY 0x66006600 ---";
+const char PROGMEM query_not_found_msg[] = " not found";
+const char PROGMEM query_count_msg[] = " Punches: ";
+const char PROGMEM query_first_msg[] = " First timestamp: ";
+const char PROGMEM query_last_msg[] = " Last timestamp: ";
 
 const char PROGMEM write_tag_id_error_msg[] = "writing tag id failed, maybe tag is write protected with access key";
 
@@ -114,38 +250,43 @@ const PGM_P read_tag_msg[] =	{
  */
 
 /**
- * user_rfid_led_on - register rfid led as on (blinking) to indicate ready rfid operation
- *
- *		Blinking is done with user_time_tick function
+ * user_rfid_led_toggle - toggle the rfid led, callback of rfid_led_timer
  */
-static void user_rfid_led_on(void)
+static void user_rfid_led_toggle(void)
 {
-	RFID_LED_ON();
-	rfid_led_on = TRUE;
+	RFID_LED_TOGGLE();
 }
 
 /**
- * user_get_rfid_led - returns if user_rfid_led_on or user_rfid_led_off was last called
- *
- *		Function is needed for user_time_tick to determine if it should blink or not!
+ * user_rfid_led_off - stop blinking of the rfid led
  *
- *		Return: TRUE if user_rfid_led_on was called last, FALSE if user_rfid_led_off
- *		was called last
+ *		Callback of rfid_led_off_timer
  */
-static uint8_t user_get_rfid_led(void)
+static void user_rfid_led_off(void)
 {
-	return rfid_led_on;
+	timer_stop(&rfid_led_timer);
+	RFID_LED_OFF();
 }
 
 /**
- * user_rfid_led_off - register rfid_led as off
+ * user_rfid_led_on - let the rfid led blink to indicate ready rfid operation
  *
- *		Tells user_time_tick function that rfid led should not blink any more
+ *		The led blinks for USER_RFID_LED_ON_MS
  */
-static void user_rfid_led_off(void)
+static void user_rfid_led_on(void)
 {
-	RFID_LED_OFF();
-	rfid_led_on = FALSE;
+	RFID_LED_ON();
+	timer_start(&rfid_led_timer, USER_RFID_LED_BLINK_MS, USER_RFID_LED_BLINK_MS,
+			user_rfid_led_toggle);
+	timer_start(&rfid_led_off_timer, USER_RFID_LED_ON_MS, 0, user_rfid_led_off);
+}
+
+/**
+ * user_read_timeout_expired - callback of read_timeout_timer
+ */
+static void user_read_timeout_expired(void)
+{
+	read_timeout = TRUE;
 }
 
 /**
@@ -165,11 +306,18 @@ static uint8_t user_get_read_timeout(void)
  *			 tag if it is last read tag
  *
  *		If read_timeout is set to true, a tag will also be read if it was the
- *		last tag
+ *		last tag. If it is set to false, it is set to true again after
+ *		USER_READ_TIMEOUT_MS.
  */
 static void user_set_read_timeout(uint8_t timeout)
 {
 	read_timeout = timeout;
+	if (timeout == FALSE)	{
+		timer_start(&read_timeout_timer, USER_READ_TIMEOUT_MS, 0,
+				user_read_timeout_expired);
+	} else	{
+		timer_stop(&read_timeout_timer);
+	}
 }
 
 /**
@@ -180,18 +328,21 @@ static void user_set_read_timeout(uint8_t timeout)
  */
 static uint16_t user_get_ext_eeprom_pointer(void)
 {
-	uint8_t byte;
-	ext_eeprom_read_byte(EXT_EEPROM_WRITE_POINTER_ADDRESS, &byte);
-	return byte;
+	uint16_t pointer;
+	ext_eeprom_read_word(EXT_EEPROM_WRITE_POINTER_ADDRESS, &pointer);
+	return pointer;
 }
 
 /**
  * user_set_ext_eeprom_pointer - write ext_eeprom pointer
  * @pointer:	the value that the pointer should be set to
+ *
+ *		The pointer is written in the background (see ext_eeprom_queue_write)
  */
 static void user_set_ext_eeprom_pointer(uint16_t pointer)
 {
-	ext_eeprom_write_byte(EXT_EEPROM_WRITE_POINTER_ADDRESS, pointer);
+	ext_eeprom_queue_write((uint8_t *)&pointer, EXT_EEPROM_WRITE_POINTER_ADDRESS,
+			EXT_EEPROM_WRITE_POINTER_SIZE);
 }
 
 /**
@@ -199,12 +350,123 @@ static void user_set_ext_eeprom_pointer(uint16_t pointer)
  */
 static void user_reset_ext_eeprom_pointer(void)
 {
-	ext_eeprom_write_byte(EXT_EEPROM_WRITE_POINTER_ADDRESS, EXT_EEPROM_START_ADDRESS);
+	ext_eeprom_write_word(EXT_EEPROM_WRITE_POINTER_ADDRESS, EXT_EEPROM_START_ADDRESS);
+}
+
+/**
+ * user_index_find - search the slot of a tag id in the tag index
+ * @tag_id:		tag id to search for
+ * @slot_addr:	pointer where the ext_eeprom address of the slot is stored
+ * @slot:		pointer to buffer with EXT_EEPROM_INDEX_SLOT_SIZE bytes where
+ *				the content of the slot is stored
+ *
+ *		Return: INDEX_FOUND if tag id is in index, INDEX_NEW if tag id is
+ *		not in index (slot_addr is the free slot for this tag id), INDEX_FULL
+ *		if tag id is not in index and no slot is free, INDEX_ERR if ext_eeprom
+ *		could not be read
+ */
+static uint8_t user_index_find(uint16_t tag_id, uint16_t *slot_addr, uint8_t *slot)
+{
+	uint16_t i;
+	uint16_t slot_num = tag_id & (EXT_EEPROM_INDEX_SLOTS - 1);
+	for (i = 0; i < EXT_EEPROM_INDEX_SLOTS; i++)	{
+		*slot_addr = EXT_EEPROM_INDEX_ADDRESS + slot_num * EXT_EEPROM_INDEX_SLOT_SIZE;
+		if (ext_eeprom_read_block(slot, *slot_addr, EXT_EEPROM_INDEX_SLOT_SIZE) != TWI_OK)	{
+			return INDEX_ERR;
+		}
+		uint16_t slot_tag_id = slot[INDEX_SLOT_TAG_ID] | (slot[INDEX_SLOT_TAG_ID + 1] << 8);
+		if (slot_tag_id == tag_id)	{
+			return INDEX_FOUND;
+		}
+		if (slot_tag_id == INDEX_EMPTY_TAG_ID)	{
+			return INDEX_NEW;
+		}
+		slot_num = (slot_num + 1) & (EXT_EEPROM_INDEX_SLOTS - 1);
+	}
+	return INDEX_FULL;
+}
+
+/**
+ * user_index_add - register a new history entry in the tag index
+ * @tag_id:		tag id of the history entry
+ * @entry_addr:	ext_eeprom address of the history entry
+ *
+ *		The slot is written in the background (see ext_eeprom_queue_write)
+ */
+static void user_index_add(uint16_t tag_id, uint16_t entry_addr)
+{
+	uint16_t slot_addr;
+	uint8_t slot[EXT_EEPROM_INDEX_SLOT_SIZE];
+	uint8_t ret = user_index_find(tag_id, &slot_addr, slot);
+	if (ret == INDEX_NEW)	{
+		slot[INDEX_SLOT_TAG_ID] = tag_id & 0xff;
+		slot[INDEX_SLOT_TAG_ID + 1] = tag_id >> 8;
+		slot[INDEX_SLOT_FIRST] = entry_addr & 0xff;
+		slot[INDEX_SLOT_FIRST + 1] = entry_addr >> 8;
+		slot[INDEX_SLOT_LAST] = entry_addr & 0xff;
+		slot[INDEX_SLOT_LAST + 1] = entry_addr >> 8;
+		slot[INDEX_SLOT_COUNT] = 1;
+		slot[INDEX_SLOT_COUNT + 1] = 0;
+		ext_eeprom_queue_write(slot, slot_addr, EXT_EEPROM_INDEX_SLOT_SIZE);
+	} else if (ret == INDEX_FOUND)	{
+		uint16_t count = slot[INDEX_SLOT_COUNT] | (slot[INDEX_SLOT_COUNT + 1] << 8);
+		if (count < 0xffff)	{
+			count++;
+		}
+		slot[INDEX_SLOT_LAST] = entry_addr & 0xff;
+		slot[INDEX_SLOT_LAST + 1] = entry_addr >> 8;
+		slot[INDEX_SLOT_COUNT] = count & 0xff;
+		slot[INDEX_SLOT_COUNT + 1] = count >> 8;
+		/* only last and count have changed */
+		ext_eeprom_queue_write(slot + INDEX_SLOT_LAST, slot_addr + INDEX_SLOT_LAST,
+				EXT_EEPROM_INDEX_SLOT_SIZE - INDEX_SLOT_LAST);
+	}
+#ifdef DEBUG_WRITE_HISTORY
+	else	{
+		uart_send_text_sram("tag index not updated");
+		UART_NEWLINE();
+	}
+#endif
+}
+
+/**
+ * user_index_clear - mark all slots of the tag index as empty
+ */
+static void user_index_clear(void)
+{
+	uint8_t buffer[INDEX_CLEAR_CHUNK] = {0};
+	uint16_t addr;
+	for (addr = EXT_EEPROM_INDEX_ADDRESS; addr < EXT_EEPROM_START_ADDRESS; addr += INDEX_CLEAR_CHUNK)	{
+		ext_eeprom_write_block(buffer, addr, INDEX_CLEAR_CHUNK);
+	}
+}
+
+/**
+ * user_check_ext_eeprom_pointer - reset the log if the pointer is not valid
+ *
+ *		A valid pointer lies in the log area and on an entry boundary. This
+ *		is not the case for an erased ext_eeprom and usually not for one
+ *		written by firmware with a one byte pointer, whose log started at
+ *		the beginning of the ext_eeprom. Then the log and the index are
+ *		cleared, so an old log is discarded.
+ */
+static void user_check_ext_eeprom_pointer(void)
+{
+	uint16_t pointer;
+	if (ext_eeprom_read_word(EXT_EEPROM_WRITE_POINTER_ADDRESS, &pointer) != TWI_OK)	{
+		return;
+	}
+	if (pointer < EXT_EEPROM_START_ADDRESS
+			|| pointer > EXT_EEPROM_MAX_ADDRESS - EXT_EEPROM_ENTRY_SIZE + 1
+			|| (pointer - EXT_EEPROM_START_ADDRESS) % EXT_EEPROM_ENTRY_SIZE != 0)	{
+		user_reset_ext_eeprom_pointer();
+		user_index_clear();
+	}
 }
 
 /**
  * get_history_block_physical - returns the block number on rfid tag for history
- * @block_logical:	the block number for history between 0 and (HISTORY_BLOCKS - 1)
+ * @block_logical:	the block number for history between 0 and (HISTORY_COPIES - 1)
  * @num:			fox number
  *
  *		The physical blocks on mifare tag depend on the the fox number. This
@@ -221,6 +483,9 @@ static uint8_t get_history_block_physical(uint8_t block_logical, uint8_t num)
 	if (num == 0)	{
 		num = 1;
 	}
+	if (rfid_get_tag_type() == RFID_TAG_ULTRALIGHT)	{
+		return ULTRALIGHT_BLOCK_MIN + (num - 1) * HISTORY_COPIES + block_logical;
+	}
 	uint8_t base_block = (num - 1) * 4 + 4;
 	return base_block + block_logical + block_logical / 3;
 	/*
@@ -230,86 +495,90 @@ static uint8_t get_history_block_physical(uint8_t block_logical, uint8_t num)
 }
 
 /**
- * calculate_timediff - calculates the difference between two times
- * time1: pointer to array with time values (second, minute, hour, date)
- * time2: pointer to array with time values (second, minute, hour, date)
- * len:   length of array because array can also be shorter -> e.g. no year given!)
- *
- *		Note: Calculates the difference time2 - time1, therefore time2 should
- *		be greater than time1
- *		The function does not read month and year. The two times should be in same
- *		month and year because otherwise difference calculation would be complicated
+ * get_tag_id_block - returns the block number of the tag id on the rfid tag
  *
- *		Return: the difference in seconds
+ *		Return: TAG_ID_BLOCK_ULTRALIGHT for ultralight tags, TAG_ID_BLOCK
+ *		otherwise
  */
-static uint16_t calculate_timediff(uint8_t *time1, uint8_t *time2, uint8_t len)
+static uint8_t get_tag_id_block(void)
+{
+	if (rfid_get_tag_type() == RFID_TAG_ULTRALIGHT)	{
+		return TAG_ID_BLOCK_ULTRALIGHT;
+	}
+	return TAG_ID_BLOCK;
+}
+
+/**
+ * history_get_tag_id - get tag id of an entry of the history array or ext_eeprom
+ * @entry:	pointer to the HISTORY_ENTRY_SIZE bytes of the entry
+ */
+static uint16_t history_get_tag_id(uint8_t *entry)
+{
+	return entry[HISTORY_ENTRY_TAG_ID] | (entry[HISTORY_ENTRY_TAG_ID + 1] << 8);
+}
+
+/**
+ * history_get_timestamp - get timestamp of an entry of the history array or ext_eeprom
+ * @entry:	pointer to the HISTORY_ENTRY_SIZE bytes of the entry
+ */
+static uint32_t history_get_timestamp(uint8_t *entry)
 {
 	uint8_t i;
-	int32_t diff = 0; /* 32 bit to be sure that there is no overflow! */
-	if (len > RTC_DATE + 1)	{
-		len = RTC_DATE + 1;
-	}
-	for (i = len - 1; i >= 0 && i < len; i--)	{
-		diff = diff + (time2[i] - time1[i]);
-		switch (i)	{
-			case (RTC_DATE):
-				diff *= 24;
-				break;
-			case (RTC_HOUR):
-				diff *= 60;
-				break;
-			case (RTC_MINUTE):
-				diff *= 60;
-				break;
-		}
+	uint32_t timestamp = 0;
+	for (i = 0; i < 4; i++)	{
+		timestamp |= (uint32_t)entry[HISTORY_ENTRY_TIMESTAMP + i] << (8 * i);
+	}
+	return timestamp;
+}
+
+/**
+ * user_get_timestamp - get the current time as timestamp
+ *
+ *		The time is read with one burst read and compared as seconds since
+ *		2000, so events can also go over the end of a month or year
+ *
+ *		Return: the seconds since the start time of the event, 0 if the
+ *		rtc can not be read or the start time is not reached
+ */
+static uint32_t user_get_timestamp(void)
+{
+	uint8_t time[RTC_TIME_MAX + 1];
+	uint32_t now;
+	uint32_t start = startup_get_start_seconds();
+
+	if (rtc_get_time_all(time) != TWI_OK)	{
+		return 0;
 	}
-	if (diff < 0)	{
-		diff = 0; /* time2 was smaller than time1, maybe because there was a month overflow */
+	now = rtc_time_to_seconds(time);
+	if (now < start)	{
+		return 0; /* punch before the start time */
 	}
-	return diff / TIMESTAMP_DIVISOR;
+	return (now - start) / TIMESTAMP_DIVISOR;
 }
 
 /**
  * user_add_to_history - add user to the history of fox in ram
  * tag_id: tag id that should be added to history
  *
- *		Transponder is only added to history if it does not have
- *		the same id as the last transponder in history
+ *		Every call adds an entry, repeated punches are already filtered
+ *		by the re-punch window (see recent_tags_check)
  */
 static void user_add_to_history(uint16_t tag_id)
 {
-	uint8_t history_pointer_write_temp = history_pointer_write;
-	if (history_pointer_write_temp == 0)	{
-		history_pointer_write_temp = HISTORY_ENTRIES_MAX;
-	} else {
-		history_pointer_write_temp--;
-	}
-	if (history[history_pointer_write_temp][0] == (tag_id & 0xff) &&
-		history[history_pointer_write_temp][1] == (tag_id >> 8))	{
-#ifdef DEBUG_WRITE_HISTORY
-		uart_send_text_sram("already in history");
-		UART_NEWLINE();
-#endif
-		return; /* do not add to history if tag id is the same as last tag id */
-	}
-
 	uint8_t i;
-	uint8_t time[RTC_DATE - RTC_SECOND + 1];
-	uint8_t start_time[STARTUP_DATE - STARTUP_SECOND + 1];
-	for (i = RTC_SECOND; i <= RTC_DATE; i++)	{
-		rtc_get_time(i, time + i - RTC_SECOND);
-		start_time[i - RTC_SECOND] = startup_get_start_time(i);
-	}
+	uint32_t timestamp = user_get_timestamp();
 
-	uint16_t timestamp = calculate_timediff(start_time, time, STARTUP_DATE - STARTUP_SECOND + 1);
-
-	history[history_pointer_write][0] = tag_id & 0xff;
-	history[history_pointer_write][1] = tag_id >> 8;
-	history[history_pointer_write][2] = timestamp & 0xff;
-	history[history_pointer_write][3] = timestamp >> 8;
+	uint8_t *entry = history[history_pointer_write];
+	entry[HISTORY_ENTRY_TAG_ID] = tag_id & 0xff;
+	entry[HISTORY_ENTRY_TAG_ID + 1] = tag_id >> 8;
+	for (i = 0; i < 4; i++)	{
+		entry[HISTORY_ENTRY_TIMESTAMP + i] = timestamp >> (8 * i);
+	}
 
 	uint16_t ext_eeprom_pointer = user_get_ext_eeprom_pointer();
-	ext_eeprom_write_block(history[history_pointer_write], ext_eeprom_pointer, EXT_EEPROM_ENTRY_SIZE);
+	/* the log entry, the index and the pointer are written in the background */
+	ext_eeprom_queue_write(history[history_pointer_write], ext_eeprom_pointer, EXT_EEPROM_ENTRY_SIZE);
+	user_index_add(tag_id, ext_eeprom_pointer);
 	if (ext_eeprom_pointer <= (EXT_EEPROM_MAX_ADDRESS - 2 * EXT_EEPROM_ENTRY_SIZE))	{
 		ext_eeprom_pointer += EXT_EEPROM_ENTRY_SIZE;
 		user_set_ext_eeprom_pointer(ext_eeprom_pointer);
@@ -322,63 +591,311 @@ static void user_add_to_history(uint16_t tag_id)
 }
 
 /**
- * user_write_history - write history to current tag
+ * varint_size - number of bytes needed to store a value as varint
+ * @val:	the value
+ */
+static uint8_t varint_size(uint32_t val)
+{
+	uint8_t size = 1;
+	while (val >= 0x80)	{
+		val >>= 7;
+		size++;
+	}
+	return size;
+}
+
+/**
+ * varint_put - store a value as varint
+ * @buffer:	pointer where the varint is stored, must have space for
+ *			varint_size(val) bytes
+ * @val:	the value to store
  *
- *		Return: TRUE on success, FALSE on failure
+ *		Return: number of bytes written
  */
-static uint8_t user_write_history(void)
+static uint8_t varint_put(uint8_t *buffer, uint32_t val)
 {
-	uint8_t ret = STATUS_OK;
+	uint8_t i = 0;
+	while (val >= 0x80)	{
+		buffer[i++] = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	buffer[i++] = val;
+	return i;
+}
 
-	uint8_t block_temp_length = RFID_BLOCK_SIZE + 2;
-	uint8_t block_temp[block_temp_length];
-	uint8_t i, j, k;
-	uint8_t temp_pointer_write = history_pointer_write;
-	uint8_t tries = 0;
+/**
+ * varint_get - read a varint
+ * @buffer:	pointer to the varint
+ * @len:	number of bytes that may be read from buffer
+ * @val:	pointer where the value is stored
+ *
+ *		Return: number of bytes read, 0 if the varint is not complete or
+ *		too long
+ */
+static uint8_t varint_get(uint8_t *buffer, uint8_t len, uint32_t *val)
+{
+	uint8_t i;
+	*val = 0;
+	for (i = 0; i < len && i < VARINT_MAX_SIZE; i++)	{
+		*val |= (uint32_t)(buffer[i] & 0x7f) << (7 * i);
+		if ((buffer[i] & 0x80) == 0)	{
+			return i + 1;
+		}
+	}
+	return 0;
+}
 
-	for (i = 0; i < HISTORY_BLOCKS; i++)	{
-		for (j = 0; j < HISTORY_ENTRIES_PER_BLOCK; j++)	{
-			if (temp_pointer_write == 0)	{
-				temp_pointer_write = HISTORY_ENTRIES_MAX - 1;
-			} else {
-				temp_pointer_write--;
-			}
-			for (k = 0; k < HISTORY_ENTRY_SIZE; k++)	{
-				block_temp[j * HISTORY_ENTRY_SIZE + k] = history[temp_pointer_write][k];
+/**
+ * history_encode - pack the newest entries of the history array into a copy
+ * @block:	pointer to the RFID_BLOCK_SIZE bytes of the copy, only the payload
+ *			bytes are changed
+ *
+ *		Entries are added newest first as long as they fit completely into
+ *		the payload. Empty entries and entries that are newer than the entry
+ *		before (history was cleared in between) end the history.
+ *
+ *		Return: number of entries stored in the copy
+ */
+static uint8_t history_encode(uint8_t *block)
+{
+	uint8_t pos = HISTORY_PAYLOAD_BYTE;
+	uint8_t pointer = history_pointer_write;
+	uint8_t count = 0;
+	uint32_t timestamp_newer = 0;
+	uint8_t i;
+
+	for (i = HISTORY_PAYLOAD_BYTE; i < HISTORY_PAYLOAD_END; i++)	{
+		block[i] = 0;
+	}
+	for (i = 0; i < HISTORY_ENTRIES_MAX; i++)	{
+		if (pointer == 0)	{
+			pointer = HISTORY_ENTRIES_MAX - 1;
+		} else {
+			pointer--;
+		}
+		uint16_t tag_id = history_get_tag_id(history[pointer]);
+		uint32_t timestamp = history_get_timestamp(history[pointer]);
+		uint32_t time = timestamp;
+		if (tag_id == 0)	{
+			break;
+		}
+		if (count > 0)	{
+			if (timestamp > timestamp_newer)	{
+				break;
 			}
+			time = timestamp_newer - timestamp;
+		}
+		if (pos + varint_size(tag_id) + varint_size(time) > HISTORY_PAYLOAD_END)	{
+			break;
 		}
-		ret = rfid_write_block(get_history_block_physical(i, morse_get_fox_number()), block_temp, RFID_BLOCK_SIZE);
+		pos += varint_put(block + pos, tag_id);
+		pos += varint_put(block + pos, time);
+		timestamp_newer = timestamp;
+		count++;
+	}
+	return count;
+}
+
+/**
+ * history_decode_next - unpack the next entry of a copy
+ * @block:		pointer to the RFID_BLOCK_SIZE bytes of the copy
+ * @pos:		pointer to the position of the next entry, has to be set to
+ *				HISTORY_PAYLOAD_BYTE before the first call
+ * @tag_id:		pointer where the tag id of the entry is stored
+ * @timestamp:	pointer where the timestamp of the entry is stored, has to
+ *				hold the timestamp of the entry before between the calls
+ *
+ *		Return: TRUE if an entry was read, FALSE if there are no more entries
+ */
+static uint8_t history_decode_next(uint8_t *block, uint8_t *pos, uint16_t *tag_id, uint32_t *timestamp)
+{
+	uint32_t id, time;
+	uint8_t size;
+
+	if (*pos >= HISTORY_PAYLOAD_END || block[*pos] == 0)	{
+		return FALSE;
+	}
+	size = varint_get(block + *pos, HISTORY_PAYLOAD_END - *pos, &id);
+	if (size == 0 || id > 0xffff)	{
+		return FALSE;
+	}
+	uint8_t first = (*pos == HISTORY_PAYLOAD_BYTE);
+	*pos += size;
+	size = varint_get(block + *pos, HISTORY_PAYLOAD_END - *pos, &time);
+	if (size == 0)	{
+		return FALSE;
+	}
+	*pos += size;
+
+	*tag_id = id;
+	if (first)	{
+		*timestamp = time;
+	} else {
+		*timestamp -= time;
+	}
+	return TRUE;
+}
+
+/**
+ * history_crc - calculate crc of a history copy
+ * @block:	pointer to the 16 bytes of the copy
+ *
+ *		Return: crc over all bytes of the copy before HISTORY_CRC_BYTE
+ */
+static uint8_t history_crc(uint8_t *block)
+{
+	uint8_t i;
+	uint8_t crc = HISTORY_CRC_INIT;
+	for (i = 0; i < HISTORY_CRC_BYTE; i++)	{
+		crc = _crc_ibutton_update(crc, block[i]);
+	}
+	return crc;
+}
+
+/**
+ * history_mac - calculate the mac of a history copy
+ * @block:	pointer to the RFID_BLOCK_SIZE bytes of the copy, byte 0-12 are used
+ * @tag_id:	tag id of the tag the copy is written to
+ * @num:	fox number
+ *
+ *		Return: the lowest 16 bits of SipHash-2-4 with the secret key
+ */
+static uint16_t history_mac(uint8_t *block, uint16_t tag_id, uint8_t num)
+{
+	uint8_t key[SIPHASH_KEY_SIZE];
+	uint8_t message[HISTORY_MAC_MESSAGE_SIZE];
+	uint8_t i;
+
+	user_get_secret(key);
+	message[0] = tag_id & 0xff;
+	message[1] = tag_id >> 8;
+	message[2] = num;
+	for (i = 0; i < HISTORY_MAC_BYTE; i++)	{
+		message[3 + i] = block[i];
+	}
+	return (uint16_t)siphash24(key, message, HISTORY_MAC_MESSAGE_SIZE);
+}
+
+#ifdef DEBUG_MAC_BENCHMARK
+/**
+ * user_mac_benchmark - measure cpu cycles of the mac calculation for one copy
+ *
+ *		Timer1 counts with prescaler 8 during the measurement (a mac needs
+ *		more than 65535 cycles) and is restored afterwards. Has to be called
+ *		before the interrupts are enabled.
+ */
+static void user_mac_benchmark(void)
+{
+	uint8_t block[RFID_BLOCK_SIZE] = {0};
+	uint8_t tccr1b = TCCR1B;
+	uint8_t timsk1 = TIMSK1;
+
+	TIMSK1 &= ~(1 << OCIE1A);
+	TCCR1B = (1 << CS11); /* normal mode, prescaler 8 */
+	TCNT1 = 0;
+	history_mac(block, 1, FOX_NUMBER_FIRST);
+	uint32_t cycles = (uint32_t)TCNT1 * 8;
+	TCCR1B = tccr1b;
+	TCNT1 = 0;
+	TIFR1 = (1 << OCF1A) | (1 << TOV1);
+	TIMSK1 = timsk1;
+
+	uart_send_text_sram("mac benchmark history_mac: ");
+	uart_send_int(cycles);
+	uart_send_text_sram(" cycles");
+	UART_NEWLINE();
+}
+#endif
+
+/**
+ * user_read_newest_copy - read the newest valid history copy of a fox from tag
+ * @num:		fox number
+ * @newest:		pointer to buffer with RFID_BLOCK_SIZE bytes where the newest
+ *				copy is stored
+ * @copy:		pointer where the number of the newest copy is stored, or
+ *				HISTORY_NO_COPY if there is no valid copy on the tag
+ *
+ *		Return: STATUS_OK on success, STATUS_??? if the tag could not be read
+ */
+static uint8_t user_read_newest_copy(uint8_t num, uint8_t *newest, uint8_t *copy)
+{
+	uint8_t buffer_length = RFID_BLOCK_SIZE + 2;
+	uint8_t buffer[buffer_length];
+	uint8_t ret = STATUS_OK;
+	uint8_t i, j;
+
+	*copy = HISTORY_NO_COPY;
+	for (i = 0; i < RFID_BLOCK_SIZE; i++)	{
+		newest[i] = 0;
+	}
+	for (i = 0; i < HISTORY_COPIES; i++)	{
+		uint8_t len = buffer_length;
+		ret = rfid_read_block(get_history_block_physical(i, num), buffer, &len);
 		if (ret != STATUS_OK)	{
-			tries++;
-			if (tries > HISTORY_WRITE_MAX_TRIES)	{
-				goto user_write_history_return;
-			} else {
-				i--; /* try to write this block another time */
+			return ret;
+		}
+		if (len != buffer_length)	{
+			return STATUS_ERROR;
+		}
+		if (history_crc(buffer) != buffer[HISTORY_CRC_BYTE])	{
+			continue; /* broken or empty copy */
+		}
+		if (*copy == HISTORY_NO_COPY ||
+				(int8_t)(buffer[HISTORY_VERSION_BYTE] - newest[HISTORY_VERSION_BYTE]) > 0)	{
+			*copy = i;
+			for (j = 0; j < RFID_BLOCK_SIZE; j++)	{
+				newest[j] = buffer[j];
 			}
-		} else {
-			tries = 0; /* if writing of block was successful -> reset tries */
 		}
 	}
+	return ret;
+}
+
+/**
+ * user_write_history - write history to current tag
+ * @tag_id:	tag id of the current tag, protected by the mac
+ *
+ *		The history is written as new copy into the block after the newest
+ *		valid copy. Only this block is written for each tag.
+ *
+ *		Return: TRUE on success, FALSE on failure
+ */
+static uint8_t user_write_history(uint16_t tag_id)
+{
+	uint8_t ret = STATUS_OK;
+
+	uint8_t block_temp[RFID_BLOCK_SIZE];
+	uint8_t copy;
+	uint8_t tries = 0;
+	uint8_t fox_number = morse_get_fox_number();
 
-	tries = 0;
 	while (1)	{
-		uint8_t len = block_temp_length;
-		ret = rfid_read_block(FOX_SECRET_BLOCK, block_temp, &len);
+		ret = user_read_newest_copy(fox_number, block_temp, &copy);
 		tries++;
-		if (ret == STATUS_OK && len == block_temp_length)	{
+		if (ret == STATUS_OK)	{
 			break;
 		} else if (tries > HISTORY_WRITE_MAX_TRIES)	{
 			goto user_write_history_return;
 		}
-	};
+	}
+
+	uint8_t version = block_temp[HISTORY_VERSION_BYTE] + 1;
+	if (copy == HISTORY_NO_COPY)	{
+		copy = 0;
+	} else {
+		copy = (copy + 1) % HISTORY_COPIES;
+	}
 
-	uint16_t secret = user_get_secret();
-	block_temp[FOX_SECRET_ADDRESS(morse_get_call_sign())] = secret & 0xff;
-	block_temp[FOX_SECRET_ADDRESS(morse_get_call_sign()) + 1] = secret >> 8;
+	block_temp[HISTORY_VERSION_BYTE] = version;
+	history_encode(block_temp);
+	uint16_t mac = history_mac(block_temp, tag_id, fox_number);
+	block_temp[HISTORY_MAC_BYTE] = mac & 0xff;
+	block_temp[HISTORY_MAC_BYTE + 1] = mac >> 8;
+	block_temp[HISTORY_CRC_BYTE] = history_crc(block_temp);
 
 	tries = 0;
 	while (1)	{
-		ret = rfid_write_block(FOX_SECRET_BLOCK, block_temp, RFID_BLOCK_SIZE);
+		ret = rfid_write_block(get_history_block_physical(copy, fox_number), block_temp, RFID_BLOCK_SIZE);
 		tries++;
 		if (ret == STATUS_OK)	{
 			break;
@@ -406,7 +923,7 @@ static uint8_t user_read_tag_id(uint16_t *tag_id)
 	uint8_t buffer[18];
 	uint8_t buffer_size = 18;
 	uint8_t ret;
-	ret = rfid_read_block(TAG_ID_BLOCK, buffer, &buffer_size);
+	ret = rfid_read_block(get_tag_id_block(), buffer, &buffer_size);
 	if (ret != STATUS_OK)	{
 		goto user_read_id_return;
 	}
@@ -420,19 +937,51 @@ user_read_id_return:
 	return ret;
 }
 
+/**
+ * user_send_tag_record - send the compact record of a tag to uart
+ * @tag_id_block:	pointer to the block with the tag id
+ * @copies:		the newest copy of each fox
+ */
+static void user_send_tag_record(uint8_t *tag_id_block, uint8_t copies[][RFID_BLOCK_SIZE])
+{
+	uint8_t crc = RECORD_CRC_INIT;
+	uint8_t i, j;
+
+	uart_send_text_flash((uint16_t)tag_record_msg);
+	for (i = 0; i < TAG_ID_SIZE + TAG_START_SIZE; i++)	{
+		crc = _crc_ibutton_update(crc, tag_id_block[TAG_ID_BYTE + i]);
+		uart_send_hex_byte(tag_id_block[TAG_ID_BYTE + i]);
+	}
+	for (i = 0; i <= FOX_NUMBER_MAX - FOX_NUMBER_FIRST; i++)	{
+		for (j = 0; j < RFID_BLOCK_SIZE; j++)	{
+			crc = _crc_ibutton_update(crc, copies[i][j]);
+			uart_send_hex_byte(copies[i][j]);
+		}
+	}
+	uart_send_hex_byte(crc);
+	UART_NEWLINE();
+}
+
 /**
  * user_read_tag - read history from tag and send to uart
  *
+ *		For each fox the newest valid copy of the history is sent. If there
+ *		is no valid copy of a fox, mac and entries of this fox are zero.
+ *		With compact readout only the record line is sent, see
+ *		user_send_tag_record.
+ *
  *		Return: STATUS_OK on success, STATUS_?? otherwise
  */
 uint8_t user_read_tag(void)
 {
 	uint8_t buffer_length = RFID_BLOCK_SIZE + 2;
 	uint8_t buffer[buffer_length];
+	uint8_t copies[FOX_NUMBER_MAX][RFID_BLOCK_SIZE];
 	uint8_t ret;
+	uint8_t i, j;
 
 	uint8_t len = buffer_length;
-	ret =  rfid_read_block(TAG_ID_BLOCK, buffer, &len);
+	ret =  rfid_read_block(get_tag_id_block(), buffer, &len);
 	if (ret != STATUS_OK)	{
 		goto user_read_tag_return;
 	}
@@ -441,51 +990,74 @@ uint8_t user_read_tag(void)
 		goto user_read_tag_return;
 	}
 
+	for (i = FOX_NUMBER_FIRST; i <= FOX_NUMBER_MAX; i++)	{
+		uint8_t copy;
+		ret = user_read_newest_copy(i, copies[i - FOX_NUMBER_FIRST], &copy);
+		if (ret != STATUS_OK)	{
+			goto user_read_tag_return;
+		}
+	}
+
+	if (config.compact_readout == TRUE)	{
+		user_send_tag_record(buffer, copies);
+		goto user_read_tag_return;
+	}
+
 	UART_NEWLINE();
 	uart_send_text_flash((uint16_t)tag_read_begin_msg);
 	UART_NEWLINE();
 	UART_NEWLINE();
 
-	uint8_t i;
-	for (i = 0; i <= READ_TAG_MSG_MAX; i++)	{
-		uint16_t temp = buffer[i * 2] | (buffer[i * 2 + 1] << 8);
+	uart_send_text_flash((uint16_t)read_tag_msg[0]);
+	uart_send_int((uint16_t)buffer[TAG_ID_BYTE] | (buffer[TAG_ID_BYTE + 1] << 8));
+	UART_NEWLINE();
+	uint32_t start = 0;
+	for (i = 0; i < TAG_START_SIZE; i++)	{
+		start |= (uint32_t)buffer[TAG_START_BYTE + i] << (8 * i);
+	}
+	uart_send_text_flash((uint16_t)start_timestamp_msg);
+	uart_send_int(start);
+	UART_NEWLINE();
+	for (i = FOX_NUMBER_FIRST; i <= FOX_NUMBER_MAX; i++)	{
+		uint8_t *copy = copies[i - FOX_NUMBER_FIRST];
 		uart_send_text_flash((uint16_t)read_tag_msg[i]);
-		if (i != 0)
-			uart_send_text_flash((uint16_t)secret_msg);
-		uart_send_int(temp);
+		uart_send_text_flash((uint16_t)mac_msg);
+		uart_send_int((uint16_t)copy[HISTORY_MAC_BYTE] | (copy[HISTORY_MAC_BYTE + 1] << 8));
 		UART_NEWLINE();
 	}
 	UART_NEWLINE();
 
-	uint8_t j;
 	for (i = FOX_NUMBER_FIRST; i <= FOX_NUMBER_MAX; i++)	{
+		uint8_t *copy = copies[i - FOX_NUMBER_FIRST];
 		uart_send_text_flash((uint16_t)read_tag_msg[i]);
 		uart_send_text_flash((uint16_t)history_msg);
 		UART_NEWLINE();
 
-		for (j = 0; j < HISTORY_BLOCKS; j++)	{
-			len = buffer_length;
-			ret = rfid_read_block(get_history_block_physical(j, i), buffer, &len);
-			if (ret != STATUS_OK)	{
-				goto user_read_tag_return;
-			}
-			if (len != buffer_length)	{
-				ret = STATUS_ERROR;
-				goto user_read_tag_return;
-			}
-			uint8_t k;
-			for (k = 0; k < HISTORY_ENTRIES_PER_BLOCK; k++)	{
-				uart_send_text_flash((uint16_t)tag_id);
-				uart_send_int((uint16_t)buffer[k * HISTORY_ENTRY_SIZE] | (buffer[k * HISTORY_ENTRY_SIZE + 1] << 8));
-				UART_NEWLINE();
-				uart_send_text_flash((uint16_t)timestamp_msg);
-				uart_send_int((uint16_t)buffer[k * HISTORY_ENTRY_SIZE + 2] | (buffer[k * HISTORY_ENTRY_SIZE + 3] << 8));
-				UART_NEWLINE();
-			}
+		uint8_t pos = HISTORY_PAYLOAD_BYTE;
+		uint16_t entry_tag_id;
+		uint32_t entry_timestamp = 0;
+		while (history_decode_next(copy, &pos, &entry_tag_id, &entry_timestamp) == TRUE)	{
+			uart_send_text_flash((uint16_t)tag_id);
+			uart_send_int(entry_tag_id);
+			UART_NEWLINE();
+			uart_send_text_flash((uint16_t)timestamp_msg);
+			uart_send_int(entry_timestamp);
+			UART_NEWLINE();
 		}
 		UART_NEWLINE();
 	}
 
+	/* raw copies for the pc software, which checks the crc itself */
+	for (i = FOX_NUMBER_FIRST; i <= FOX_NUMBER_MAX; i++)	{
+		uart_send_text_flash((uint16_t)read_tag_msg[i]);
+		uart_send_text_flash((uint16_t)data_msg);
+		for (j = 0; j < RFID_BLOCK_SIZE; j++)	{
+			uart_send_hex_byte(copies[i - FOX_NUMBER_FIRST][j]);
+		}
+		UART_NEWLINE();
+	}
+	UART_NEWLINE();
+
 	uart_send_text_flash((uint16_t)tag_read_end_msg);
 	UART_NEWLINE();
 	UART_NEWLINE();
@@ -498,49 +1070,211 @@ user_read_tag_return:
 	return ret;
 }
 
+/**
+ * user_clear_tag_history - clear the history of all foxes on the tag
+ *
+ *		The blocks are written sector by sector, so each sector is
+ *		authenticated only once.
+ *
+ *		Return: STATUS_OK if clearing was successful, returns STATUS_??? otherwise
+ */
+static uint8_t user_clear_tag_history(void)
+{
+	uint8_t buffer[RFID_BLOCK_SIZE] = {0};
+	uint8_t ret = STATUS_OK;
+	uint8_t num, copy;
+
+	for (num = FOX_NUMBER_FIRST; num <= FOX_NUMBER_MAX; num++)	{
+		for (copy = 0; copy < HISTORY_COPIES; copy++)	{
+			ret = rfid_write_block(get_history_block_physical(copy, num), buffer, RFID_BLOCK_SIZE);
+			if (ret != STATUS_OK)	{
+				return ret;
+			}
+		}
+	}
+	return ret;
+}
+
 /**
  * user_write_id - write an tag id to a tag
  * @tag_id: the 16-bit id to write on the tag
  *
+ *		The history of all foxes on the tag is cleared before.
+ *
  *		Return: STATUS_OK if writing was successful, returns STATUS_??? otherwise
  */
 static uint8_t user_write_tag_id(uint16_t tag_id)
 {
-	uint8_t buffer[16] = {0};
-	uint8_t length = 16;
+	uint8_t buffer[RFID_BLOCK_SIZE] = {0};
 	uint8_t ret;
-	uint8_t i;
 
-	for (i = MIFARE_BLOCK_MIN; i <= MIFARE_BLOCK_MAX; i++)	{
-		if ((i % 4) != 3)	{
-			/* do not write access bit blocks! */
-			ret = rfid_write_block(i, buffer, length);
-		} else {
-			ret = STATUS_OK;
-		}
-		if (ret != STATUS_OK)	{
-			goto user_write_id_return_code;
+	ret = user_clear_tag_history();
+	if (ret != STATUS_OK)	{
+		return ret;
+	}
+	buffer[TAG_ID_BYTE] = tag_id & 0xff;
+	buffer[TAG_ID_BYTE + 1] = tag_id >> 8;
+	return rfid_write_block(get_tag_id_block(), buffer, RFID_BLOCK_SIZE);
+}
+
+/**
+ * user_send_id_written - send the message that a tag id was written
+ * @tag_id:	the written tag id
+ */
+static void user_send_id_written(uint16_t tag_id)
+{
+	uart_send_text_sram("tag id ");
+	uart_send_int(tag_id);
+	uart_send_text_sram(" written!");
+	UART_NEWLINE();
+}
+
+/**
+ * recent_tags_move_to_front - move an entry of the recent tags to index 0
+ * @index:	index of the entry
+ */
+static void recent_tags_move_to_front(uint8_t index)
+{
+	uint16_t id = recent_tag_ids[index];
+	uint32_t time = recent_tag_times[index];
+	for (; index > 0; index--)	{
+		recent_tag_ids[index] = recent_tag_ids[index - 1];
+		recent_tag_times[index] = recent_tag_times[index - 1];
+	}
+	recent_tag_ids[0] = id;
+	recent_tag_times[0] = time;
+}
+
+/**
+ * recent_tags_check - check if a tag was punched within the re-punch window
+ * @tag_id:	tag id of the punched tag
+ *
+ *		The time of the entry is not changed, so the window starts with the
+ *		punch that was written and a runner cannot extend it by tapping.
+ *
+ *		Return: TRUE if the tag was punched within the window, FALSE otherwise
+ */
+static uint8_t recent_tags_check(uint16_t tag_id)
+{
+	uint8_t i;
+	for (i = 0; i < recent_tags_count; i++)	{
+		if (recent_tag_ids[i] == tag_id)	{
+			recent_tags_move_to_front(i);
+			return (main_get_time_ms() - recent_tag_times[0] < config.repunch_window_s * 1000UL);
 		}
-		break;
 	}
+	return FALSE;
+}
 
-		buffer[TAG_ID_BYTE] = next_write_id & 0xff;
-		buffer[TAG_ID_BYTE+1] = next_write_id >> 8;
-		for (i = FOX_SECRET_ADDRESS(CALL_MOE); i < FOX_SECRET_ADDRESS(CALL_MO5) + FOX_SECRET_SIZE; i++)	{
-			buffer[i] = 0;
+/**
+ * recent_tags_add - store a written punch in the recent tags
+ * @tag_id:	tag id of the punched tag
+ */
+static void recent_tags_add(uint16_t tag_id)
+{
+	uint8_t i;
+	for (i = 0; i < recent_tags_count; i++)	{
+		if (recent_tag_ids[i] == tag_id)	{
+			break;
 		}
-		length = 16;
-		ret = rfid_write_block(TAG_ID_BLOCK, buffer, length);
-		if (ret != STATUS_OK)	{
-			goto user_write_id_return_code;
+	}
+	if (i == recent_tags_count)	{
+		if (recent_tags_count < RECENT_TAGS_MAX)	{
+			recent_tags_count++;
+		} else {
+			i = RECENT_TAGS_MAX - 1; /* overwrite least recently used tag */
 		}
-	if (ret == STATUS_OK)	{
-		/* tag write was successful */
-		write_id = FALSE;
 	}
-user_write_id_return_code:
-	rfid_close_tag();
-	return ret;
+	recent_tag_ids[i] = tag_id;
+	recent_tag_times[i] = main_get_time_ms();
+	recent_tags_move_to_front(i);
+}
+
+/**
+ * user_register_tag - write the next id of the id queue to the tag
+ *
+ *		Return: STATUS_OK on success or if there is no id to write,
+ *		STATUS_??? otherwise
+ */
+static uint8_t user_register_tag(void)
+{
+	uint16_t tag_id;
+	uint8_t ret;
+
+	if (id_queue_count == 0)	{
+		return STATUS_OK;
+	}
+	ret = user_read_tag_id(&tag_id);
+	if (ret != STATUS_OK)	{
+		return ret;
+	}
+	if (recent_tags_check(tag_id) == TRUE)	{
+		/* tag was just registered and came back into the field */
+		user_rfid_led_on();
+		return STATUS_OK;
+	}
+
+	tag_id = id_queue[id_queue_read];
+	ret = user_write_tag_id(tag_id);
+	if (ret != STATUS_OK)	{
+		uart_send_text_flash((uint16_t)write_tag_id_error_msg);
+		UART_NEWLINE();
+		return ret;
+	}
+	id_queue_read = (id_queue_read + 1) % ID_QUEUE_MAX;
+	id_queue_count--;
+	recent_tags_add(tag_id);
+	user_send_id_written(tag_id);
+	user_rfid_led_on();
+	return STATUS_OK;
+}
+
+/**
+ * user_start_tag - clear the history of the tag and store the start time
+ *
+ *		Return: STATUS_OK on success, STATUS_??? otherwise
+ */
+static uint8_t user_start_tag(void)
+{
+	uint8_t buffer_length = RFID_BLOCK_SIZE + 2;
+	uint8_t buffer[buffer_length];
+	uint8_t len = buffer_length;
+	uint8_t ret;
+	uint8_t i;
+
+	ret = rfid_read_block(get_tag_id_block(), buffer, &len);
+	if (ret != STATUS_OK)	{
+		return ret;
+	}
+	if (len != buffer_length)	{
+		return STATUS_ERROR;
+	}
+	uint16_t tag_id = buffer[TAG_ID_BYTE] | (buffer[TAG_ID_BYTE + 1] << 8);
+	if (recent_tags_check(tag_id) == TRUE)	{
+		user_rfid_led_on();
+		return STATUS_OK;
+	}
+
+	ret = user_clear_tag_history();
+	if (ret != STATUS_OK)	{
+		return ret;
+	}
+	uint32_t timestamp = user_get_timestamp();
+	for (i = 0; i < TAG_START_SIZE; i++)	{
+		buffer[TAG_START_BYTE + i] = timestamp >> (8 * i);
+	}
+	ret = rfid_write_block(get_tag_id_block(), buffer, RFID_BLOCK_SIZE);
+	if (ret != STATUS_OK)	{
+		return ret;
+	}
+	recent_tags_add(tag_id);
+	uart_send_text_flash((uint16_t)start_written_msg);
+	uart_send_int(tag_id);
+	uart_send_text_flash((uint16_t)timestamp_msg);
+	uart_send_int(timestamp);
+	UART_NEWLINE();
+	user_rfid_led_on();
+	return STATUS_OK;
 }
 
 /*
@@ -554,6 +1288,10 @@ void user_init(void)
 {
 #ifdef NEW_PROTOTYPE
 	RFID_DDR |= (1 << RFID_LED);
+#endif
+	user_check_ext_eeprom_pointer();
+#ifdef DEBUG_MAC_BENCHMARK
+	user_mac_benchmark();
 #endif
 }
 
@@ -564,7 +1302,22 @@ void user_show_configuration(void)
 {
 	uart_send_text_sram("Secret key: ");
 
-	uart_send_int(user_get_secret());
+	uint8_t key[SIPHASH_KEY_SIZE];
+	uint8_t i;
+	user_get_secret(key);
+	for (i = 0; i < SIPHASH_KEY_SIZE; i++)	{
+		uart_send_hex_byte(key[i]);
+	}
+	UART_NEWLINE();
+	uart_send_text_sram("Repunch window: ");
+	uart_send_int(config.repunch_window_s);
+	uart_send_text_sram(" s");
+	UART_NEWLINE();
+	uart_send_text_sram("Compact readout: ");
+	uart_send_int(config.compact_readout);
+	UART_NEWLINE();
+	uart_send_text_sram("Station mode: ");
+	uart_send_int(config.station_mode);
 	UART_NEWLINE();
 }
 
@@ -605,69 +1358,66 @@ uint8_t user_new_tag(void)	{
 
 	if (write_id == TRUE)	{
 		ret = user_write_tag_id(next_write_id);
-		if (ret != TRUE)	{
+		if (ret != STATUS_OK)	{
 			uart_send_text_flash((uint16_t)write_tag_id_error_msg);
 			UART_NEWLINE();
-			return ret;
 		} else {
-			uart_send_text_sram("tag id ");
-			uart_send_int(next_write_id);
-			uart_send_text_sram(" written!");
-			UART_NEWLINE();
+			write_id = FALSE;
+			user_send_id_written(next_write_id);
 			last_tag_id = next_write_id;
 			user_set_read_timeout(FALSE);
 		}
+	} else if (config.station_mode == USER_STATION_REGISTER)	{
+		ret = user_register_tag();
+	} else if (config.station_mode == USER_STATION_START)	{
+		ret = user_start_tag();
 	} else {
+		/* the tag id is read only once, sector 0 stays authenticated for the secret */
+		uint16_t tag_id;
+		ret = user_read_tag_id(&tag_id);
+		if (ret != STATUS_OK)	{
+#ifdef DEBUG_WRITE_HISTORY
+			uart_send_text_sram("read id failed");
+			UART_NEWLINE();
+#endif
+			goto user_new_tag_exit;
+		} else {
+#ifdef DEBUG_WRITE_HISTORY
+			uart_send_text_sram("read id success");
+			UART_NEWLINE();
+#endif
+		}
 		/* if it is not demo fox -> write history */
 		if (morse_get_fox_number() != FOX_NUMBER_DEMO)	{
 			/* it is not demo fox -> write history */
 			if (is_started == TRUE)	{
-				static uint16_t tag_id_old = 0;
-				uint16_t tag_id;
-				ret = user_read_tag_id(&tag_id);
-				if (ret != STATUS_OK)	{
-#ifdef DEBUG_WRITE_HISTORY
-					uart_send_text_sram("read id failed");
-					UART_NEWLINE();
-#endif
+				if (recent_tags_check(tag_id) == TRUE)	{
+					/* repeated punch, only acknowledge it */
+					user_rfid_led_on();
 					goto user_new_tag_exit;
-				} else {
-#ifdef DEBUG_WRITE_HISTORY
-					uart_send_text_sram("read id success");
-					UART_NEWLINE();
-#endif
 				}
 				user_add_to_history(tag_id);
-				if (tag_id != tag_id_old)	{
-					ret = user_write_history();
-					if (ret == STATUS_OK)	{
+				ret = user_write_history(tag_id);
+				if (ret == STATUS_OK)	{
 #ifdef DEBUG_WRITE_HISTORY
-						uart_send_text_sram("history written");
+					uart_send_text_sram("history written");
 #endif
-						uart_send_text_flash((uint16_t)history_written_msg);
-						uart_send_text_sram(" tag id: ");
-						uart_send_int(tag_id);
-						UART_NEWLINE();
-						tag_id_old = tag_id;
-						history_written = TRUE;
-					} else {
+					uart_send_text_flash((uint16_t)history_written_msg);
+					uart_send_text_sram(" tag id: ");
+					uart_send_int(tag_id);
+					UART_NEWLINE();
+					recent_tags_add(tag_id);
+					history_written = TRUE;
+				} else {
 #ifdef DEBUG_WRITE_HISTORY
-						uart_send_text_sram("history failed to write");
-						UART_NEWLINE();
-						goto user_new_tag_exit;
+					uart_send_text_sram("history failed to write");
+					UART_NEWLINE();
+					goto user_new_tag_exit;
 #endif
-					}
-				} else {
-					/* also show here success light!! */
 				}
 			}
 		}
 		/* read history and send via uart */
-		uint16_t tag_id;
-		uint8_t ret = user_read_tag_id(&tag_id);
-		if (ret != STATUS_OK)	{
-			goto user_new_tag_exit;
-		}
 		if (tag_id != last_tag_id || read_timeout == TRUE)	{
 			if (user_read_tag() == STATUS_OK)	{
 				last_tag_id = tag_id;
@@ -709,6 +1459,46 @@ uint8_t user_set_id(uint16_t tag_id)
 	return FALSE;
 }
 
+/**
+ * user_queue_id - add a tag id to the id queue of the registration station
+ * @tag_id:	16-bit id to write onto a tag
+ *
+ *		Return: TRUE if the id was added, FALSE if the queue is full or
+ *		tag_id == 0 because 0 as tag id is forbidden
+ */
+uint8_t user_queue_id(uint16_t tag_id)
+{
+	if (tag_id == 0 || id_queue_count >= ID_QUEUE_MAX)	{
+		return FALSE;
+	}
+	id_queue[(id_queue_read + id_queue_count) % ID_QUEUE_MAX] = tag_id;
+	id_queue_count++;
+	return TRUE;
+}
+
+/**
+ * user_clear_id_queue - remove all ids from the id queue
+ */
+void user_clear_id_queue(void)
+{
+	id_queue_count = 0;
+}
+
+/**
+ * user_set_station_mode - set the mode of the station
+ * @mode:	USER_STATION_FOX, USER_STATION_START or USER_STATION_REGISTER
+ *
+ *		Return: TRUE if the mode was set, FALSE if mode is not valid
+ */
+uint8_t user_set_station_mode(uint8_t mode)
+{
+	if (mode > USER_STATION_MAX)	{
+		return FALSE;
+	}
+	config.station_mode = mode;
+	return TRUE;
+}
+
 /**
  * user_check_set_id_state - check if user_set_id would return TRUE
  *
@@ -734,33 +1524,47 @@ void user_cancel_set_id(void)
 }
 
 /**
- * user_set_secret - set the secret key of the fox that is written on the tags
- * secret_int:	the 16-bit secret key
+ * user_set_secret - set the secret key of the fox for the mac on the tags
+ * @key:	pointer to the SIPHASH_KEY_SIZE bytes of the key
+ */
+void user_set_secret(uint8_t *key)
+{
+	memcpy(config.secret, key, SIPHASH_KEY_SIZE);
+}
+
+/**
+ * user_set_repunch_window - set the re-punch window
+ * @seconds:	time in seconds in which a tag is not written again, 0 writes
+ *				every punch
  *
- *		Return: TRUE if secret was set correctly, FALSE if secret could not
- *		be set because it is zero and zero is not allowed
+ *		Return: TRUE if the window was set, FALSE if the value is too big
  */
-uint8_t user_set_secret(uint16_t secret_int)
+uint8_t user_set_repunch_window(uint16_t seconds)
 {
-	if (secret_int == 0)	{
+	if (seconds > USER_REPUNCH_WINDOW_MAX)	{
 		return FALSE;
 	}
-	eeprom_write_word(&secret, secret_int);
+	config.repunch_window_s = seconds;
 	return TRUE;
 }
 
 /**
- * user_get_secret - get the secret key of the fox that is written on the tags
- *
- *		Return: the 16-bit secret key
+ * user_set_compact_readout - choose the output format of read tags
+ * @compact:	TRUE to send one record line per tag, FALSE to send the
+ *				decoded history as text
  */
-uint16_t user_get_secret(void)
+void user_set_compact_readout(uint8_t compact)
 {
-	uint16_t secret_int = eeprom_read_word(&secret);
-	if (secret_int == 0)	{
-		secret_int = 1;
-	}
-	return secret_int;
+	config.compact_readout = (compact == TRUE) ? TRUE : FALSE;
+}
+
+/**
+ * user_get_secret - get the secret key of the fox for the mac on the tags
+ * @key:	pointer to buffer for the SIPHASH_KEY_SIZE bytes of the key
+ */
+void user_get_secret(uint8_t *key)
+{
+	memcpy(key, config.secret, SIPHASH_KEY_SIZE);
 }
 
 /**
@@ -775,19 +1579,19 @@ void user_print_fox_history(void)
 
 	uint16_t eeprom_pointer_end = user_get_ext_eeprom_pointer();
 	uint16_t eeprom_pointer = EXT_EEPROM_START_ADDRESS;
-	uint8_t buffer[EXT_EEPROM_ENTRY_SIZE] = {2,2,2,2};
+	uint8_t buffer[EXT_EEPROM_ENTRY_SIZE];
 
 	while (eeprom_pointer < eeprom_pointer_end)	{
-		ext_eeprom_read_block(buffer, eeprom_pointer, 4);
-		uint16_t eeprom_pointer_temp = eeprom_pointer + 4;
+		ext_eeprom_read_block(buffer, eeprom_pointer, EXT_EEPROM_ENTRY_SIZE);
+		uint16_t eeprom_pointer_temp = eeprom_pointer + EXT_EEPROM_ENTRY_SIZE;
 		if (eeprom_pointer_temp < eeprom_pointer)	{
 			break; /* overflow of eeprom_pointer happened -> break to prevent infinte loop */
 		}
 		eeprom_pointer = eeprom_pointer_temp;
 		uart_send_text_flash((uint16_t)tag_id);
-		uart_send_int((uint16_t)buffer[0] | (buffer[1] << 8));
+		uart_send_int(history_get_tag_id(buffer));
 		uart_send_text_flash((uint16_t)timestamp_msg);
-		uart_send_int((uint16_t)buffer[2] | (buffer[3] << 8));
+		uart_send_int(history_get_timestamp(buffer));
 	}
 
 	UART_NEWLINE();
@@ -796,40 +1600,53 @@ void user_print_fox_history(void)
 	UART_NEWLINE();
 }
 
+/**
+ * user_query_tag - look up a tag id in the tag index and write result to uart
+ * @tag_id:	the tag id to look up
+ *
+ *		Outputs the number of punches and the timestamps of the first and
+ *		the last punch of this tag without reading the whole fox history.
+ *
+ *		Return: TRUE if tag id was found, FALSE otherwise
+ */
+uint8_t user_query_tag(uint16_t tag_id)
+{
+	uint16_t slot_addr;
+	uint8_t slot[EXT_EEPROM_INDEX_SLOT_SIZE];
+	uint8_t entry[EXT_EEPROM_ENTRY_SIZE];
+
+	uart_send_text_flash((uint16_t)tag_msg);
+	uart_send_int(tag_id);
+	if (user_index_find(tag_id, &slot_addr, slot) != INDEX_FOUND)	{
+		uart_send_text_flash((uint16_t)query_not_found_msg);
+		UART_NEWLINE();
+		return FALSE;
+	}
+
+	uart_send_text_flash((uint16_t)query_count_msg);
+	uart_send_int((uint16_t)slot[INDEX_SLOT_COUNT] | (slot[INDEX_SLOT_COUNT + 1] << 8));
+	uart_send_text_flash((uint16_t)query_first_msg);
+	ext_eeprom_read_block(entry, slot[INDEX_SLOT_FIRST] | (slot[INDEX_SLOT_FIRST + 1] << 8), EXT_EEPROM_ENTRY_SIZE);
+	uart_send_int(history_get_timestamp(entry));
+	uart_send_text_flash((uint16_t)query_last_msg);
+	ext_eeprom_read_block(entry, slot[INDEX_SLOT_LAST] | (slot[INDEX_SLOT_LAST + 1] << 8), EXT_EEPROM_ENTRY_SIZE);
+	uart_send_int(history_get_timestamp(entry));
+	UART_NEWLINE();
+	return TRUE;
+}
+
 /**
  * user_clear_history - deletes user history in ram and external eeprom
  */
 void user_clear_history(void)
 {
 	user_reset_ext_eeprom_pointer();
+	user_index_clear();
+	recent_tags_count = 0;
 	uint8_t i, j;
 	for (i = 0; i < HISTORY_ENTRIES_MAX; i++)	{
-		for (j = 0; j < HISTORY_ENTRIES_PER_BLOCK; j++)	{
+		for (j = 0; j < HISTORY_ENTRY_SIZE; j++)	{
 			history[i][j] = 0x00;
 		}
 	}
 }
-
-/**
- * user_time_tick - function is called regularly by main module for time base of user module
- */
-void user_time_tick(void)
-{
-	static uint8_t user_read_timeout_count = 0;
-	if (user_read_timeout_count >= (USER_READ_TIMEOUT_MS / TIMER1_MS))	{
-		user_read_timeout_count = 0;
-		user_set_read_timeout(TRUE);
-	}
-	if (user_get_read_timeout() == FALSE)	{
-		user_read_timeout_count++;
-	}
-	static uint8_t rfid_led_count = 0;
-	if (rfid_led_count >= (USER_RFID_LED_ON_MS / TIMER1_MS))	{
-		rfid_led_count = 0;
-		user_rfid_led_off();
-	}
-	if (user_get_rfid_led() == TRUE)	{
-		rfid_led_count++;
-		RFID_LED_TOGGLE();
-	}
-}
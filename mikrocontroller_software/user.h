@@ -34,6 +34,14 @@
 
 
 
+#define USER_STATION_FOX		0 /* punches are written into the history of the tags */
+#define USER_STATION_START		1 /* tags are cleared and the start time is written */
+#define USER_STATION_REGISTER	2 /* ids from the id queue are written to the tags */
+#define USER_STATION_MAX		2
+
+#define USER_REPUNCH_WINDOW_DEFAULT_S	60
+#define USER_REPUNCH_WINDOW_MAX		0xfffe
+
 void user_init(void);
 void user_show_configuration(void);
 
@@ -42,16 +50,21 @@ void user_stop_time(void);
 
 uint8_t user_new_tag(void);
 
-void user_time_tick(void);
 
 uint8_t user_set_id(uint16_t tag_id);
 void user_cancel_set_id(void);
 uint8_t user_check_set_id_state(void);
+uint8_t user_queue_id(uint16_t tag_id);
+void user_clear_id_queue(void);
+uint8_t user_set_station_mode(uint8_t mode);
 
-uint8_t user_set_secret(uint16_t secret);
-uint16_t user_get_secret(void);
+void user_set_secret(uint8_t *key);
+void user_get_secret(uint8_t *key);
+uint8_t user_set_repunch_window(uint16_t seconds);
+void user_set_compact_readout(uint8_t compact);
 
 void user_clear_history(void);
+uint8_t user_query_tag(uint16_t tag_id);
 
 void user_print_fox_history(void);
 
@@ -30,6 +30,53 @@
  * public functions
  */
 
+/**
+ * str_to_bytes_hex - convert a string with hex digits to bytes
+ * @string:	string with 1 to 2 * length hex digits (upper or lower case)
+ * @bytes:	pointer to the buffer for the bytes
+ * @length:	number of bytes in the buffer
+ *
+ *		The number is stored big endian (the first digits of the string are
+ *		in the first byte) and filled up with zeros at the beginning, so that
+ *		the last digit of the string is in the last byte.
+ *
+ *		Return: TRUE on success, FALSE if the string contains other characters
+ *		or too many digits
+ */
+uint8_t str_to_bytes_hex(char *string, uint8_t *bytes, uint8_t length)
+{
+	uint8_t digits = 0;
+	uint8_t i;
+
+	while (string[digits] != 0)	{
+		digits++;
+		if (digits > 2 * length)	{
+			return FALSE;
+		}
+	}
+	if (digits == 0)	{
+		return FALSE;
+	}
+	for (i = 0; i < length; i++)	{
+		bytes[i] = 0;
+	}
+	for (i = 0; i < digits; i++)	{
+		char c = string[digits - 1 - i];
+		uint8_t nibble;
+		if (c >= '0' && c <= '9')	{
+			nibble = c - '0';
+		} else if (c >= 'a' && c <= 'f')	{
+			nibble = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F')	{
+			nibble = c - 'A' + 10;
+		} else {
+			return FALSE;
+		}
+		bytes[length - 1 - i / 2] |= nibble << (4 * (i % 2));
+	}
+	return TRUE;
+}
+
 /**
  * str_compare_progmem - compare a string in sram and in progmem (flash memory)
  * @string1:	pointer to the first string in SRAM
@@ -31,6 +31,7 @@ uint8_t int_to_string(char *string, uint8_t length, uint32_t val);
 uint8_t int_to_string_fixed_length(char *string, uint8_t length, uint32_t val);
 uint8_t int_to_string_hex(char *string, uint8_t length, uint32_t val);
 uint8_t str_to_int(char *string, uint32_t *val);
+uint8_t str_to_bytes_hex(char *string, uint8_t *bytes, uint8_t length);
 uint8_t str_compare_progmem(const char *string1, uint16_t string2);
 void to_upper_case(char *string);
 
@@ -130,6 +130,22 @@ def SendCommand(con, command, parameter, with_error=True):
     fox_serial.Writeln(con, command + parameter)
     return True
 
+# SendConfig - send settings as one "set config" block
+# @con: the opened serial port
+# @commands: list of "set" commands like settings.COMMAND_SET_WPM
+# @parameters: list with the parameter for each command
+#
+# The fox checks all settings and saves them only if all of them are valid,
+# the response has to be read with one fox_serial.ReadToPrompt.
+#
+def SendConfig(con, commands, parameters):
+    fox_serial.Writeln(con, settings.COMMAND_SET_CONFIG)
+    for i in range(0, len(commands)):
+        name = commands[i][len(settings.COMMAND_SET_PREFIX):].strip().replace(" ", "_")
+        fox_serial.Writeln(con, name + "=" + parameters[i])
+    fox_serial.Writeln(con, settings.CONFIG_END)
+    return True
+
 def SyncTime(con, with_error=True):
     try:
         # write time
@@ -40,6 +40,7 @@ import utils
 import fox_serial
 import fox
 import fox_dialogs
+import tag_history
 
 CHECK_FOX_PROGRESS_STRING = "Check all COM-ports for connected foxes"
 
@@ -57,7 +58,7 @@ class PanelFox(wx.Panel):
 
         self.fox_secret = []
         for i in range(0, 5):
-            self.fox_secret.append(random.randint(1, 65535))
+            self.fox_secret.append("%032x" % random.getrandbits(128))
 
         # frequency 
         flex_sizer_frequency_timing.Add(wx.StaticText(self, label="Frequency:"), flag=wx.ALIGN_CENTER_VERTICAL)
@@ -359,8 +360,7 @@ class PanelFox(wx.Panel):
         else:
             modulation_string = settings.STRING_OFF
 
-        commands = [settings.COMMAND_SET_RELOAD,
-                    settings.COMMAND_SET_CALL_SIGN, 
+        commands = [settings.COMMAND_SET_CALL_SIGN, 
                     settings.COMMAND_SET_FOX_MAX,
                     settings.COMMAND_SET_TRANSMIT_MINUTE,
                     settings.COMMAND_SET_FREQUENCY,
@@ -372,11 +372,9 @@ class PanelFox(wx.Panel):
                     settings.COMMAND_SET_MODULATION,
                     settings.COMMAND_SET_MORSING,
                     settings.COMMAND_SET_AMPLITUDE,
-                    settings.COMMAND_RESET_HISTORY,
                     settings.COMMAND_SET_SECRET]
 
-        parameters = [settings.STRING_OFF,
-                      self.combobox_call[number].GetValue()[:self.combobox_call[number].GetValue().find(" ")],  # SET_CALL_SIGN
+        parameters = [self.combobox_call[number].GetValue()[:self.combobox_call[number].GetValue().find(" ")],  # SET_CALL_SIGN
                       repetition, # SET_FOX_MAX
                       transmit_minute, # SET_TRANSMIT_MINUTE
                       frequency, # SET_FREQUENCY
@@ -388,7 +386,6 @@ class PanelFox(wx.Panel):
                       modulation_string, # SET_MODULATION
                       settings.STRING_ON, # SET_MORSING
                       self.text_amplitude.GetValue(), # SET_AMPLITUDE
-                      "", # RESET HISTORY
                       secret]
 
         self.frame.Status("Program Fox " + str(number) + ": Write commands")
@@ -396,15 +393,14 @@ class PanelFox(wx.Panel):
 
         fox_serial.ReadAll(con)
 
-        # continue here -> others with commands and parameters, oscillator frequency in fox-panel
-        for i in range(0, len(commands)):
-            fox.SendCommand(con, commands[i], parameters[i], with_error=False)
+        # the settings are sent as one block, the fox saves and reloads them once
+        fox.SendCommand(con, settings.COMMAND_RESET_HISTORY, "", with_error=False)
+        fox.SendConfig(con, commands, parameters)
 
         suc = True
-        for i in range (0, len(commands)):
+        for i in range (0, 2): # response of reset history and of the settings block
             allstr = fox_serial.ReadToPrompt(con)
             if fox.CheckRespond(allstr, False) == False:
-                utils.MessageBox(i)
                 suc = False
                 break
 
@@ -421,20 +417,10 @@ class PanelFox(wx.Panel):
             utils.MessageBox("Fox " + str(number) + " does not respond correctly")
             self.frame.Status("Program Fox " + str(number) + ": Failed")
             progress_dialog.Destroy()
-            fox_serial.Writeln(con, settings.COMMAND_SET_RELOAD + settings.STRING_ON)
-            fox_serial.ReadToPrompt()
             fox_serial.Close(con)
             return False
         progress_dialog.Update(30)
 
-        fox_serial.Writeln(con, settings.COMMAND_SET_RELOAD + settings.STRING_ON)
-        allstr = fox_serial.ReadToPrompt(con)
-        if fox.CheckRespond(allstr, False) == False:
-            utils.MessageBox("Fox does not respond correctly")
-            self.frame.Status("Program Fox " + str(number) + ": Failed")
-            fox_serial.Close(con)
-            return False
-
         self.frame.Status("Fox " + str(number) + " programmed successfully")
 
         fox_serial.Close(con)
@@ -559,12 +545,14 @@ class PanelFox(wx.Panel):
 
                 try:
                     temp = fox_x.attrib['secret']
-                    self.fox_secret[i] = int(temp)
+                    if tag_history.KeyFromHex(temp) == None:
+                        raise ValueError
+                    self.fox_secret[i] = temp
                 except KeyError:
                     utils.MessageBox("File is not valid, \"" + fox_name + "\"-tag does not have a \"secret\"-attribute")
                     return False
                 except ValueError:
-                    utils.MessageBox("File is not valid, \"" + fox_name + "\"-tag does not have an integer number as \"secret\"-attribute")
+                    utils.MessageBox("File is not valid, \"" + fox_name + "\"-tag does not have a hex number with up to 32 digits as \"secret\"-attribute")
                     return False
 
         repetition_interval = fox.find("repetition_interval")
@@ -41,6 +41,7 @@ import utils
 import fox_serial
 import fox
 import fox_dialogs
+import tag_history
 
 class PanelResult(wx.Panel):
 
@@ -217,6 +218,10 @@ class PanelResult(wx.Panel):
         if self.con_listen_tag == None:
             return
 
+        # one short record line per tag is much faster than the text
+        fox_serial.Writeln(self.con_listen_tag, settings.COMMAND_SET_COMPACT_READOUT + "on")
+        fox_serial.ReadToPrompt(self.con_listen_tag)
+
         self.thread_listen_tag = self.ListenThread(self, self.con_listen_tag)
         self.thread_listen_tag.start()
         self.Bind(self.EVT_TAG_FOUND, self.TagFound)
@@ -245,53 +250,68 @@ class PanelResult(wx.Panel):
                 utils.MessageBox("Error reading tag")
                 return False
 
-        ret = self.TestString(tag_string[1], settings.TAG_TAG_ID)
-        if ret[0] != False and ret[1] != False:
-            tag_id = ret[2]
-        else:
+        # the first line with a tag id is the id of the tag, the other ones
+        # belong to the decoded histories, which are only meant for reading
+        tag_id = None
+        data = [None, None, None, None, None]
+        for line in tag_string:
+            pos = line.find(settings.MESSAGE_TAG_RECORD)
+            if pos >= 0:
+                ret = tag_history.DecodeRecord(tag_history.FromHex(line[pos + len(settings.MESSAGE_TAG_RECORD):]))
+                if ret[0] == False:
+                    return False
+                tag_id = ret[1]
+                data = ret[2]
+                break
+            if tag_id == None and line.find(settings.TAG_TAG_ID) >= 0:
+                ret = self.TestString(line, settings.TAG_TAG_ID)
+                if ret[1] == False:
+                    return False
+                tag_id = ret[2]
+            for i in range(0, 5):
+                pos = line.find(settings.TAG_FOX_DATA[i])
+                if pos >= 0:
+                    data[i] = tag_history.FromHex(line[pos + len(settings.TAG_FOX_DATA[i]):])
+        if tag_id == None:
             return False
 
-        secret = []
+        # the raw copies are checked and decoded here, a broken or missing
+        # copy is treated like a fox without history
+        history = []
         for i in range(0, 5):
-            ret = self.TestString(tag_string[2 + i], settings.TAG_FOX[i])
-            if ret[0] != False and ret[1] != False:
-                secret.append(ret[2])
-            else:
+            if data[i] == None:
                 return False
-        
-        history_tag_id = []
-        history_timestamp = []
-        for j in range(0, 5):
-            history_tag_id.append([])
-            history_timestamp.append([])
-            for i in range(0, settings.TAG_HISTORY_ENTRIES_PER_FOX):
-                ret = self.TestString(tag_string[9 + j * (settings.TAG_HISTORY_ENTRIES_PER_FOX * 2 + 2) + 2 * i], settings.TAG_TAG_ID) # + 2 because of one line with "" and one line with "Fox x:"
-                if ret[0] != False and ret[1] != False:
-                    history_tag_id[j].append(ret[2])
-                else:
-                    return False
-                ret = self.TestString(tag_string[9 + j * (settings.TAG_HISTORY_ENTRIES_PER_FOX * 2 + 2) + 2 * i + 1], settings.TAG_TIMESTAMP) # + 2 because of one line with "" and one line with "Fox x:"
-                if ret[0] != False and ret[1] != False:
-                    history_timestamp[j].append(ret[2])
-                else:
-                    return False
+            ret = tag_history.Decode(data[i])
+            history.append(ret[3])
 
-        # check secret:
+        # check mac with the secret key of each fox:
         correct_secret = [True, True, True, True, True]
         all_secrets_correct = True
         secret_msg = ""
         for i in range(0, 5):
-            if self.panel_fox.GetSecret()[i] != secret[i]:
+            key = tag_history.KeyFromHex(self.panel_fox.GetSecret()[i])
+            if tag_history.Verify(key, tag_id, i + 1, data[i]) == False:
                 correct_secret[i] = False
                 secret_msg += "n"
                 all_secrets_correct = False
             else:
                 secret_msg += "y"
 
+        # the fox sends the newest valid copy of each fox history with the
+        # newest entry first -> the first entry with the id of this tag is the
+        # last punch of this tag at the fox, no entry means fox not found
         time = []
         for i in range(0, 5):
+            timestamp = None
+            for entry in history[i]:
+                if entry[0] == tag_id:
+                    timestamp = entry[1]
+                    break
+            if timestamp == None:
+                time.append("")
+                continue
             tim = self.panel_fox.GetStartTime()
-            tim.AddTS(wx.TimeSpan(0, 0, history_timestamp[i][0], 0))
+            tim.AddTS(wx.TimeSpan(0, 0, timestamp, 0))
             time.append(tim.FormatISOTime())
 
         self.AddElement(tag_id, time, secret_msg)
@@ -387,7 +407,11 @@ class PanelResult(wx.Panel):
             self.stop = False
             while self.stop == False:
                 line = fox_serial.Readln(self.con)
-                if line.find(settings.MESSAGE_NEW_TAG) >= 0:
+                if line.find(settings.MESSAGE_TAG_RECORD) >= 0:
+                    self.allstr = [line]
+                    evt = self._parent.TagFoundEvent(self._parent.myEVT_TAG_FOUND, -1)
+                    wx.PostEvent(self._parent, evt)
+                elif line.find(settings.MESSAGE_NEW_TAG) >= 0:
                     self.allstr = fox_serial.ReadToEndTag(self.con)
                     evt = self._parent.TagFoundEvent(self._parent.myEVT_TAG_FOUND, -1)
                     wx.PostEvent(self._parent, evt)
@@ -62,6 +62,7 @@ class PanelUser(wx.Panel):
         button_add = wx.Button(self, label="Add")
         button_edit = wx.Button(self, label="Edit")
         button_delete = wx.Button(self, label="Delete")
+        button_program_all = wx.Button(self, label="Program All")
         button_clear_programmed = wx.Button(self, label="Clear Flag Created")
         button_clear_all = wx.Button(self, label="Clear All")
 
@@ -83,6 +84,7 @@ class PanelUser(wx.Panel):
         box_sizer_vertical.Add(button_edit, flag=wx.EXPAND)
         box_sizer_vertical.Add(button_delete, flag=wx.EXPAND)
         box_sizer_vertical.AddSpacer(30)
+        box_sizer_vertical.Add(button_program_all, flag=wx.EXPAND)
         box_sizer_vertical.Add(button_clear_programmed, flag=wx.EXPAND)
         box_sizer_vertical.Add(button_clear_all, flag=wx.EXPAND)
         box_sizer_vertical.AddSpacer(30)
@@ -96,6 +98,7 @@ class PanelUser(wx.Panel):
         self.Bind(wx.EVT_BUTTON, self.Delete, button_delete)
         self.Bind(wx.EVT_BUTTON, self.ClearAll, button_clear_all)
         self.Bind(wx.EVT_BUTTON, self.ClearFlagsCreated, button_clear_programmed)
+        self.Bind(wx.EVT_BUTTON, self.ProgramAll, button_program_all)
 
         self.buttons_program = []
         self.checkbox_created = []
@@ -165,12 +168,33 @@ class PanelUser(wx.Panel):
         self.tag_id_set_id =  self.list_ctrl.GetItem(index, 1).GetText()
         self.index_set_id = index
 
+        com = self.GetFoxCom()
+        if com == None:
+            return
+
+        self.progress_dialog_set_id = wx.ProgressDialog("Set Transponder ID", "Take the transponder near the rfid module", 2, parent=self, style=wx.PD_APP_MODAL|wx.PD_AUTO_HIDE|wx.PD_CAN_ABORT)
+        self.progress_dialog_set_id.SetInitialSize()
+        self.progress_dialog_set_id.Update(0)
+
+        self.con_set_id = fox_serial.Open(com)
+        if self.con_set_id == None:
+            self.progress_dialog_set_id.Destroy()
+            return
+
+        fox.SendCommand(self.con_set_id, settings.COMMAND_SET_ID, str(self.tag_id_set_id))
+
+        self.timer_set_id = wx.Timer(self)
+        self.timer_set_id.Start(1000)
+        self.Bind(wx.EVT_TIMER, self.SetIdTimer, self.timer_set_id)
+
+    def GetFoxCom(self):
+        # returns the serial port of the selected fox or None
         fox_number = self.combobox_fox.GetValue()
         if fox_number == settings.DEMO_FOX_STRING:
             fox_number = 0
         elif fox_number == settings.NO_FOX_MESSAGE:
             utils.MessageBox("No Fox Detected! Connect fox and press Refresh-button in Fox-tab")
-            return False
+            return None
         else:
             fox_number = int(fox_number)
         
@@ -186,22 +210,8 @@ class PanelUser(wx.Panel):
 
         if com[fox_number] == "":
             utils.MessageBox("Selected Fox does not seem to be connected")
-            return
-
-        self.progress_dialog_set_id = wx.ProgressDialog("Set Transponder ID", "Take the transponder near the rfid module", 2, parent=self, style=wx.PD_APP_MODAL|wx.PD_AUTO_HIDE|wx.PD_CAN_ABORT)
-        self.progress_dialog_set_id.SetInitialSize()
-        self.progress_dialog_set_id.Update(0)
-
-        self.con_set_id = fox_serial.Open(com[fox_number])
-        if self.con_set_id == None:
-            self.progress_dialog_set_id.Destroy()
-            return
-
-        fox.SendCommand(self.con_set_id, settings.COMMAND_SET_ID, str(self.tag_id_set_id))
-
-        self.timer_set_id = wx.Timer(self)
-        self.timer_set_id.Start(1000)
-        self.Bind(wx.EVT_TIMER, self.SetIdTimer, self.timer_set_id)
+            return None
+        return com[fox_number]
 
     def SetIdTimer(self, event):
         self.timer_set_id.Stop()
@@ -223,6 +233,70 @@ class PanelUser(wx.Panel):
             return
         self.timer_set_id.Start(1500)
 
+    def ProgramAll(self, event):
+        # the fox is switched to registration station and gets a queue of the
+        # ids of all tags that are not created yet, it writes them to one tag
+        # after the other without further commands
+        self.program_all_pending = []
+        for i in range(0, len(self.checkbox_created)):
+            if self.checkbox_created[i].GetValue() == False:
+                self.program_all_pending.append([i, int(self.list_ctrl.GetItem(i, 1).GetText())])
+        if len(self.program_all_pending) == 0:
+            return
+        self.program_all_queued = []
+        self.program_all_written = 0
+
+        com = self.GetFoxCom()
+        if com == None:
+            return
+
+        self.con_program_all = fox_serial.Open(com)
+        if self.con_program_all == None:
+            return
+
+        self.progress_dialog_program_all = wx.ProgressDialog("Program All Transponders", "Take the transponders near the rfid module one after the other", len(self.program_all_pending), parent=self, style=wx.PD_APP_MODAL|wx.PD_AUTO_HIDE|wx.PD_CAN_ABORT)
+        self.progress_dialog_program_all.SetInitialSize()
+
+        fox.SendCommand(self.con_program_all, settings.COMMAND_CLEAR_ID_QUEUE, "")
+        fox.SendCommand(self.con_program_all, settings.COMMAND_SET_STATION, "register")
+        while len(self.program_all_pending) > 0 and len(self.program_all_queued) < settings.ID_QUEUE_MAX:
+            self.ProgramAllQueueNext()
+
+        self.timer_program_all = wx.Timer(self)
+        self.timer_program_all.Start(500)
+        self.Bind(wx.EVT_TIMER, self.ProgramAllTimer, self.timer_program_all)
+
+    def ProgramAllQueueNext(self):
+        element = self.program_all_pending.pop(0)
+        self.program_all_queued.append(element)
+        fox.SendCommand(self.con_program_all, settings.COMMAND_QUEUE_ID, str(element[1]))
+
+    def ProgramAllTimer(self, event):
+        self.timer_program_all.Stop()
+        retstr = fox_serial.Readln(self.con_program_all, False)
+        while retstr != "":
+            for element in self.program_all_queued:
+                if retstr.find("tag id " + str(element[1]) + " written!") >= 0:
+                    self.checkbox_created[element[0]].SetValue(True)
+                    self.program_all_queued.remove(element)
+                    self.program_all_written = self.program_all_written + 1
+                    self.frame.Status("Tag " + str(element[1]) + " successfully written!")
+                    if len(self.program_all_pending) > 0:
+                        self.ProgramAllQueueNext()
+                    break
+            retstr = fox_serial.Readln(self.con_program_all, False)
+
+        ret = self.progress_dialog_program_all.Update(self.program_all_written)
+        if ret[0] == False or len(self.program_all_queued) == 0:
+            # user cancelled or all tags written
+            self.progress_dialog_program_all.Destroy()
+            fox.SendCommand(self.con_program_all, settings.COMMAND_CLEAR_ID_QUEUE, "")
+            fox.SendCommand(self.con_program_all, settings.COMMAND_SET_STATION, "fox")
+            fox_serial.ReadToPrompt(self.con_program_all, False)
+            fox_serial.Close(self.con_program_all)
+            return
+        self.timer_program_all.Start(500)
+
         
     def ClearAll(self, event):
         dialog = wx.MessageDialog(self, "Clear all participants?", style=wx.YES_NO|wx.CANCEL)
@@ -86,6 +86,14 @@ COMMAND_SET_ID = "set id "
 COMMAND_SET_RELOAD = "set reload "
 COMMAND_RELOAD = "reload "
 COMMAND_SET_SECRET = "set secret "
+COMMAND_SET_COMPACT_READOUT = "set compact readout "
+COMMAND_SET_STATION = "set station "
+COMMAND_QUEUE_ID = "queue id "
+COMMAND_CLEAR_ID_QUEUE = "clear id queue "
+COMMAND_SET_CONFIG = "set config"
+COMMAND_SET_PREFIX = "set "
+CONFIG_END = "end" # ends the block of a "set config" command
+ID_QUEUE_MAX = 32 # ids the fox can queue, see user.c
 
 STRING_TRUE = "True"
 STRING_FALSE = "False"
@@ -99,8 +107,7 @@ SEARCH_FOXES_START_KEY = "search_foxes_at_start"
 MESSAGE_NEW_TAG = "--- NEW TAG 0x55005500 ---"
 MESSAGE_END_TAG = "--- END TAG 0x55005500 ---"
 MESSAGE_ERROR_TAG = "ERROR TAG 0x55005500"
+MESSAGE_TAG_RECORD = "--- TAG RECORD 0x55005500 --- "
 TAG_TAG_ID = "Tag ID: "
-TAG_FOX = ["Fox 1 Secret: ", "Fox 2 Secret: ", "Fox 3 Secret: ", "Fox 4 Secret: ", "Fox 5 Secret: "]
 TAG_TIMESTAMP = "Timestamp: "
-
-TAG_HISTORY_ENTRIES_PER_FOX = 12
+TAG_FOX_DATA = ["Fox 1 Data: ", "Fox 2 Data: ", "Fox 3 Data: ", "Fox 4 Data: ", "Fox 5 Data: "]
@@ -0,0 +1,232 @@
+#!/usr/bin/python
+# -*- coding: utf-8 -*-
+
+#
+# tag_history.py - Decode and encode the fox history copies stored on a tag
+# Copyright (C) 2016  Simon Kaufmann, HeKa
+#
+# This file is part of ADRF transmitter firmware.
+#
+# ADRF Transmitter is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# ADRF transmitter firmware is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with ADRF Transmitter.  
+# If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Layout of one history copy (16 bytes), see user.c in the firmware:
+# byte 0:       version
+# byte 1-12:    packed entries, newest entry first
+# byte 13-14:   mac (little endian)
+# byte 15:      crc over byte 0-14 (Dallas/iButton crc8, start value 0xff)
+#
+# The mac is the lowest 16 bits of SipHash-2-4 with the secret key of the fox
+# over the tag id (2 bytes, little endian), the fox number and byte 0-12.
+# The foxes do not check the mac, only Verify does at the readout, so a
+# forged copy passes with probability 2^-16 and a failed one is reported.
+#
+# Every entry is the tag id and a time, both as varint. The time of the first
+# entry is the timestamp, the time of the other entries is the difference to
+# the timestamp of the entry before.
+
+BLOCK_SIZE = 16
+VERSION_BYTE = 0
+PAYLOAD_BYTE = 1
+PAYLOAD_END = 13
+MAC_BYTE = 13
+KEY_SIZE = 16
+KEY_DIGITS = 2 * KEY_SIZE
+CRC_BYTE = 15
+CRC_INIT = 0xff
+VARINT_MAX_SIZE = 5
+
+# Compact record of a tag (sent with "set compact readout on"):
+# byte 0-1:     tag id (little endian)
+# byte 2-5:     start timestamp written by a start station (little endian)
+# then one history copy for each of the FOXES foxes
+# last byte:    crc over all bytes before
+FOXES = 5
+RECORD_TAG_ID_SIZE = 2
+RECORD_START_SIZE = 4
+RECORD_HEADER_SIZE = RECORD_TAG_ID_SIZE + RECORD_START_SIZE
+RECORD_SIZE = RECORD_HEADER_SIZE + FOXES * BLOCK_SIZE + 1
+
+def Crc(data):
+    crc = CRC_INIT
+    for byte in data:
+        crc = crc ^ byte
+        for i in range(0, 8):
+            if crc & 0x01:
+                crc = (crc >> 1) ^ 0x8c
+            else:
+                crc = crc >> 1
+    return crc
+
+def VarintPut(val):
+    data = []
+    while val >= 0x80:
+        data.append((val & 0x7f) | 0x80)
+        val = val >> 7
+    data.append(val)
+    return data
+
+def VarintGet(data, pos, end):
+    # returns [value, position after varint] or None if varint is incomplete
+    val = 0
+    i = 0
+    while pos + i < end and i < VARINT_MAX_SIZE:
+        val = val | ((data[pos + i] & 0x7f) << (7 * i))
+        if data[pos + i] & 0x80 == 0:
+            return [val, pos + i + 1]
+        i = i + 1
+    return None
+
+MASK64 = 0xffffffffffffffff
+
+def _Rotl(x, b):
+    return ((x << b) | (x >> (64 - b))) & MASK64
+
+def _SipRound(v):
+    v[0] = (v[0] + v[1]) & MASK64
+    v[1] = _Rotl(v[1], 13) ^ v[0]
+    v[0] = _Rotl(v[0], 32)
+    v[2] = (v[2] + v[3]) & MASK64
+    v[3] = _Rotl(v[3], 16) ^ v[2]
+    v[0] = (v[0] + v[3]) & MASK64
+    v[3] = _Rotl(v[3], 21) ^ v[0]
+    v[2] = (v[2] + v[1]) & MASK64
+    v[1] = _Rotl(v[1], 17) ^ v[2]
+    v[2] = _Rotl(v[2], 32)
+
+def _Le64(data):
+    val = 0
+    for i in range(len(data) - 1, -1, -1):
+        val = (val << 8) | data[i]
+    return val
+
+def SipHash24(key, data):
+    # same as siphash24 in siphash.c, key and data are lists of bytes
+    k0 = _Le64(key[0:8])
+    k1 = _Le64(key[8:16])
+    v = [k0 ^ 0x736f6d6570736575, k1 ^ 0x646f72616e646f6d,
+         k0 ^ 0x6c7967656e657261, k1 ^ 0x7465646279746573]
+    full = len(data) - len(data) % 8
+    blocks = [_Le64(data[i:i + 8]) for i in range(0, full, 8)]
+    blocks.append(_Le64(data[full:]) | ((len(data) & 0xff) << 56))
+    for m in blocks:
+        v[3] ^= m
+        _SipRound(v)
+        _SipRound(v)
+        v[0] ^= m
+    v[2] ^= 0xff
+    for i in range(0, 4):
+        _SipRound(v)
+    return v[0] ^ v[1] ^ v[2] ^ v[3]
+
+def KeyFromHex(string):
+    # converts the secret key with up to KEY_DIGITS hex digits to bytes the
+    # same way as the "set secret" command of the fox, None if not valid
+    string = string.strip()
+    if len(string) == 0 or len(string) > KEY_DIGITS:
+        return None
+    return FromHex(string.zfill(KEY_DIGITS))
+
+def Mac(key, tag_id, fox_number, data):
+    message = [tag_id & 0xff, (tag_id >> 8) & 0xff, fox_number] + list(data[0:MAC_BYTE])
+    return SipHash24(key, message) & 0xffff
+
+def Verify(key, tag_id, fox_number, data):
+    # True if the copy has a valid crc and was written by the fox with the key
+    if key == None or len(data) != BLOCK_SIZE or Crc(data[0:CRC_BYTE]) != data[CRC_BYTE]:
+        return False
+    mac = data[MAC_BYTE] | (data[MAC_BYTE + 1] << 8)
+    return mac == Mac(key, tag_id, fox_number, data)
+
+def Encode(version, key, tag_id, fox_number, entries):
+    # entries is a list of [tag_id, timestamp], newest entry first. Entries
+    # that do not fit completely into the copy are left out. tag_id and
+    # fox_number are the tag and fox the copy is written for (for the mac).
+    data = [version & 0xff]
+    timestamp_newer = None
+    for entry in entries:
+        entry_tag_id = entry[0]
+        timestamp = entry[1]
+        if entry_tag_id == 0:
+            break
+        if timestamp_newer == None:
+            time = timestamp
+        elif timestamp > timestamp_newer:
+            break
+        else:
+            time = timestamp_newer - timestamp
+        packed = VarintPut(entry_tag_id) + VarintPut(time)
+        if len(data) + len(packed) > PAYLOAD_END:
+            break
+        data = data + packed
+        timestamp_newer = timestamp
+    data = data + [0] * (PAYLOAD_END - len(data))
+    mac = Mac(key, tag_id, fox_number, data)
+    data = data + [mac & 0xff, (mac >> 8) & 0xff]
+    data.append(Crc(data))
+    return data
+
+def Decode(data):
+    # returns [valid, version, mac, entries], entries is a list of
+    # [tag_id, timestamp] with the newest entry first. An invalid copy has
+    # version 0, mac 0 and no entries like a fox without history. The mac is
+    # checked with Verify.
+    if len(data) != BLOCK_SIZE or Crc(data[0:CRC_BYTE]) != data[CRC_BYTE]:
+        return [False, 0, 0, []]
+
+    entries = []
+    pos = PAYLOAD_BYTE
+    timestamp = 0
+    while pos < PAYLOAD_END and data[pos] != 0:
+        ret = VarintGet(data, pos, PAYLOAD_END)
+        if ret == None or ret[0] > 0xffff:
+            break
+        tag_id = ret[0]
+        ret = VarintGet(data, ret[1], PAYLOAD_END)
+        if ret == None:
+            break
+        pos = ret[1]
+        if len(entries) == 0:
+            timestamp = ret[0]
+        else:
+            timestamp = timestamp - ret[0]
+        entries.append([tag_id, timestamp])
+
+    mac = data[MAC_BYTE] | (data[MAC_BYTE + 1] << 8)
+    return [True, data[VERSION_BYTE], mac, entries]
+
+def DecodeRecord(data):
+    # returns [valid, tag id, list with the copy of each fox, start timestamp]
+    if data == None or len(data) != RECORD_SIZE:
+        return [False, 0, [], 0]
+    if Crc(data[:-1]) != data[-1]:
+        return [False, 0, [], 0]
+    tag_id = data[0] | (data[1] << 8)
+    start_timestamp = 0
+    for i in range(0, RECORD_START_SIZE):
+        start_timestamp |= data[RECORD_TAG_ID_SIZE + i] << (8 * i)
+    copies = []
+    for i in range(0, FOXES):
+        start = RECORD_HEADER_SIZE + i * BLOCK_SIZE
+        copies.append(data[start:start + BLOCK_SIZE])
+    return [True, tag_id, copies, start_timestamp]
+
+def FromHex(string):
+    # converts the hex dump sent by the fox into a list of bytes
+    string = string.strip()
+    try:
+        return [int(string[i:i + 2], 16) for i in range(0, len(string), 2)]
+    except ValueError:
+        return None